@@ -18,6 +18,7 @@
 #include <cassert>
 
 #include <stxxl/bits/noncopyable.h>
+#include <stxxl/bits/unused.h>
 #include <stxxl/bits/common/rand.h>
 #include <stxxl/bits/common/simple_vector.h>
 
@@ -41,7 +42,15 @@ class random_pager
 
 public:
     enum { n_pages = npages_ };
-    random_pager() { }
+    random_pager(unsigned_type npages = npages_)
+    {
+        STXXL_UNUSED(npages);
+        assert(npages == npages_);
+    }
+    unsigned_type size() const
+    {
+        return npages_;
+    }
     int_type kick()
     {
         return rnd(npages_);
@@ -66,12 +75,19 @@ class lru_pager : private noncopyable
 public:
     enum { n_pages = npages_ };
 
-    lru_pager() : history_entry(n_pages)
+    lru_pager(size_type npages = npages_) : history_entry(n_pages)
     {
+        STXXL_UNUSED(npages);
+        assert(npages == npages_);
         for (size_type i = 0; i < n_pages; ++i)
             history_entry[i] = history.insert(history.end(), i);
     }
 
+    size_type size() const
+    {
+        return npages_;
+    }
+
     size_type kick()
     {
         return history.back();
@@ -108,6 +124,11 @@ public:
             history_entry[i] = history.insert(history.end(), i);
     }
 
+    size_type size() const
+    {
+        return n_pages;
+    }
+
     size_type kick()
     {
         return history.back();
@@ -127,6 +148,19 @@ public:
     }
 };
 
+//! \brief The number of pages of the pager type, 0 for the pager sized at runtime (\c lru_pager<0>)
+template <class Pager>
+struct pager_traits
+{
+    enum { n_pages = Pager::n_pages };
+};
+
+template <>
+struct pager_traits<lru_pager<0> >
+{
+    enum { n_pages = 0 };
+};
+
 //! \}
 
 __STXXL_END_NAMESPACE
@@ -20,6 +20,7 @@
 #include <algorithm>
 
 #include <stxxl/bits/deprecated.h>
+#include <stxxl/bits/common/error_handling.h>
 #include <stxxl/bits/io/request_operations.h>
 #include <stxxl/bits/mng/mng.h>
 #include <stxxl/bits/mng/typed_block.h>
@@ -747,7 +748,7 @@ public:
     enum constants {
         block_size = BlkSize_,
         page_size = PgSz_,
-        n_pages = pager_type::n_pages,
+        n_pages = pager_traits<pager_type>::n_pages,
         on_disk = -1
     };
 
@@ -773,6 +774,9 @@ private:
     bids_container_type _bids;
     mutable pager_type pager;
 
+    // the number of pages in the cache, n_pages of the pager type or given at runtime for lru_pager<0>
+    int_type _npages;
+
     enum { valid_on_disk = 0, uninitialized = 1, dirty = 2 };
     mutable std::vector<unsigned char> _page_status;
     mutable std::vector<int_type> _page_to_slot;
@@ -806,16 +810,23 @@ private:
     }
 
 public:
-    vector(size_type n = 0) :
+    //! \param n the number of elements
+    //! \param npages the number of pages in the cache, must be given and positive for the runtime sized pager (\c lru_pager<0>)
+    vector(size_type n = 0, unsigned_type npages = n_pages) :
         _size(n),
         _bids(div_ceil(n, block_type::size)),
+        pager(npages),
+        _npages(npages),
         _page_status(div_ceil(_bids.size(), page_size)),
         _page_to_slot(div_ceil(_bids.size(), page_size)),
-        _slot_to_page(n_pages),
+        _slot_to_page(_npages),
         _cache(NULL),
         _from(NULL),
         exported(false)
     {
+        if (_npages <= 0)
+            STXXL_THROW_INVALID_ARGUMENT("the vector needs at least one page in its cache");
+
         bm = block_manager::get_instance();
         cfg = config::get_instance();
 
@@ -828,7 +839,7 @@ public:
             _page_to_slot[i] = on_disk;
         }
 
-        for (i = 0; i < n_pages; ++i)
+        for (i = 0; i < _npages; ++i)
             _free_slots.push(i);
 
         bm->new_blocks(alloc_strategy, _bids.begin(), _bids.end(), 0);
@@ -840,6 +851,7 @@ public:
         std::swap(_size, obj._size);
         std::swap(_bids, obj._bids);
         std::swap(pager, obj.pager);
+        std::swap(_npages, obj._npages);
         std::swap(_page_status, obj._page_status);
         std::swap(_page_to_slot, obj._page_to_slot);
         std::swap(_slot_to_page, obj._slot_to_page);
@@ -852,7 +864,7 @@ public:
     void allocate_page_cache() const
     {
         if (!_cache)
-            _cache = new simple_vector<block_type>(n_pages * page_size);
+            _cache = new simple_vector<block_type>(_npages * page_size);
     }
 
     // allows to free the cache, but you may not access any element until call allocate_pacge_cache() again
@@ -978,7 +990,7 @@ public:
             _free_slots.pop();
 
 
-        for (int_type i = 0; i < n_pages; ++i)
+        for (int_type i = 0; i < _npages; ++i)
             _free_slots.push(i);
     }
 
@@ -1015,16 +1027,21 @@ public:
     //! \warning Only one \c vector can be assigned to a particular (physical) file.
     //! The block size of the vector must be a multiple of the element size
     //! \c sizeof(Tp_) and the page size (4096).
-    vector(file * from, size_type size = size_type(-1)) :
+    vector(file * from, size_type size = size_type(-1), unsigned_type npages = n_pages) :
         _size((size == size_type(-1)) ? size_from_file_length(from->size()) : size),
         _bids(div_ceil(_size, size_type(block_type::size))),
+        pager(npages),
+        _npages(npages),
         _page_status(div_ceil(_bids.size(), page_size)),
         _page_to_slot(div_ceil(_bids.size(), page_size)),
-        _slot_to_page(n_pages),
+        _slot_to_page(_npages),
         _cache(NULL),
         _from(from),
         exported(false)
     {
+        if (_npages <= 0)
+            STXXL_THROW_INVALID_ARGUMENT("the vector needs at least one page in its cache");
+
         // initialize from file
         if (!block_type::has_only_data)
         {
@@ -1046,7 +1063,7 @@ public:
             _page_to_slot[i] = on_disk;
         }
 
-        for (i = 0; i < n_pages; ++i)
+        for (i = 0; i < _npages; ++i)
             _free_slots.push(i);
 
 
@@ -1064,9 +1081,11 @@ public:
     vector(const vector & obj) :
         _size(obj.size()),
         _bids(div_ceil(obj.size(), block_type::size)),
+        pager(obj._npages),
+        _npages(obj._npages),
         _page_status(div_ceil(_bids.size(), page_size)),
         _page_to_slot(div_ceil(_bids.size(), page_size)),
-        _slot_to_page(n_pages),
+        _slot_to_page(_npages),
         _cache(NULL),
         _from(NULL),
         exported(false)
@@ -1084,7 +1103,7 @@ public:
             _page_to_slot[i] = on_disk;
         }
 
-        for (i = 0; i < n_pages; ++i)
+        for (i = 0; i < _npages; ++i)
             _free_slots.push(i);
 
         bm->new_blocks(alloc_strategy, _bids.begin(), _bids.end(), 0);
@@ -1178,9 +1197,9 @@ public:
 
     void flush() const
     {
-        simple_vector<bool> non_free_slots(n_pages);
+        simple_vector<bool> non_free_slots(_npages);
         int_type i = 0;
-        for ( ; i < n_pages; i++)
+        for ( ; i < _npages; i++)
             non_free_slots[i] = true;
 
         while (!_free_slots.empty())
@@ -1189,7 +1208,7 @@ public:
             _free_slots.pop();
         }
 
-        for (i = 0; i < n_pages; i++)
+        for (i = 0; i < _npages; i++)
         {
             _free_slots.push(i);
             int_type page_no = _slot_to_page[i];
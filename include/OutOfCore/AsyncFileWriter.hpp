@@ -0,0 +1,162 @@
+#ifndef _ASYNC_FILE_WRITER_HPP
+#define _ASYNC_FILE_WRITER_HPP
+
+#include "ImageStorage.hpp"
+
+#include <deque>
+#include <vector>
+
+#include <boost/assert.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/noncopyable.hpp>
+
+/**
+ * @class AsyncFileWriter AsyncFileWriter.hpp
+ *
+ * @brief Write the data nodes into the image storage in the background writer threads, so the disk writing 
+ * overlaps the producer which fills the next buffer.
+ *
+ * The producer hands over a full buffer by write(), the buffer is swapped out with a recycled one,
+ * thus every producer buffer works as a double buffer. When there are max_pending buffers waiting to be
+ * written, write() blocks until a writer thread finishes one, so the memory usage is bounded.
+ * @see HierarchicalImage
+ *
+ * @tparam T The type of the image cells
+ */
+
+template<typename T>
+class AsyncFileWriter : private boost::noncopyable
+{
+public:
+	/**
+	 * @param storage the storage to write the nodes, which must support the concurrent writing
+	 * @param thread_number the number of the writer threads, at least 1
+	 * @param max_pending the maximum number of the buffers waiting to be written, at least 1
+	 */
+	AsyncFileWriter(ImageStorage &storage, size_t thread_number, size_t max_pending)
+		: m_storage(storage), m_max_pending(max_pending < 1 ? 1 : max_pending), m_stopping(false), m_failed(false)
+	{
+		if(thread_number < 1) thread_number = 1;
+		for(size_t i = 0; i < thread_number; ++i) {
+			m_threads.create_thread(boost::bind(&AsyncFileWriter::writer_loop, this));
+		}
+	}
+
+	~AsyncFileWriter()
+	{
+		wait();
+	}
+
+	/**
+	 * @brief write the first count cells of data into the node of the level in the background
+	 *
+	 * @param level the image level
+	 * @param node_no the node number in the level
+	 * @param data [In/Out] the data to write, it is swapped with a recycled buffer which has the same size
+	 * @param count the number of cells to write
+	 * @return false if any previous writing has failed
+	 */
+	bool write(size_t level, size_t node_no, std::vector<T> &data, size_t count)
+	{
+		BOOST_ASSERT(count <= data.size());
+
+		boost::unique_lock<boost::mutex> lock(m_mutex);
+		while(m_jobs.size() >= m_max_pending && !m_failed) {
+			m_job_done.wait(lock);
+		}
+		if(m_failed) return false;
+
+		m_jobs.push_back(Job());
+		m_jobs.back().level = level;
+		m_jobs.back().node_no = node_no;
+		m_jobs.back().count = count;
+		m_jobs.back().data.swap(data);
+
+		/* give back a recycled buffer with the same size */
+		size_t size = m_jobs.back().data.size();
+		if(!m_free_buffers.empty()) {
+			data.swap(m_free_buffers.back());
+			m_free_buffers.pop_back();
+		}
+		data.resize(size);
+
+		m_job_ready.notify_one();
+		return true;
+	}
+
+	/**
+	 * @brief wait all the data written and stop the writer threads
+	 * @return whether all the data nodes are written successfully
+	 */
+	bool wait()
+	{
+		{
+			boost::lock_guard<boost::mutex> lock(m_mutex);
+			m_stopping = true;
+		}
+		m_job_ready.notify_all();
+		m_threads.join_all();
+
+		return !m_failed;
+	}
+
+private:
+	struct Job
+	{
+		size_t level;
+		size_t node_no;
+		std::vector<T> data;
+		size_t count;
+	};
+
+	void writer_loop()
+	{
+		for(;;) {
+			Job job;
+			{
+				boost::unique_lock<boost::mutex> lock(m_mutex);
+				while(m_jobs.empty() && !m_stopping) {
+					m_job_ready.wait(lock);
+				}
+				if(m_jobs.empty()) return;
+
+				job.level = m_jobs.front().level;
+				job.node_no = m_jobs.front().node_no;
+				job.data.swap(m_jobs.front().data);
+				job.count = m_jobs.front().count;
+				m_jobs.pop_front();
+			}
+
+			bool success = m_storage.write_cells(job.level, job.node_no, job.data.data(), job.count*sizeof(T), sizeof(T));
+
+			{
+				boost::lock_guard<boost::mutex> lock(m_mutex);
+				if(!success) m_failed = true;
+				m_free_buffers.push_back(std::vector<T>());
+				m_free_buffers.back().swap(job.data);
+			}
+			m_job_done.notify_all();
+		}
+	}
+
+private:
+	ImageStorage &m_storage;
+
+	boost::thread_group m_threads;
+	boost::mutex m_mutex;
+
+	/** signaled when a job is pushed or the writer is stopping */
+	boost::condition_variable m_job_ready;
+	/** signaled when a job is finished */
+	boost::condition_variable m_job_done;
+
+	std::deque<Job> m_jobs;
+	std::vector<std::vector<T> > m_free_buffers;
+
+	size_t m_max_pending;
+	bool m_stopping;
+	bool m_failed;
+};
+
+#endif
@@ -7,6 +7,7 @@ typedef unsigned int uint;
 typedef unsigned long ulong;
 typedef unsigned long long ulonglong;
 typedef __int64  int64;
+typedef unsigned __int64  uint64;
 
 template<typename T>
 struct PixelElement
@@ -4,9 +4,15 @@
 #pragma warning(disable:4307 4244 4250 4290 4800 4018 4204)
 
 #include "GiantImageInterface.h"
+#include "IndexPolicy.h"
+#include "ImageTile.h"
+#include "ImageStorage.hpp"
+#include "ImageHead.hpp"
+#include "NodeCodec.hpp"
 #include "UtlityFunc.h"
 
 #include <string>
+#include <boost/assert.hpp>
 
 /* stxxl part */
 #include <stxxl.h>
@@ -22,13 +28,20 @@
  * BlockwiseImage can support very big image processing and storing, and can be wrote into the disk in a non compressed way.
  *
  * @tparam T The type of the image cell
- * @tparam memory_usage The memory usage used as a I/O cache in the main memory, and it must be bigger than 8 (in the unit of M).
- *		 By default, memory_usage is set to 64M
+ * @tparam memory_usage The default memory usage used as a I/O cache in the main memory (in the unit of M), it is used when 
+ *		 the constructor is not given the runtime memory budget. By default, memory_usage is set to 64M
+ * @tparam IndexMethod The compile-time index method type. If it is a concrete index method class (such as ZOrderIndex), 
+ *		 the index computing is inlined into the pixel accessing loop instead of the virtual function call, and the index 
+ *		 method object must be that type. By default, it is IndexMethodInterface that uses any index method in runtime.
  */
 
-template<typename T, unsigned memory_usage = 64>
+template<typename T, unsigned memory_usage = 64, typename IndexMethod = IndexMethodInterface>
 class BlockwiseImage: public GiantImageInterface<T>
 {
+public:
+	/** the policy to compute the cell index */
+	typedef IndexPolicy<IndexMethod> IndexPolicyType;
+
 public:
 
 	/**
@@ -41,10 +54,14 @@ public:
 	 * @param cols the image cols
 	 * @param mini_rows the minimum rows of the image
 	 * @param mini_cols the minimum cols of the image 
-	 * @param method  the index method shared_ptr object(default is zorder index method)
+	 * @param method  the index method shared_ptr object(default is created by IndexPolicy<IndexMethod>, thus zorder
+	 * index method for IndexMethodInterface)
+	 * @param memory_budget the I/O cache size in bytes, it is rounded down to whole pages(at least one page). 
+	 * 0 means using the memory_usage template parameter
 	 */
 	BlockwiseImage(int rows, int cols, int mini_rows, int mini_cols, 
-		boost::shared_ptr<IndexMethodInterface> method = boost::shared_ptr<IndexMethodInterface>());
+		boost::shared_ptr<IndexMethodInterface> method = boost::shared_ptr<IndexMethodInterface>(),
+		int64 memory_budget = 0);
 
 	virtual ~BlockwiseImage();
 
@@ -70,6 +87,34 @@ public:
 	virtual T& at(IndexMethodInterface::IndexType index);
 	virtual const T& at(IndexMethodInterface::IndexType index) const;
 
+public:
+	/**
+	 * @brief : the non virtual version of operator(), when the image type is known, calling this function in 
+	 * the loop avoids both the virtual call of the image and the index method
+	 */
+	inline T& pixel(int row, int col);
+	inline const T& pixel(int row, int col) const;
+
+	/**
+	 * @brief : pin the aligned tile whose size is 2^tile_order, the tile cells are copied into the row-major
+	 * memory of the ImageTile, so the image container is touched once per block instead of once per cell.
+	 * With the zorder like index methods the cells of the tile are one successive index range.
+	 *
+	 * @param tile_row the tile row, thus the tile start row is tile_row * 2^tile_order
+	 * @param tile_col the tile col
+	 * @param tile_order the tile size is 2^tile_order
+	 * @param tile [Out] the pinned tile, which is valid until unpin_tile() is called
+	 * @return whether pin the tile successfully
+	 */
+	bool pin_tile(int tile_row, int tile_col, int tile_order, ImageTile<T> &tile) const;
+
+	/**
+	 * @brief : unpin the tile that was pinned by pin_tile()
+	 * @param tile the pinned tile
+	 * @param write_back whether write the tile data back into the image
+	 */
+	bool unpin_tile(ImageTile<T> &tile, bool write_back = true);
+
 public:
 	/** 
 	 * @brief : get the minimum image size
@@ -82,12 +127,35 @@ public:
 	 */
 	inline size_t get_max_image_level() const;
 
+	/**
+	 * @brief : get the actual I/O cache size in bytes, thus the number of cache pages * the page size
+	 */
+	inline int64 get_memory_budget() const;
+
+	/**
+	 * @brief : set the format of the written image data.
+	 *
+	 * ImageStorage::DIRECTORY_STORAGE (by default) saves one file per node in the directory beside the .bigimage file, 
+	 * ImageStorage::PACKED_STORAGE packs all the nodes into the .bigimage file with a node directory.
+	 */
+	inline void set_storage_format(ImageStorage::StorageFormat format);
+	inline ImageStorage::StorageFormat get_storage_format() const;
+
+	/**
+	 * @brief : set the codec to compress the written image data nodes, NodeCodec::NO_CODEC (by default) saves the raw cells.
+	 *
+	 * The codec is recorded in the image head, and DiskBigImage decompresses the nodes when loading them into the cache.
+	 */
+	inline void set_compression_codec(NodeCodec::CodecType codec);
+	inline NodeCodec::CodecType get_compression_codec() const;
+
 protected:
 
 	/**
 	 *	@brief : write the image head info before write the actual image data
+	 *	@param max_level the max level of the image, 0 means only the full size level
 	 */
-	bool write_image_head_file(const char* file_name);
+	bool write_image_head_file(const char* file_name, size_t max_level = 0);
 
 	/**
 	 * @brief : set the minimum image size according to the image size (rows, cols).
@@ -101,6 +169,12 @@ protected:
 	 */
 	void set_minimal_resolution(int rows, int cols, int mini_rows, int mini_cols);
 
+	/**
+	 *	@brief create the storage for writing the image data, must be called after the head file is written.
+	 *	The data directory of the formal image is removed.
+	 */
+	boost::shared_ptr<ImageStorage> create_image_storage(const char *file_name);
+
 	/**
 	 *	@brief save the mini size image as a jpg file for observation
 	 *	@param file_name the bigimage file name (*.bigimage)
@@ -108,45 +182,117 @@ protected:
 	 */
 	virtual bool save_mini_image(const char* file_name);
 
+	/**
+	 *	@brief copy the successive cells [front, front + count) of the image container, 
+	 *	each block of the container is touched only once.
+	 */
+	void read_container_range(IndexMethodInterface::IndexType front, size_t count, T *dst) const;
+	void write_container_range(IndexMethodInterface::IndexType front, size_t count, const T *src);
+
+	/**
+	 *	@brief fill the successive cells [front, front + count) of the image container with the value
+	 */
+	void fill_container_range(IndexMethodInterface::IndexType front, size_t count, const T &value);
+
 protected:
 
 	/**
 	 * @brief saves the image data in the disk.
 	 * 
 	 *	4 means a page has 4 blocks
-	 *	lru_pages<n> : n means the number of pages in memory
-	 *	each block is 2M , thus total memroy usage = 8M * (number of pages) , thus why right shift 3 bit
+	 *	lru_pager<0> : the number of pages in memory is given at runtime
+	 *	each block is 2M , thus total memroy usage = 8M * (number of pages)
 	 */
-	typedef stxxl::vector<T, 4, stxxl::lru_pager<(memory_usage >> 3)> >  ContainerType;
+	typedef stxxl::vector<T, 4, stxxl::lru_pager<0> >  ContainerType;
 	ContainerType img_container;
 
+	/**
+	 * @brief : get the number of cache pages for the memory budget in bytes
+	 */
+	static size_t get_cache_pages(int64 memory_budget);
+
 	size_t m_mini_rows, m_mini_cols;
 	size_t m_max_level;
+
+	/** the number of pages of the I/O cache */
+	size_t m_cache_pages;
+
+	/** the format of the written image data */
+	ImageStorage::StorageFormat m_storage_format;
+
+	/** the codec of the written image data nodes */
+	NodeCodec::CodecType m_compression_codec;
 };
 
-template<typename T, unsigned memory_usage>
-inline size_t BlockwiseImage<T, memory_usage>::get_minimal_image_rows() const
+template<typename T, unsigned memory_usage, typename IndexMethod>
+inline size_t BlockwiseImage<T, memory_usage, IndexMethod>::get_minimal_image_rows() const
 {
 	return m_mini_rows;
 }
 
-template<typename T, unsigned memory_usage>
-inline size_t BlockwiseImage<T, memory_usage>::get_minimal_image_cols() const
+template<typename T, unsigned memory_usage, typename IndexMethod>
+inline size_t BlockwiseImage<T, memory_usage, IndexMethod>::get_minimal_image_cols() const
 {
 	return m_mini_cols;
 }
 
-template<typename T, unsigned memory_usage>
-inline size_t BlockwiseImage<T, memory_usage>::get_max_image_level() const 
+template<typename T, unsigned memory_usage, typename IndexMethod>
+inline size_t BlockwiseImage<T, memory_usage, IndexMethod>::get_max_image_level() const 
 {
 	return m_max_level;
 }
 
+template<typename T, unsigned memory_usage, typename IndexMethod>
+inline int64 BlockwiseImage<T, memory_usage, IndexMethod>::get_memory_budget() const
+{
+	const int64 page_bytes = int64(ContainerType::block_type::raw_size) * ContainerType::page_size;
+	return page_bytes * m_cache_pages;
+}
+
+template<typename T, unsigned memory_usage, typename IndexMethod>
+inline void BlockwiseImage<T, memory_usage, IndexMethod>::set_storage_format(ImageStorage::StorageFormat format)
+{
+	m_storage_format = format;
+}
+
+template<typename T, unsigned memory_usage, typename IndexMethod>
+inline ImageStorage::StorageFormat BlockwiseImage<T, memory_usage, IndexMethod>::get_storage_format() const
+{
+	return m_storage_format;
+}
+
+template<typename T, unsigned memory_usage, typename IndexMethod>
+inline void BlockwiseImage<T, memory_usage, IndexMethod>::set_compression_codec(NodeCodec::CodecType codec)
+{
+	m_compression_codec = codec;
+}
+
+template<typename T, unsigned memory_usage, typename IndexMethod>
+inline NodeCodec::CodecType BlockwiseImage<T, memory_usage, IndexMethod>::get_compression_codec() const
+{
+	return m_compression_codec;
+}
+
+template<typename T, unsigned memory_usage, typename IndexMethod>
+inline T& BlockwiseImage<T, memory_usage, IndexMethod>::pixel(int row, int col)
+{
+	BOOST_ASSERT(0 <= row && row < img_size.rows && 0 <= col && col < img_size.cols);
+	return img_container[IndexPolicyType::get_index(*index_method, row, col)];
+}
+
+template<typename T, unsigned memory_usage, typename IndexMethod>
+inline const T& BlockwiseImage<T, memory_usage, IndexMethod>::pixel(int row, int col) const
+{
+	BOOST_ASSERT(0 <= row && row < img_size.rows && 0 <= col && col < img_size.cols);
+	const ContainerType &c_img_container = img_container;
+	return c_img_container[IndexPolicyType::get_index(*index_method, row, col)];
+}
+
 /**
- * @brief return the block wise image by memroy_usage, maximum support 4G.
+ * @brief return the block wise image by memroy_usage, the memory usage is not limited to the power of 2.
  * 
  * @relates BlockwiseImage
- * @param memory_usage the memory usage of the main memory
+ * @param memory_usage the memory usage of the main memory (in the unit of M), at least 8M
  * @param method the index method shared_ptr object
  * @param rows the image total rows
  * @param cols the image total cols
@@ -162,36 +308,7 @@ boost::shared_ptr<GiantImageInterface<T> > get_block_wise_image_by_meomory_usage
 	/* ensure memory_usage is bigger than 8 */
 	memory_usage = (memory_usage < 8) ? 8 : memory_usage;
 
-	/* make memory_usage = 2^order (order >=3 && order <= 12) */
-	while(memory_usage & (memory_usage - 1)) {
-		memory_usage &= (memory_usage - 1);
-	}
-
-	switch(memory_usage)
-	{
-	case 8:
-		return boost::make_shared<BlockwiseImage<T, 8> >(rows, cols, mini_rows, mini_cols, method);
-	case 16:
-		return boost::make_shared<BlockwiseImage<T, 16> >(rows, cols, mini_rows, mini_cols, method);
-	case 32:
-		return boost::make_shared<BlockwiseImage<T, 32> >(rows, cols, mini_rows, mini_cols, method);
-	case 64:
-		return boost::make_shared<BlockwiseImage<T, 64> >(rows, cols, mini_rows, mini_cols, method);
-	case 128:
-		return boost::make_shared<BlockwiseImage<T, 128> >(rows, cols, mini_rows, mini_cols, method);
-	case 256:
-		return boost::make_shared<BlockwiseImage<T, 256> >(rows, cols, mini_rows, mini_cols, method);
-	case 512:
-		return boost::make_shared<BlockwiseImage<T, 512> >(rows, cols, mini_rows, mini_cols, method);
-	case 1024:
-		return boost::make_shared<BlockwiseImage<T, 1024> >(rows, cols, mini_rows, mini_cols, method);
-	case 2048:
-		return boost::make_shared<BlockwiseImage<T, 2048> >(rows, cols, mini_rows, mini_cols, method);
-	case 4096:
-		return boost::make_shared<BlockwiseImage<T, 4096> >(rows, cols, mini_rows, mini_cols, method);
-	default:
-		return boost::make_shared<BlockwiseImage<T, 64> >(rows, cols, mini_rows, mini_cols, method);
-	}
+	return boost::make_shared<BlockwiseImage<T> >(rows, cols, mini_rows, mini_cols, method, int64(memory_usage) << 20);
 }
 
 /**
@@ -9,7 +9,7 @@
 
 #include <string>
 #include <fstream>
-#include <strstream>
+#include <algorithm>
 
 #ifdef SAVE_MINI_IMAGE
 /*---------------------------------------------*/
@@ -30,24 +30,39 @@
 /*---------------------------------------------*/
 #endif
 
-template<typename T, unsigned memory_usage>
-BlockwiseImage<T, memory_usage>::BlockwiseImage(int rows, int cols, int mini_rows, int mini_cols, 
-	boost::shared_ptr<IndexMethodInterface> method)
-	: GiantImageInterface(method ? method : (boost::shared_ptr<IndexMethodInterface>(new ZOrderIndex(rows, cols))))
+template<typename T, unsigned memory_usage, typename IndexMethod>
+size_t BlockwiseImage<T, memory_usage, IndexMethod>::get_cache_pages(int64 memory_budget)
 {
+	if(memory_budget <= 0) memory_budget = int64(memory_usage) << 20;
+
+	/* the pager needs at least one page */
+	const int64 page_bytes = int64(ContainerType::block_type::raw_size) * ContainerType::page_size;
+	return (memory_budget < page_bytes) ? 1 : size_t(memory_budget / page_bytes);
+}
+
+template<typename T, unsigned memory_usage, typename IndexMethod>
+BlockwiseImage<T, memory_usage, IndexMethod>::BlockwiseImage(int rows, int cols, int mini_rows, int mini_cols, 
+	boost::shared_ptr<IndexMethodInterface> method, int64 memory_budget)
+	: GiantImageInterface(method ? method : IndexPolicyType::create(rows, cols)), 
+	img_container(typename ContainerType::size_type(0), get_cache_pages(memory_budget)), m_cache_pages(get_cache_pages(memory_budget)),
+	m_storage_format(ImageStorage::DIRECTORY_STORAGE), m_compression_codec(NodeCodec::NO_CODEC)
+{
+	/* the compile-time index method must be the type of the index method object */
+	BOOST_ASSERT_MSG(IndexPolicyType::is_valid(index_method.get()), "index method type not correct");
+
 	init(rows, cols);
 	set_minimal_resolution(rows, cols, mini_rows, mini_cols);
 }
 
-template<typename T, unsigned memory_usage>
-bool BlockwiseImage<T, memory_usage>::reset()
+template<typename T, unsigned memory_usage, typename IndexMethod>
+bool BlockwiseImage<T, memory_usage, IndexMethod>::reset()
 {
 	init(0, 0);
 	return true;
 }
 
-template<typename T, unsigned memory_usage>
-bool BlockwiseImage<T, memory_usage>::init(int rows, int cols)
+template<typename T, unsigned memory_usage, typename IndexMethod>
+bool BlockwiseImage<T, memory_usage, IndexMethod>::init(int rows, int cols)
 {
 	BOOST_ASSERT(rows >= 0 && cols >= 0);
 
@@ -61,8 +76,8 @@ bool BlockwiseImage<T, memory_usage>::init(int rows, int cols)
 	return true;
 }
 
-template<typename T, unsigned memory_usage>
-void BlockwiseImage<T, memory_usage>::set_minimal_resolution(int rows, int cols, int mini_rows, int mini_cols)
+template<typename T, unsigned memory_usage, typename IndexMethod>
+void BlockwiseImage<T, memory_usage, IndexMethod>::set_minimal_resolution(int rows, int cols, int mini_rows, int mini_cols)
 {
 	BOOST_ASSERT(m_mini_rows >= 0 && m_mini_cols >= 0 && rows >= mini_rows && cols >= mini_cols);
 
@@ -77,19 +92,22 @@ void BlockwiseImage<T, memory_usage>::set_minimal_resolution(int rows, int cols,
 	/* ensure the smallest image (the max scale level) is not less than mini_rows or mini_cols which user specified */
 	m_max_level = (level_row < level_col) ? level_row : level_col;
 
+	/* the index method may not support all the hierarchical levels */
+	while(m_max_level > 0 && !index_method->get_level_index_method(m_max_level)) --m_max_level;
+
 	/* recalculate the mini_rows and mini_cols */
 	m_mini_rows = std::ceil((double)(rows) / (1 << m_max_level));
 	m_mini_cols = std::ceil((double)(cols) / (1 << m_max_level));
 }
 
-template<typename T, unsigned memory_usage>
-BlockwiseImage<T, memory_usage>::~BlockwiseImage()
+template<typename T, unsigned memory_usage, typename IndexMethod>
+BlockwiseImage<T, memory_usage, IndexMethod>::~BlockwiseImage()
 {
 	img_container.clear();
 }
 
-template<typename T, unsigned memory_usage>
-bool BlockwiseImage<T, memory_usage>::set_pixels(int start_row, int start_col, int rows, int cols, const std::vector<T> &data)
+template<typename T, unsigned memory_usage, typename IndexMethod>
+bool BlockwiseImage<T, memory_usage, IndexMethod>::set_pixels(int start_row, int start_col, int rows, int cols, const std::vector<T> &data)
 {
 	if(start_row < 0 || start_col < 0 || start_row > (get_image_rows()-1) || start_col > (get_image_cols()-1)
 		|| rows <= 0 || cols <= 0 || (start_row+rows) > get_image_rows() || (start_col+cols) > get_image_cols()) {
@@ -100,17 +118,19 @@ bool BlockwiseImage<T, memory_usage>::set_pixels(int start_row, int start_col, i
 	if(data.size() < (rows*cols))	return false;
 
 	size_t count = 0;
+	const IndexMethodInterface &method = *index_method;
+	std::vector<IndexMethodInterface::IndexType> row_indexes(cols);
 	for(IndexMethodInterface::RowMajorIndexType row = 0; row < rows; ++row) {
-		IndexMethodInterface::IndexType row_result = index_method->get_row_result(start_row+row);
+		IndexPolicyType::get_row_indexes(method, start_row+row, start_col, start_col+cols, &row_indexes[0]);
 		for(IndexMethodInterface::RowMajorIndexType col = 0; col < cols; ++col) {
-			img_container[index_method->get_index_by_row_result(row_result, start_col+col)] = data[count++];
+			img_container[row_indexes[col]] = data[count++];
 		}
 	}
 	return true;
 }
 
-template<typename T, unsigned memory_usage>
-bool BlockwiseImage<T, memory_usage>::get_pixels(int start_row, int start_col, int rows, int cols, std::vector<T> &data) const
+template<typename T, unsigned memory_usage, typename IndexMethod>
+bool BlockwiseImage<T, memory_usage, IndexMethod>::get_pixels(int start_row, int start_col, int rows, int cols, std::vector<T> &data) const
 {
 	if(start_row < 0 || start_col < 0 || start_row > (get_image_rows()-1) || start_col > (get_image_cols()-1)
 		|| rows <= 0 || cols <= 0 || (start_row+rows) > get_image_rows() || (start_col+cols) > get_image_cols()) {
@@ -120,19 +140,21 @@ bool BlockwiseImage<T, memory_usage>::get_pixels(int start_row, int start_col, i
 
 	data.resize(rows*cols);
 
-	static const ContainerType &c_img_container = img_container;
+	const ContainerType &c_img_container = img_container;
 	size_t count = 0;
+	const IndexMethodInterface &method = *index_method;
+	std::vector<IndexMethodInterface::IndexType> row_indexes(cols);
 	for(IndexMethodInterface::RowMajorIndexType row = 0; row < rows; ++row) {
-		IndexMethodInterface::IndexType row_result = index_method->get_row_result(start_row+row);
+		IndexPolicyType::get_row_indexes(method, start_row+row, start_col, start_col+cols, &row_indexes[0]);
 		for(IndexMethodInterface::RowMajorIndexType col = 0; col < cols; ++col) {
-			data[count++] = c_img_container[index_method->get_index_by_row_result(row_result, start_col+col)];
+			data[count++] = c_img_container[row_indexes[col]];
 		}
 	}
 	return true;
 }
 
-template<typename T, unsigned memory_usage>
-bool BlockwiseImage<T, memory_usage>::set_pixels(int start_row, int start_col, int rows, int cols, const T clear_value)
+template<typename T, unsigned memory_usage, typename IndexMethod>
+bool BlockwiseImage<T, memory_usage, IndexMethod>::set_pixels(int start_row, int start_col, int rows, int cols, const T clear_value)
 {
 	if(start_row < 0 || start_col < 0 || start_row > (get_image_rows()-1) || start_col > (get_image_cols()-1)
 		|| rows <= 0 || cols <= 0 || (start_row+rows) > get_image_rows() || (start_col+cols) > get_image_cols()) {
@@ -140,44 +162,199 @@ bool BlockwiseImage<T, memory_usage>::set_pixels(int start_row, int start_col, i
 			return false;
 	}
 
-	for(IndexMethodInterface::RowMajorIndexType row = 0; row < rows; ++row) {
-		IndexMethodInterface::IndexType row_result = index_method->get_row_result(start_row+row);
-		for(IndexMethodInterface::RowMajorIndexType col = 0; col < cols; ++col) {
-			img_container[index_method->get_index_by_row_result(row_result, start_col+col)] = clear_value;
+	/* fill the successive index ranges block by block, so the aligned areas become the uniform nodes 
+	 * without touching every cell through the index method */
+	std::vector<IndexMethodInterface::IndexRange> index_ranges;
+	index_method->get_index_ranges(start_row, start_col, rows, cols, index_ranges);
+	for(size_t i = 0; i < index_ranges.size(); ++i) {
+		fill_container_range(index_ranges[i].front, (size_t)(index_ranges[i].tail - index_ranges[i].front), clear_value);
+	}
+	return true;
+}
+
+template<typename T, unsigned memory_usage, typename IndexMethod>
+void BlockwiseImage<T, memory_usage, IndexMethod>::read_container_range(IndexMethodInterface::IndexType front, 
+	size_t count, T *dst) const
+{
+	BOOST_ASSERT(front >= 0 && front + count <= img_container.size());
+
+	/* the cells are successive only inside one block of the container */
+	const size_t block_size = ContainerType::block_type::size;
+	const ContainerType &c_img_container = img_container;
+	while(count > 0) {
+		size_t run = std::min<size_t>(count, block_size - (size_t)(front % block_size));
+		const T *src = &c_img_container[front];
+		std::copy(src, src + run, dst);
+
+		front += run;
+		dst += run;
+		count -= run;
+	}
+}
+
+template<typename T, unsigned memory_usage, typename IndexMethod>
+void BlockwiseImage<T, memory_usage, IndexMethod>::write_container_range(IndexMethodInterface::IndexType front, 
+	size_t count, const T *src)
+{
+	BOOST_ASSERT(front >= 0 && front + count <= img_container.size());
+
+	const size_t block_size = ContainerType::block_type::size;
+	while(count > 0) {
+		size_t run = std::min<size_t>(count, block_size - (size_t)(front % block_size));
+		T *dst = &img_container[front];
+		std::copy(src, src + run, dst);
+
+		front += run;
+		src += run;
+		count -= run;
+	}
+}
+
+template<typename T, unsigned memory_usage, typename IndexMethod>
+void BlockwiseImage<T, memory_usage, IndexMethod>::fill_container_range(IndexMethodInterface::IndexType front, 
+	size_t count, const T &value)
+{
+	BOOST_ASSERT(front >= 0 && front + count <= img_container.size());
+
+	const size_t block_size = ContainerType::block_type::size;
+	while(count > 0) {
+		size_t run = std::min<size_t>(count, block_size - (size_t)(front % block_size));
+		T *dst = &img_container[front];
+		std::fill(dst, dst + run, value);
+
+		front += run;
+		count -= run;
+	}
+}
+
+template<typename T, unsigned memory_usage, typename IndexMethod>
+bool BlockwiseImage<T, memory_usage, IndexMethod>::pin_tile(int tile_row, int tile_col, int tile_order, ImageTile<T> &tile) const
+{
+	if(tile_row < 0 || tile_col < 0 || tile_order < 0 || tile_order > 15 
+		|| ((size_t)(tile_row) << tile_order) >= get_image_rows() || ((size_t)(tile_col) << tile_order) >= get_image_cols()) {
+		std::cerr << "BlockwiseImage::pin_tile error : Invalid parameter" << std::endl;
+		return false;
+	}
+
+	if(tile.is_pinned()) {
+		std::cerr << "BlockwiseImage::pin_tile error : the tile is pinned already" << std::endl;
+		return false;
+	}
+
+	typedef IndexMethodInterface::IndexType IndexType;
+	const size_t tile_size = (size_t)(1) << tile_order;
+
+	/* the tile at the border is clipped by the image */
+	tile.m_tile_order = tile_order;
+	tile.m_start_row = tile_row << tile_order;
+	tile.m_start_col = tile_col << tile_order;
+	tile.m_rows = (int)(std::min<size_t>(tile_size, get_image_rows() - tile.m_start_row));
+	tile.m_cols = (int)(std::min<size_t>(tile_size, get_image_cols() - tile.m_start_col));
+	tile.m_data.resize(tile_size * tile_size);
+
+	const IndexMethodInterface &method = *index_method;
+	method.get_index_ranges(tile.m_start_row, tile.m_start_col, tile.m_rows, tile.m_cols, tile.m_ranges);
+
+	/* the tile cells are in a short index span, thus read the whole span at once */
+	IndexType span_front = tile.m_ranges.front().front, span_tail = tile.m_ranges.back().tail;
+	if((size_t)(span_tail - span_front) <= tile_size * tile_size) {
+		tile.m_span_front = span_front;
+		tile.m_span.resize(span_tail - span_front);
+		for(size_t i = 0; i < tile.m_ranges.size(); ++i) {
+			read_container_range(tile.m_ranges[i].front, tile.m_ranges[i].tail - tile.m_ranges[i].front, 
+				&tile.m_span[tile.m_ranges[i].front - span_front]);
 		}
+	} else {
+		tile.m_span.clear();
 	}
+
+	/* convert the index order into the row-major order */
+	const ContainerType &c_img_container = img_container;
+	std::vector<IndexType> row_indexes(tile.m_cols);
+	for(int row = 0; row < tile.m_rows; ++row) {
+		IndexPolicyType::get_row_indexes(method, tile.m_start_row + row, tile.m_start_col, 
+			tile.m_start_col + tile.m_cols, &row_indexes[0]);
+
+		T *row_data = &tile.m_data[row * tile_size];
+		if(!tile.m_span.empty()) {
+			for(int col = 0; col < tile.m_cols; ++col) 
+				row_data[col] = tile.m_span[row_indexes[col] - span_front];
+		} else {
+			for(int col = 0; col < tile.m_cols; ++col) 
+				row_data[col] = c_img_container[row_indexes[col]];
+		}
+	}
+
+	tile.m_pinned = true;
 	return true;
 }
 
-template<typename T, unsigned memory_usage>
-const T& BlockwiseImage<T, memory_usage>::operator()(int row, int col) const
+template<typename T, unsigned memory_usage, typename IndexMethod>
+bool BlockwiseImage<T, memory_usage, IndexMethod>::unpin_tile(ImageTile<T> &tile, bool write_back)
 {
-	BOOST_ASSERT(0 <= row && row < img_size.rows && 0 <= col && col < img_size.cols);
-	static const ContainerType &c_img_container = img_container;
-	return c_img_container[index_method->get_index(row, col)];
+	typedef IndexMethodInterface::IndexType IndexType;
+
+	if(!tile.is_pinned()) {
+		std::cerr << "BlockwiseImage::unpin_tile error : the tile is not pinned" << std::endl;
+		return false;
+	}
+	tile.m_pinned = false;
+	if(!write_back) return true;
+
+	const size_t tile_size = tile.get_stride();
+	const IndexMethodInterface &method = *index_method;
+	std::vector<IndexType> row_indexes(tile.m_cols);
+	for(int row = 0; row < tile.m_rows; ++row) {
+		IndexPolicyType::get_row_indexes(method, tile.m_start_row + row, tile.m_start_col, 
+			tile.m_start_col + tile.m_cols, &row_indexes[0]);
+
+		const T *row_data = &tile.m_data[row * tile_size];
+		if(!tile.m_span.empty()) {
+			for(int col = 0; col < tile.m_cols; ++col) 
+				tile.m_span[row_indexes[col] - tile.m_span_front] = row_data[col];
+		} else {
+			for(int col = 0; col < tile.m_cols; ++col) 
+				img_container[row_indexes[col]] = row_data[col];
+		}
+	}
+
+	/* only write the ranges of the tile, the other cells in the span may be changed after pinning */
+	if(!tile.m_span.empty()) {
+		for(size_t i = 0; i < tile.m_ranges.size(); ++i) {
+			write_container_range(tile.m_ranges[i].front, tile.m_ranges[i].tail - tile.m_ranges[i].front, 
+				&tile.m_span[tile.m_ranges[i].front - tile.m_span_front]);
+		}
+	}
+
+	return true;
 }
 
-template<typename T, unsigned memory_usage>
-T& BlockwiseImage<T, memory_usage>::operator()(int row, int col)
+template<typename T, unsigned memory_usage, typename IndexMethod>
+const T& BlockwiseImage<T, memory_usage, IndexMethod>::operator()(int row, int col) const
 {
-	BOOST_ASSERT(0 <= row && row < img_size.rows && 0 <= col && col < img_size.cols);
-	return img_container[index_method->get_index(row, col)];
+	return pixel(row, col);
 }
 
-template<typename T, unsigned memory_usage>
-const T& BlockwiseImage<T, memory_usage>::get_pixel(int row, int col) const
+template<typename T, unsigned memory_usage, typename IndexMethod>
+T& BlockwiseImage<T, memory_usage, IndexMethod>::operator()(int row, int col)
+{
+	return pixel(row, col);
+}
+
+template<typename T, unsigned memory_usage, typename IndexMethod>
+const T& BlockwiseImage<T, memory_usage, IndexMethod>::get_pixel(int row, int col) const
 {
 	return this->operator() (row, col);
 }
 
-template<typename T, unsigned memory_usage>
-T& BlockwiseImage<T, memory_usage>::get_pixel(int row, int col)
+template<typename T, unsigned memory_usage, typename IndexMethod>
+T& BlockwiseImage<T, memory_usage, IndexMethod>::get_pixel(int row, int col)
 {
 	return this->operator() (row, col);
 }
 
-template<typename T, unsigned memory_usage>
-bool BlockwiseImage<T, memory_usage>::write_image_head_file(const char* file_name)
+template<typename T, unsigned memory_usage, typename IndexMethod>
+bool BlockwiseImage<T, memory_usage, IndexMethod>::write_image_head_file(const char* file_name, size_t max_level)
 {
 	namespace bf = boost::filesystem;
 	using namespace std;
@@ -201,29 +378,61 @@ bool BlockwiseImage<T, memory_usage>::write_image_head_file(const char* file_nam
 		return false;
 	}
 
-	ofstream fout(file_name, ios::out);
-	if(!fout.is_open()) {
-		cerr << "create " << file_name << " failure" << endl;
-		return false;
+	/* the head file info, the node data of the packed storage follows the head */
+	BigImageHead head;
+	head.img_size = img_size;
+	head.file_node_size = file_node_size;
+	head.file_node_shift_num = file_node_shift_num;
+	head.mini_rows = m_mini_rows;
+	head.mini_cols = m_mini_cols;
+	head.max_level = max_level;
+	head.cell_size = sizeof(T);
+	head.cell_type = CellTypeName<T>::name();
+	head.index_method_name = index_method->get_index_method_name();
+	head.index_method_para = index_method->get_index_method_para();
+	head.storage_format = m_storage_format;
+	head.compression_codec = m_compression_codec;
+	head.set_levels(img_container.size());
+
+	return head.save(file_name);
+}
+
+template<typename T, unsigned memory_usage, typename IndexMethod>
+boost::shared_ptr<ImageStorage> BlockwiseImage<T, memory_usage, IndexMethod>::create_image_storage(const char *file_name)
+{
+	using namespace std;
+	namespace bf = boost::filesystem;
+
+	/* the image data directory is beside the head file, for example : the file_name is /a/x.bigimage then the data_path is /a/x/ */
+	bf::path file_path = file_name;
+	bf::path data_path = (file_path.parent_path() / file_path.stem()).make_preferred();
+	if(bf::exists(data_path)) {
+		bf::remove_all(data_path);
+		cout << "[Warning] : " << data_path << " is existing, and the original directory will be removed" << endl;
 	}
 
-	/* the head file info */
-	fout << "type=" << "BlockwiseImage" << endl;
-	fout << "rows=" << img_size.rows << endl;
-	fout << "cols=" << img_size.cols << endl;
-	fout << "filenodesize=" << file_node_size << endl;
-	fout << "filenodeshiftnum=" << file_node_shift_num << endl;
-	fout << "indexmethod=" << index_method->get_index_method_name() << endl;
-	fout << "minirows=" << m_mini_rows << endl;
-	fout << "minicols=" << m_mini_cols << endl;
+	boost::shared_ptr<ImageStorage> storage;
+	if(m_storage_format == ImageStorage::PACKED_STORAGE) {
+		boost::shared_ptr<PackedImageStorage> packed_storage = boost::make_shared<PackedImageStorage>();
+		if(!packed_storage->create(file_name, BigImageHead::DIRECTORY_OFFSET_POS)) return boost::shared_ptr<ImageStorage>();
+		storage = packed_storage;
+	} else {
+		if(!bf::create_directories(data_path)) {
+			cerr << "create directory " << data_path << " failure" << endl;
+			return boost::shared_ptr<ImageStorage>();
+		}
+		storage = boost::make_shared<DirectoryImageStorage>(data_path.generic_string());
+	}
 
-	fout.close();
+	/* compress the nodes before they reach the storage */
+	boost::shared_ptr<NodeCodec> codec = NodeCodec::create(m_compression_codec, sizeof(T));
+	if(codec) storage = boost::make_shared<CompressedImageStorage>(storage, codec);
 
-	return true;
+	return storage;
 }
 
-template<typename T, unsigned memory_usage>
-bool BlockwiseImage<T, memory_usage>::write_image(const char* file_name)
+template<typename T, unsigned memory_usage, typename IndexMethod>
+bool BlockwiseImage<T, memory_usage, IndexMethod>::write_image(const char* file_name)
 {
 	using namespace std;
 	namespace bf = boost::filesystem;
@@ -231,67 +440,26 @@ bool BlockwiseImage<T, memory_usage>::write_image(const char* file_name)
 	try {
 		if(!write_image_head_file(file_name))	return false;
 
-		bf::path file_path = file_name;
-		bf::path data_path = (file_path.parent_path() / file_path.stem()).make_preferred();
-		if(bf::exists(data_path)) {
-			bf::remove_all(data_path);
-			cout << "[Warning] : " << data_path << " is existing, and the original directory will be removed" << endl;
-		}
-
 		/* block wise image only has one level : means the full size level */
-		data_path /= bf::path("level_0");
-		if(!bf::create_directories(data_path)) {
-			cerr << "create directory " << data_path << "failure" << endl;
-			return false;
-		}
+		boost::shared_ptr<ImageStorage> storage = create_image_storage(file_name);
+		if(!storage || !storage->create_level(0)) return false;
 
 		/* because just read the image data, so just const reference to read for some kind of optimization */
-		static const ContainerType &c_img_container = img_container;
-		int64 file_number = std::ceil((double)(c_img_container.size()) / file_node_size);
-
-		T *temp_file_data = new T[file_node_size];
-
-		/* first write the full one file context */
-		int64 start_index = 0, file_loop = 0;
-		for(; file_loop < file_number - 1; ++file_loop) {
-			std::ostrstream strstream;
-			strstream << data_path.generic_string() << "/" << file_loop << '\0';
-			ofstream file_out(strstream.str(), ios::out | ios::binary);
-			if(!file_out.is_open()) {
-				cerr << "create " << strstream.str() << " failure" << endl;
-				return false;
-			}
-
-			start_index = (int64)(file_loop) << file_node_shift_num;
-
-			for(int64 i = 0; i < file_node_size; ++i) {
-				temp_file_data[i] = c_img_container[start_index + i];
-			}
-
-			file_out.write(reinterpret_cast<const char*>(temp_file_data), sizeof(T)*file_node_size);
-			file_out.close();
-		}
+		const ContainerType &c_img_container = img_container;
+		std::vector<T> file_data(std::min<int64>(file_node_size, c_img_container.size()));
 
-		/* write the last file till the end of the container(maybe not full) */
-		start_index = (int64)(file_loop) << file_node_shift_num;
-		std::ostrstream strstream;
-		strstream << data_path.generic_string() << "/" << file_loop << '\0';
-		ofstream file_out(strstream.str(), ios::out | ios::binary);
-		if(!file_out.is_open()) {
-			cerr << "create " << strstream.str() << " failure" << endl;
-			return false;
-		}
+		for(int64 start_index = 0, file_loop = 0; start_index < (int64)c_img_container.size(); 
+			start_index += file_node_size, ++file_loop) {
+			/* the last file is till the end of the container(maybe not full) */
+			size_t count = (size_t)std::min<int64>(file_node_size, c_img_container.size() - start_index);
+			read_container_range(start_index, count, &file_data[0]);
 
-		int64 last_file_size = c_img_container.size() - start_index;
-		for(int64 i = 0; i < last_file_size; ++i) {
-			temp_file_data[i] = c_img_container[start_index + i];
+			/* the node of the same cells is saved as a uniform node */
+			if(!storage->write_cells(0, file_loop, &file_data[0], sizeof(T)*count, sizeof(T))) return false;
 		}
 
-		file_out.write(reinterpret_cast<const char*>(temp_file_data), sizeof(T)*last_file_size);
-		file_out.close();
+		if(!storage->close()) return false;
 
-		delete []temp_file_data;
-		
 		if(!save_mini_image(file_name)) return false;
 
 	} catch(bf::filesystem_error &err) {
@@ -302,29 +470,29 @@ bool BlockwiseImage<T, memory_usage>::write_image(const char* file_name)
 	return true;
 }
 
-template<typename T, unsigned memory_usage>
-bool BlockwiseImage<T, memory_usage>::write_image(const std::string &file_name)
+template<typename T, unsigned memory_usage, typename IndexMethod>
+bool BlockwiseImage<T, memory_usage, IndexMethod>::write_image(const std::string &file_name)
 {
 	return write_image(file_name.c_str());
 }
 
-template<typename T, unsigned memory_usage>
-const T& BlockwiseImage<T, memory_usage>::at(IndexMethodInterface::IndexType index) const
+template<typename T, unsigned memory_usage, typename IndexMethod>
+const T& BlockwiseImage<T, memory_usage, IndexMethod>::at(IndexMethodInterface::IndexType index) const
 {
 	BOOST_ASSERT(index < img_container.size());
-	static const ContainerType &c_img_container = img_container;
+	const ContainerType &c_img_container = img_container;
 	return c_img_container[index];
 }
 
-template<typename T, unsigned memory_usage>
-T& BlockwiseImage<T, memory_usage>::at(IndexMethodInterface::IndexType index)
+template<typename T, unsigned memory_usage, typename IndexMethod>
+T& BlockwiseImage<T, memory_usage, IndexMethod>::at(IndexMethodInterface::IndexType index)
 {
 	BOOST_ASSERT(index < img_container.size());
 	return img_container[index];
 }
 
-template<typename T, unsigned memory_usage>
-bool BlockwiseImage<T, memory_usage>::save_mini_image(const char *file_name) 
+template<typename T, unsigned memory_usage, typename IndexMethod>
+bool BlockwiseImage<T, memory_usage, IndexMethod>::save_mini_image(const char *file_name) 
 {
 
 #ifdef SAVE_MINI_IMAGE
@@ -336,9 +504,13 @@ bool BlockwiseImage<T, memory_usage>::save_mini_image(const char *file_name)
 	 */
 	IndexMethodInterface::IndexType total_size, file_cell_size, delta_count;
 	total_size = c_img_container.size();
-	file_cell_size = total_size >> (2*m_max_level);
+	file_cell_size = ((total_size - 1) >> (2*m_max_level)) + 1;
 	delta_count = 1 << (2*m_max_level);
 
+	/* the minimum size image is indexed by the index method of the max level */
+	boost::shared_ptr<IndexMethodInterface> mini_index_method = index_method->get_level_index_method(m_max_level);
+	BOOST_ASSERT(mini_index_method);
+
 	std::vector<T> img_data(m_mini_rows*m_mini_cols);
 	std::vector<T> img_zorder_data(file_cell_size);
 
@@ -348,10 +520,11 @@ bool BlockwiseImage<T, memory_usage>::save_mini_image(const char *file_name)
 	}
 
 	/* convert it to the row-major format */
+	std::vector<IndexMethodInterface::IndexType> row_indexes(m_mini_cols);
 	for(size_t row = 0; row < m_mini_rows; ++row) {
-		IndexMethodInterface::IndexType row_result = index_method->get_row_result(row);
+		mini_index_method->get_row_indexes(row, 0, m_mini_cols, &row_indexes[0]);
 		for(size_t col = 0; col < m_mini_cols; ++col) {
-			img_data[row*m_mini_cols+col] = img_zorder_data[index_method->get_index_by_row_result(row_result, col)];
+			img_data[row*m_mini_cols+col] = img_zorder_data[row_indexes[col]];
 		}
 	}
 
@@ -370,7 +543,7 @@ bool BlockwiseImage<T, memory_usage>::save_mini_image(const char *file_name)
 }
 
 /* deprecated function */
-//boost::shared_ptr<BlockwiseImage<T, memory_usage> > BlockwiseImage<T, memory_usage>::load_image(const char *file_name)
+//boost::shared_ptr<BlockwiseImage<T, memory_usage> > BlockwiseImage<T, memory_usage, IndexMethod>::load_image(const char *file_name)
 //{
 //	typedef boost::shared_ptr<BlockwiseImage<T, memory_usage> > PtrType;
 //	PtrType dst_image(new BlockwiseImage<T, memory_usage> (0, 0));
@@ -4,15 +4,108 @@
 #include "BasicType.h"
 #include "DiskBigImageInterface.h"
 #include "Lru.hpp"
+#include "ImagePrefetcher.hpp"
+#include "ImageFlusher.hpp"
+#include "MappedFile.hpp"
+#include "ImageStorage.hpp"
+#include "ImageHead.hpp"
+#include "NodeCodec.hpp"
 #include "IndexMethod.hpp"
 
 /** filesystem part */
 #define BOOST_FILESYSTEM_VERSION 3
 #include <boost/filesystem.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/type_traits/alignment_of.hpp>
 
 #include <vector>
 
+template<typename T>
+class DiskBigImage;
+
+/**
+ * @class ImageRegionView DiskBigImage.h
+ *
+ * @brief The read-only view of an image area lying in one cached file node, the cells are read from the
+ * cache (or the mapped image file) without copying. The file node is kept in the cache as long as the view
+ * or any of its copies exists, the view may outlive the image, the cache and its storage live with it.
+ * @see DiskBigImage::get_region_view()
+ *
+ * @tparam T The type of the image cell
+ */
+
+template<typename T>
+class ImageRegionView
+{
+public:
+	ImageRegionView() : m_node_front(0), m_start_row(0), m_start_col(0), m_rows(0), m_cols(0) {}
+
+	bool empty() const
+	{
+		return !m_cells;
+	}
+
+	int rows() const
+	{
+		return m_rows;
+	}
+
+	int cols() const
+	{
+		return m_cols;
+	}
+
+	/**
+	 *	@brief the cell of the area, row and col are relative to the left-corner point of the area
+	 */
+	const T& at(int row, int col) const
+	{
+		IndexMethodInterface::IndexType index = m_index_method->get_index(m_start_row + row, m_start_col + col);
+		return m_cells.get()[size_t(index - m_node_front)];
+	}
+
+	/**
+	 *	@brief the cells of the whole file node in the order of the index method, the first one is
+	 *	the cell of node_front() index
+	 */
+	const T* node_data() const
+	{
+		return m_cells.get();
+	}
+
+	IndexMethodInterface::IndexType node_front() const
+	{
+		return m_node_front;
+	}
+
+	void reset()
+	{
+		m_cells.reset();
+		m_index_method.reset();
+	}
+
+private:
+	friend class DiskBigImage<T>;
+
+	/** the cells of the file node, which keeps the pinned cache or the mapped file */
+	boost::shared_ptr<const T> m_cells;
+	boost::shared_ptr<IndexMethodInterface> m_index_method;
+	IndexMethodInterface::IndexType m_node_front;
+	int m_start_row, m_start_col, m_rows, m_cols;
+};
+
+/**
+ * @brief how load_disk_image() accesses the image data
+ */
+enum ImageAccessMode
+{
+	/** the file nodes are read into the ImageFileLRU caches, the image can be read and written */
+	CACHED_IMAGE_ACCESS,
+	/** the packed image file is mapped read-only and the cells are gathered from the mapping, so the page cache
+	 * of the system is the cache, shared by all the processes reading the image */
+	MAPPED_IMAGE_ACCESS
+};
+
 /**
  * @class DiskBigImage DiskBigImage.h 
  *
@@ -23,6 +116,15 @@
  * When access the image data, the last frequently used image data will be save in the memory, 
  * and the none frequently used image data will be swap out to the disk.
  *
+ * The file cache is split into the shards by the file number, each shard has its own lock, so the threads
+ * calling read_pixels_by_level() concurrently rarely wait for each other.
+ *
+ * With MAPPED_IMAGE_ACCESS, the packed image file without compression is mapped instead, nothing is cached
+ * by the image, and the image can't be written.
+ *
+ * The cached file nodes can be saved as the hot set beside the head file (*.hotset), load_disk_image() reads
+ * the hot set in the background, so the restarted process doesn't wait for the cold reading.
+ *
  * @tparam T The type of the image cell
  */
 
@@ -30,6 +132,20 @@ template<typename T>
 class DiskBigImage : public DiskBigImageInterface<T>
 {
 
+public:
+	/** the maximum number of the cache shards */
+	enum { MAX_CACHE_SHARDS = 8 };
+
+	/** what to prefetch after each reading, the flags can be combined */
+	enum PrefetchPolicy
+	{
+		PREFETCH_NONE = 0,
+		/** the ring of the file nodes around the area */
+		PREFETCH_NEIGHBOURS = 1,
+		/** the area in the parent level and the child level */
+		PREFETCH_LEVELS = 2
+	};
+
 public:
 	/* Derived from DiskBigImageInterface */
 
@@ -38,6 +154,14 @@ public:
 
     virtual bool get_pixels_by_level_fast(int level, int &start_row, int &start_col, int &rows, int &cols, std::vector<T> &vec);
 
+	virtual bool read_pixels_by_level(int level, int start_row, int start_col, int rows, int cols, std::vector<T> &vec) const;
+	virtual bool read_pixels_by_level(int level, int start_row, int start_col, int rows, int cols, 
+		T *dst, size_t row_stride) const;
+
+	virtual bool read_regions(const std::vector<ImageRegionRequest<T> > &requests) const;
+
+	virtual bool prefetch_region(int level, int start_row, int start_col, int rows, int cols) const;
+
 	virtual bool set_current_level(int level);
 	virtual size_t get_current_level() const; 
 
@@ -45,6 +169,9 @@ public:
 	virtual size_t get_current_level_image_cols() const;
 
 	virtual bool set_file_cache_number(int _file_cache_number);
+	virtual bool set_file_cache_bytes(size_t bytes);
+
+	virtual bool flush();
 
 	virtual size_t get_max_image_level() const;
 
@@ -71,39 +198,187 @@ public:
 	inline size_t get_image_rows() const;
 	inline size_t get_image_cols() const;
 
+	/**
+	 *	@brief get the read-only view of the area without copying the cells, only if the area lies in one
+	 *	file node (otherwise use read_pixels_by_level())
+	 *	@return false if the area is not in one file node or fails to read the file node
+	 */
+	bool get_region_view(int level, int start_row, int start_col, int rows, int cols, ImageRegionView<T> &view) const;
+
+	/**
+	 *	@brief get the bytes of the cached image files of the level
+	 */
+	size_t get_cached_bytes(size_t level) const;
+
+	/**
+	 *	@brief the access mode actually used, MAPPED_IMAGE_ACCESS falls back to CACHED_IMAGE_ACCESS if the image
+	 *	can't be mapped
+	 */
+	ImageAccessMode get_access_mode() const;
+
+	/**
+	 *	@brief set the PrefetchPolicy flags applied after each reading, PREFETCH_NONE by default
+	 */
+	void set_prefetch_policy(int policy);
+	int get_prefetch_policy() const;
+
+	/**
+	 *	@brief set the number of the background I/O threads for prefetching (2 by default), 0 disables
+	 *	the prefetching. The threads are started at the first prefetching
+	 */
+	void set_prefetch_thread_number(size_t thread_number);
+
+	/**
+	 *	@brief flush the changed image data every interval milliseconds in a background thread,
+	 *	0 (by default) stops the flushing
+	 */
+	void set_flush_interval(size_t interval);
+
+	/**
+	 *	@brief save the cached file nodes into the hot set file, the most recently used first
+	 */
+	bool save_hot_set();
+
+	/**
+	 *	@brief save the hot set when the image is destroyed, false by default
+	 */
+	void set_keep_hot_set(bool keep);
+
+	~DiskBigImage();
+
 protected:
 
 	/**
-	 * @struct DataIndexInfo
-	 *
-	 * @brief This structure is used in the get_pixels_by_level() function to sort the range data. 
-	 * @see get_pixels_by_level()
+	 *	@brief read out the cells of the successive index range, write the data into the dst buffer, 
+	 *	which keeps the row-major format image data of the rectangle (start_row, start_col, *, *) 
+	 *	whose rows are row_stride bytes apart, that comes to be the result of read_pixels_by_level() function.
+	 */
+	bool read_from_index_range(size_t level, const IndexMethodInterface &level_index_method, 
+		const IndexMethodInterface::IndexRange &range, int start_row, int start_col, T *dst, size_t row_stride) const;
+
+	/**
+	 *	@brief the same as read_from_index_range(), but the cells are gathered from the mapped image file
+	 */
+	bool read_from_mapped_range(size_t level, const IndexMethodInterface &level_index_method, 
+		const IndexMethodInterface::IndexRange &range, int start_row, int start_col, T *dst, size_t row_stride) const;
+
+	/**
+	 *	@brief write the cells of the successive index range from the row-major data_vector, used by the 
+	 *	set_pixel_by_level() function.
 	 */
-	struct DataIndexInfo
+	bool write_to_index_range(const IndexMethodInterface::IndexRange &range, int start_row, int start_col, 
+		int cols, const std::vector<T> &data_vector);
+
+	/**
+	 *	@brief the cells of one request in one file node, the unit of read_regions()
+	 */
+	struct RegionSegment
 	{
-		int64 index;			/**< keeps the original index (in row-major order) */
-		int64 zorder_index;	/**< keeps the zorder index according to the row-major index */
+		size_t level;
+		size_t file_number;
+		size_t request_no;
+		IndexMethodInterface::IndexRange range;
 
-		friend inline bool operator< (const DataIndexInfo& lhs, const DataIndexInfo& rhs) 
+		bool operator < (const RegionSegment &other) const
 		{
-			return (lhs.zorder_index < rhs.zorder_index);
+			if(level != other.level) return level < other.level;
+			if(file_number != other.file_number) return file_number < other.file_number;
+			return request_no < other.request_no;
 		}
 	};
 
-protected:
-
 	/**
-	 *	@brief read out the [front, tail) range cells in the index_info_vector, write
-	 *	the data into the data_vector, which keeps the row-major format image data that
-	 *	comes to be the result of get_pixels_by_level() function.
+	 *	@brief the file node in the mapped image file
 	 */
-	bool read_from_index_range(size_t front, size_t tail, ZOrderIndex::IndexType start_index, 
-		const std::vector<DataIndexInfo> &index_info_vector, std::vector<T> &data_vector);
+	struct MappedNode
+	{
+		/** the cells in the mapping, NULL for the uniform node */
+		const char *data;
+		size_t cell_number;
+		T uniform_cell;
+
+		/**
+		 *	@brief the cell may be not aligned in the mapping, the cell out of the node is zero
+		 */
+		void get_cell(size_t i, T &cell) const
+		{
+			if(data == NULL) cell = uniform_cell;
+			else if(i < cell_number) memcpy(&cell, data + i*sizeof(T), sizeof(T));
+			else memset(&cell, 0, sizeof(T));
+		}
+	};
 
 	/** 
 	 * @brief checks the parameter invalidation before calling the get_pixels_by_level() function
+	 * @param caller the name of the calling function, printed in the error message
+	 */
+	bool check_para_validation(const char *caller, int level, int start_row, int start_col, int rows, int cols);
+
+	/**
+	 * @brief checks the rectangle is in the level, without changing the current level
+	 * @param caller the name of the calling function, printed in the error message
+	 */
+	bool check_level_rectangle(const char *caller, int level, int start_row, int start_col, int rows, int cols) const;
+
+	/**
+	 * @brief get the cache shard of the image file
+	 */
+	const boost::shared_ptr<ImageFileLRU<T> >& get_cache_shard(size_t level, size_t file_number) const;
+	size_t get_cache_shard_number(size_t level, size_t file_number) const;
+
+	/**
+	 * @brief create the cache shards for the file cache number
+	 */
+	void create_cache_shards();
+
+	/**
+	 * @brief get the prefetcher, which is created at the first calling, NULL if the prefetching is disabled
+	 */
+	ImagePrefetcher* get_prefetcher() const;
+
+	/**
+	 * @brief push the file nodes of the rectangle [start_row, end_row) x [start_col, end_col) into the
+	 * prefetcher, the rectangle is clipped by the level
+	 */
+	void prefetch_rectangle(size_t level, int64 start_row, int64 start_col, int64 end_row, int64 end_col) const;
+
+	/**
+	 * @brief prefetch around the area just read according to the prefetch policy
 	 */
-	bool check_para_validation(int level, int start_row, int start_col, int rows, int cols);
+	void prefetch_around(size_t level, int start_row, int start_col, int rows, int cols) const;
+
+	/**
+	 * @brief get the file nodes (level, file number) of the sorted index ranges, each node once
+	 */
+	void get_file_nodes(size_t level, const std::vector<IndexMethodInterface::IndexRange> &index_ranges, 
+		std::vector<ImagePrefetcher::Node> &nodes) const;
+
+	/**
+	 * @brief read the missing file nodes into the cache together by ImageStorage::read_nodes(), called by
+	 * the region reading and the prefetching threads. At most the cache capacity of the nodes are read
+	 */
+	void load_file_nodes(const std::vector<ImagePrefetcher::Node> &nodes) const;
+
+	/**
+	 * @brief ask the system to read the file nodes of the mapped image file in the background
+	 */
+	void advise_file_nodes(const std::vector<ImagePrefetcher::Node> &nodes) const;
+
+	/**
+	 * @brief the hot set file of the image, (image data path).hotset
+	 */
+	std::string get_hot_set_file_name() const;
+
+	/**
+	 * @brief read the hot set file saved by save_hot_set(), the nodes not in the image are skipped
+	 * @return false if there is no hot set file
+	 */
+	bool load_hot_set();
+
+	/**
+	 * @brief load the nodes of the hot set in the background once, the hot set is cleared then
+	 */
+	void preload_hot_set();
 
 	/**
 	 * @brief load the image head file before load image
@@ -115,6 +390,19 @@ protected:
 	 */
 	void set_image_data_path(const char * file_name);
 
+	/**
+	 *	@brief open the storage of the image data according to the head file, must be called after
+	 *	load_image_head_file() and set_image_data_path()
+	 */
+	bool open_image_storage(const char *file_name);
+
+	/**
+	 *	@brief map the packed image file read-only and locate the file nodes in it, must be called after
+	 *	open_image_storage()
+	 *	@return false if the image is not packed, compressed or fails to be mapped
+	 */
+	bool open_mapped_file(const char *file_name);
+
 protected:
 	/**
 	 * @brief DiskBigImage can only be constructed in the subclass or friend function.
@@ -122,16 +410,19 @@ protected:
 	 *
 	 * @see load_disk_image()
 	 */
-	DiskBigImage() {}
+	DiskBigImage() : storage_format(ImageStorage::DIRECTORY_STORAGE), packed_directory_offset(0), 
+		compression_codec(NodeCodec::NO_CODEC), file_cache_number(16), prefetch_policy(PREFETCH_NONE), 
+		prefetch_thread_number(2), keep_hot_set(false), access_mode(CACHED_IMAGE_ACCESS) {}
 	
 	/**
 	 * @brief The main function to load a big image file from disk
 	 *
 	 * @para file_name The file name of the big image header file (the extension is .bigimage)
+	 * @para access_mode How the image data is accessed, @see ImageAccessMode
 	 * @return the shared_ptr of the big image object DiskBigImage
 	 */
 	template<typename T>
-	friend boost::shared_ptr<DiskBigImage<T> > load_disk_image(const char *file_name);
+	friend boost::shared_ptr<DiskBigImage<T> > load_disk_image(const char *file_name, ImageAccessMode access_mode);
 
 protected:
 	/** saves the whole size of the image */
@@ -143,9 +434,12 @@ protected:
 	/** the shift number of file_node_size */
 	int64 file_node_shift_num;
 
-	/** the shared_ptr of index method */
+	/** the shared_ptr of index method of the current level */
 	boost::shared_ptr<IndexMethodInterface> index_method;
 
+	/** the index method of the full size image, the index method of each level comes from it */
+	boost::shared_ptr<IndexMethodInterface> origin_index_method;
+
 	/** size of the minimum size image */
 	size_t m_mini_rows, m_mini_cols;
 
@@ -159,20 +453,57 @@ protected:
 	/** the image current level */
 	Size img_current_level_size;
 
+	/** the geometry of each level saved in the head */
+	std::vector<BigImageHead::LevelInfo> level_infos;
+
+	/** the index method of each level, null if the index method doesn't support the level */
+	std::vector<boost::shared_ptr<IndexMethodInterface> > level_index_methods;
+
 	/** the current level for reading and writing */
 	size_t m_current_level;
 
 	/** the path of the image data in filesystem */
 	std::string img_data_path;
 
-	/** the specific level image data path */
-	std::string img_level_data_path;
+	/** the format of the image data, and the directory offset if the nodes are packed in the head file */
+	ImageStorage::StorageFormat storage_format;
+	int64 packed_directory_offset;
 
-	/** the number of cache file number for lru manager */
+	/** the codec of the image data nodes */
+	NodeCodec::CodecType compression_codec;
+
+	/** the storage of the image data, shared by the lru manager shards, which write back into it */
+	boost::shared_ptr<ImageStorage> image_storage;
+
+	/** the number of cache file number for lru manager, 0 means only limited by ImageCacheManager */
 	size_t file_cache_number;
 
-	/** the lru image files manager */
-	ImageFileLRU<Vec3b> lru_image_files;
+	/** the shards of the lru image files manager, the mutex of a shard is locked while accessing its files */
+	std::vector<boost::shared_ptr<ImageFileLRU<T> > > lru_shards;
+
+	/** the PrefetchPolicy flags */
+	int prefetch_policy;
+
+	/** the prefetching I/O threads, stopped before the caches are destroyed */
+	size_t prefetch_thread_number;
+	mutable boost::mutex prefetch_mutex;
+	mutable boost::shared_ptr<ImagePrefetcher> prefetcher;
+
+	/** the hot set read by load_disk_image(), cleared after it is preloaded */
+	std::vector<ImagePrefetcher::Node> hot_nodes;
+	/** whether the hot set is saved when the image is destroyed */
+	bool keep_hot_set;
+
+	/** the shards are not replaced while flushing */
+	boost::mutex flush_mutex;
+
+	/** the background flushing thread, stopped before the caches are destroyed */
+	boost::shared_ptr<ImageFlusher> flusher;
+
+	/** the mapped image file and its file nodes of each level, only for MAPPED_IMAGE_ACCESS */
+	ImageAccessMode access_mode;
+	boost::shared_ptr<MappedFile> mapped_file;
+	std::vector<std::vector<MappedNode> > mapped_nodes;
 };
 
 template<typename T>
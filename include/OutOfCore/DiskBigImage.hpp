@@ -24,11 +24,519 @@ bool DiskBigImage<T>::set_file_cache_number(int _file_cache_number)
 	}
 
 	file_cache_number = _file_cache_number;
-	lru_image_files.init(file_node_size, file_cache_number);
+	create_cache_shards();
 
 	return true;
 }
 
+template<typename T>
+void DiskBigImage<T>::create_cache_shards()
+{
+	/* a shard keeps at least 4 files, the small cache is not split */
+	size_t shard_number = (file_cache_number == 0) ? size_t(MAX_CACHE_SHARDS) : 
+		std::min<size_t>(std::max<size_t>(file_cache_number/4, 1), size_t(MAX_CACHE_SHARDS));
+	size_t shard_cache_number = (file_cache_number + shard_number - 1)/shard_number;
+
+	/* the former shards write back the dirty files when destroyed, nobody loads them now. The prefetcher is
+	 * created again at the next prefetching, for the new cache capacity */
+	{
+		boost::mutex::scoped_lock lock(prefetch_mutex);
+		prefetcher.reset();
+	}
+	{
+		boost::mutex::scoped_lock lock(flush_mutex);
+		lru_shards.clear();
+		for(size_t i = 0; i < shard_number; ++i) {
+			/* the shards of the image share one fair share of the cache budget */
+			lru_shards.push_back(boost::make_shared<ImageFileLRU<T> >(file_node_size, shard_cache_number, this));
+			lru_shards.back()->set_storage(image_storage);
+		}
+	}
+}
+
+template<typename T>
+inline const boost::shared_ptr<ImageFileLRU<T> >& DiskBigImage<T>::get_cache_shard(size_t level, size_t file_number) const
+{
+	return lru_shards[get_cache_shard_number(level, file_number)];
+}
+
+template<typename T>
+inline size_t DiskBigImage<T>::get_cache_shard_number(size_t level, size_t file_number) const
+{
+	/* the successive files go to the different shards */
+	return (file_number + level) % lru_shards.size();
+}
+
+template<typename T>
+bool DiskBigImage<T>::set_file_cache_bytes(size_t bytes)
+{
+	size_t file_bytes = size_t(file_node_size)*sizeof(T);
+	return set_file_cache_number((int)std::max<size_t>(bytes/file_bytes, 1));
+}
+
+template<typename T>
+bool DiskBigImage<T>::flush()
+{
+	boost::mutex::scoped_lock lock(flush_mutex);
+
+	bool success = true;
+	for(size_t i = 0; i < lru_shards.size(); ++i) {
+		boost::mutex::scoped_lock shard_lock(lru_shards[i]->get_mutex());
+		if(!lru_shards[i]->flush()) success = false;
+	}
+
+	/* the directory may be changed by the moved nodes */
+	if(image_storage && !image_storage->flush()) success = false;
+	return success;
+}
+
+template<typename T>
+void DiskBigImage<T>::set_flush_interval(size_t interval)
+{
+	/* the running thread is stopped first */
+	flusher.reset();
+	if(interval > 0) {
+		flusher = boost::make_shared<ImageFlusher>(boost::bind(&DiskBigImage<T>::flush, this), interval);
+	}
+}
+
+template<typename T>
+bool DiskBigImage<T>::save_hot_set()
+{
+	using namespace std;
+	namespace bf = boost::filesystem;
+
+	if(img_data_path.empty()) return false;
+
+	/* the mapped image has no cache, the hot set saved before is kept */
+	if(mapped_file) return true;
+
+	vector<vector<ImagePrefetcher::Node> > shard_nodes;
+	size_t max_rank = 0;
+	{
+		boost::mutex::scoped_lock lock(flush_mutex);
+		shard_nodes.resize(lru_shards.size());
+		for(size_t i = 0; i < lru_shards.size(); ++i) {
+			boost::mutex::scoped_lock shard_lock(lru_shards[i]->get_mutex());
+			lru_shards[i]->get_recent_nodes(shard_nodes[i]);
+			max_rank = max(max_rank, shard_nodes[i].size());
+		}
+	}
+
+	/* the hot set is written into the temporary file and then replaced at once, a crash never leaves 
+	 * a partial hot set */
+	string file_name = get_hot_set_file_name(), temp_name = file_name + ".tmp";
+	ofstream file(temp_name.c_str());
+
+	/* each shard has its own recency, the nodes of the same rank in the shards are taken in turn */
+	for(size_t rank = 0; rank < max_rank; ++rank) {
+		for(size_t i = 0; i < shard_nodes.size(); ++i) {
+			if(rank < shard_nodes[i].size()) file << shard_nodes[i][rank].first << ' ' << shard_nodes[i][rank].second << '\n';
+		}
+	}
+	file.close();
+
+	boost::system::error_code error;
+	if(file.fail() || (bf::rename(temp_name, file_name, error), error)) {
+		cerr << "save the hot set " << file_name << " failure" << endl;
+		bf::remove(temp_name, error);
+		return false;
+	}
+	return true;
+}
+
+template<typename T>
+void DiskBigImage<T>::set_keep_hot_set(bool keep)
+{
+	keep_hot_set = keep;
+}
+
+template<typename T>
+DiskBigImage<T>::~DiskBigImage()
+{
+	/* the shards kept by the region views are destroyed later, their changes must be in the saved directory */
+	flush();
+	if(keep_hot_set) save_hot_set();
+}
+
+template<typename T>
+std::string DiskBigImage<T>::get_hot_set_file_name() const
+{
+	return img_data_path + ".hotset";
+}
+
+template<typename T>
+bool DiskBigImage<T>::load_hot_set()
+{
+	hot_nodes.clear();
+
+	std::ifstream file(get_hot_set_file_name().c_str());
+	if(!file) return false;
+
+	/* the image may be written again after the hot set is saved */
+	size_t level = 0, node_no = 0;
+	while(file >> level >> node_no) {
+		if(level < level_infos.size() && node_no < level_infos[level].node_number) {
+			hot_nodes.push_back(ImagePrefetcher::Node(level, node_no));
+		}
+	}
+	return true;
+}
+
+template<typename T>
+void DiskBigImage<T>::preload_hot_set()
+{
+	if(hot_nodes.empty()) return;
+
+	if(mapped_file) {
+		/* the adjacent nodes are advised together */
+		std::sort(hot_nodes.begin(), hot_nodes.end());
+		advise_file_nodes(hot_nodes);
+	} else if(ImagePrefetcher *files_prefetcher = get_prefetcher()) {
+		/* the least recently used first, so the most recently used nodes end up the most recent in the cache,
+		 * and they are kept when the prefetcher drops the oldest waiting nodes for the smaller cache */
+		for(size_t i = hot_nodes.size(); i > 0; --i) {
+			files_prefetcher->push(hot_nodes[i - 1].first, hot_nodes[i - 1].second);
+		}
+	}
+
+	/* the hot set is only used by the loading */
+	std::vector<ImagePrefetcher::Node>().swap(hot_nodes);
+}
+
+template<typename T>
+void DiskBigImage<T>::set_prefetch_policy(int policy)
+{
+	prefetch_policy = policy;
+}
+
+template<typename T>
+int DiskBigImage<T>::get_prefetch_policy() const
+{
+	return prefetch_policy;
+}
+
+template<typename T>
+void DiskBigImage<T>::set_prefetch_thread_number(size_t thread_number)
+{
+	boost::mutex::scoped_lock lock(prefetch_mutex);
+
+	/* the running threads are stopped, the new threads are started at the next prefetching */
+	prefetcher.reset();
+	prefetch_thread_number = thread_number;
+}
+
+template<typename T>
+ImagePrefetcher* DiskBigImage<T>::get_prefetcher() const
+{
+	boost::mutex::scoped_lock lock(prefetch_mutex);
+	if(!prefetcher && prefetch_thread_number > 0) {
+		/* prefetching more files than the cache keeps just evicts the prefetched files */
+		size_t max_pending = (file_cache_number == 0) ? 256 : file_cache_number;
+		prefetcher = boost::make_shared<ImagePrefetcher>(
+			boost::bind(&DiskBigImage<T>::load_file_nodes, this, _1), prefetch_thread_number, max_pending);
+	}
+	return prefetcher.get();
+}
+
+template<typename T>
+void DiskBigImage<T>::get_file_nodes(size_t level, const std::vector<IndexMethodInterface::IndexRange> &index_ranges, 
+	std::vector<ImagePrefetcher::Node> &nodes) const
+{
+	/* the ranges are sorted, so each file is got once */
+	nodes.clear();
+	for(size_t i = 0; i < index_ranges.size(); ++i) {
+		size_t front = size_t(index_ranges[i].front >> file_node_shift_num);
+		size_t tail = size_t((index_ranges[i].tail - 1) >> file_node_shift_num);
+		for(size_t file_number = front; file_number <= tail; ++file_number) {
+			if(!nodes.empty() && nodes.back().second == file_number) continue;
+			nodes.push_back(ImagePrefetcher::Node(level, file_number));
+		}
+	}
+}
+
+template<typename T>
+void DiskBigImage<T>::load_file_nodes(const std::vector<ImagePrefetcher::Node> &nodes) const
+{
+	/* reserve the slots of the missing files, the files read together don't evict each other */
+	std::vector<ImageStorage::NodeRead> reads;
+	std::vector<int> file_indexes;
+	std::vector<size_t> shard_numbers, reserved(lru_shards.size(), 0);
+	for(size_t i = 0; i < nodes.size(); ++i) {
+		size_t level = nodes[i].first, file_number = nodes[i].second;
+		if(level >= level_infos.size() || file_number >= level_infos[level].node_number) continue;
+
+		size_t shard_number = get_cache_shard_number(level, file_number);
+		ImageFileLRU<T> &lru_image_files = *lru_shards[shard_number];
+		size_t capacity = lru_image_files.get_file_cache_number();
+		if(capacity != 0 && reserved[shard_number] >= capacity) continue;
+
+		boost::mutex::scoped_lock lock(lru_image_files.get_mutex());
+		T *data = NULL;
+		int file_index = lru_image_files.begin_loading(level, file_number, data);
+		if(file_index == lru_image_files.npos) continue;
+
+		++reserved[shard_number];
+		reads.push_back(ImageStorage::NodeRead(level, file_number, data, size_t(file_node_size)*sizeof(T)));
+		file_indexes.push_back(file_index);
+		shard_numbers.push_back(shard_number);
+	}
+	if(reads.empty()) return;
+
+	image_storage->read_nodes(reads);
+
+	for(size_t i = 0; i < reads.size(); ++i) {
+		ImageFileLRU<T> &lru_image_files = *lru_shards[shard_numbers[i]];
+		boost::mutex::scoped_lock lock(lru_image_files.get_mutex());
+		lru_image_files.end_loading(file_indexes[i], reads[i].success, reads[i].read_bytes);
+	}
+}
+
+template<typename T>
+void DiskBigImage<T>::advise_file_nodes(const std::vector<ImagePrefetcher::Node> &nodes) const
+{
+	/* the successive nodes are usually adjacent in the file, they are advised together */
+	const char *front = NULL, *tail = NULL;
+	for(size_t i = 0; i <= nodes.size(); ++i) {
+		const MappedNode *node = NULL;
+		if(i < nodes.size() && nodes[i].first < mapped_nodes.size() && nodes[i].second < mapped_nodes[nodes[i].first].size()) {
+			node = &mapped_nodes[nodes[i].first][nodes[i].second];
+			if(node->data == NULL) continue;
+			if(node->data == tail) {
+				tail += node->cell_number*sizeof(T);
+				continue;
+			}
+		}
+
+		if(front != NULL) mapped_file->advise(front - mapped_file->data(), tail - front, MappedFile::ADVICE_WILLNEED);
+		front = tail = NULL;
+		if(node != NULL) {
+			front = node->data;
+			tail = front + node->cell_number*sizeof(T);
+		}
+	}
+}
+
+template<typename T>
+bool DiskBigImage<T>::prefetch_region(int level, int start_row, int start_col, int rows, int cols) const
+{
+	if(!check_level_rectangle("prefetch_region", level, start_row, start_col, rows, cols)) return false;
+
+	prefetch_rectangle(level, start_row, start_col, start_row + rows, start_col + cols);
+	return true;
+}
+
+template<typename T>
+void DiskBigImage<T>::prefetch_rectangle(size_t level, int64 start_row, int64 start_col, int64 end_row, int64 end_col) const
+{
+	if(level > m_max_level || !level_index_methods[level]) return;
+
+	start_row = std::max<int64>(start_row, 0);
+	start_col = std::max<int64>(start_col, 0);
+	end_row = std::min<int64>(end_row, level_infos[level].rows);
+	end_col = std::min<int64>(end_col, level_infos[level].cols);
+	if(start_row >= end_row || start_col >= end_col) return;
+
+	std::vector<IndexMethodInterface::IndexRange> index_ranges;
+	level_index_methods[level]->get_index_ranges(start_row, start_col, end_row - start_row, end_col - start_col, index_ranges);
+
+	std::vector<ImagePrefetcher::Node> nodes;
+	get_file_nodes(level, index_ranges, nodes);
+
+	/* the system reads the mapped file nodes in the background */
+	if(mapped_file) {
+		advise_file_nodes(nodes);
+		return;
+	}
+
+	ImagePrefetcher *files_prefetcher = get_prefetcher();
+	if(files_prefetcher == NULL) return;
+
+	for(size_t i = 0; i < nodes.size(); ++i) {
+		files_prefetcher->push(nodes[i].first, nodes[i].second);
+	}
+}
+
+template<typename T>
+void DiskBigImage<T>::prefetch_around(size_t level, int start_row, int start_col, int rows, int cols) const
+{
+	int64 end_row = int64(start_row) + rows, end_col = int64(start_col) + cols;
+
+	if(prefetch_policy & PREFETCH_NEIGHBOURS) {
+		/* the ring is about one file node wide */
+		int64 margin = int64(1) << (file_node_shift_num / 2);
+		prefetch_rectangle(level, start_row - margin, start_col - margin, start_row, end_col + margin);
+		prefetch_rectangle(level, end_row, start_col - margin, end_row + margin, end_col + margin);
+		prefetch_rectangle(level, start_row, start_col - margin, end_row, start_col);
+		prefetch_rectangle(level, start_row, end_col, end_row, end_col + margin);
+	}
+
+	if(prefetch_policy & PREFETCH_LEVELS) {
+		if(level < m_max_level) {
+			prefetch_rectangle(level + 1, start_row/2, start_col/2, (end_row + 1)/2, (end_col + 1)/2);
+		}
+		if(level > 0) {
+			prefetch_rectangle(level - 1, int64(start_row)*2, int64(start_col)*2, end_row*2, end_col*2);
+		}
+	}
+}
+
+template<typename T>
+bool DiskBigImage<T>::read_regions(const std::vector<ImageRegionRequest<T> > &requests) const
+{
+	using namespace std;
+
+	/* split the index ranges of all the requests by the file nodes */
+	vector<RegionSegment> segments;
+	vector<IndexMethodInterface::IndexRange> index_ranges;
+	for(size_t i = 0; i < requests.size(); ++i) {
+		const ImageRegionRequest<T> &request = requests[i];
+		if(!check_level_rectangle("read_regions", request.level, request.start_row, request.start_col, request.rows, request.cols)) return false;
+		if(request.rows == 0 || request.cols == 0) continue;
+		if(request.dst == NULL || request.row_stride < request.cols*sizeof(T)) {
+			cerr << "DiskBigImage::read_regions function para error : invalid buffer of request " << i << endl;
+			return false;
+		}
+
+		level_index_methods[request.level]->get_index_ranges(request.start_row, request.start_col, 
+			request.rows, request.cols, index_ranges);
+
+		RegionSegment segment;
+		segment.level = request.level;
+		segment.request_no = i;
+		for(size_t k = 0; k < index_ranges.size(); ++k) {
+			IndexMethodInterface::IndexType front = index_ranges[k].front;
+			while(front < index_ranges[k].tail) {
+				segment.file_number = size_t(front >> file_node_shift_num);
+				IndexMethodInterface::IndexType file_tail = IndexMethodInterface::IndexType(segment.file_number + 1) << file_node_shift_num;
+				segment.range.front = front;
+				segment.range.tail = min(file_tail, index_ranges[k].tail);
+				segments.push_back(segment);
+				front = segment.range.tail;
+			}
+		}
+	}
+
+	/* visit the file nodes in the storage order, each one is put into the cache once */
+	sort(segments.begin(), segments.end());
+
+	/* the missing files are read together */
+	vector<ImagePrefetcher::Node> nodes;
+	for(size_t i = 0; i < segments.size(); ++i) {
+		ImagePrefetcher::Node node(segments[i].level, segments[i].file_number);
+		if(nodes.empty() || nodes.back() != node) nodes.push_back(node);
+	}
+
+	if(mapped_file) {
+		if(nodes.size() > 1) advise_file_nodes(nodes);
+		for(size_t i = 0; i < segments.size(); ++i) {
+			const ImageRegionRequest<T> &request = requests[segments[i].request_no];
+			if(!read_from_mapped_range(segments[i].level, *level_index_methods[segments[i].level], segments[i].range,
+				request.start_row, request.start_col, request.dst, request.row_stride)) return false;
+		}
+		segments.clear();
+	} else if(nodes.size() > 1) {
+		load_file_nodes(nodes);
+	}
+
+	for(size_t i = 0; i < segments.size(); ) {
+		size_t level = segments[i].level, file_number = segments[i].file_number;
+		ImageFileLRU<T> &lru_image_files = *get_cache_shard(level, file_number);
+		boost::mutex::scoped_lock lock(lru_image_files.get_mutex());
+
+		int file_index = lru_image_files.put_into_lru(lock, level, file_number);
+		if(file_index == lru_image_files.npos) return false;
+
+		const vector<T> &file_data = lru_image_files.get_const_data(file_index);
+		const IndexMethodInterface &level_index_method = *level_index_methods[level];
+		IndexMethodInterface::IndexType file_front = IndexMethodInterface::IndexType(file_number) << file_node_shift_num;
+
+		/* scatter the node into all the requests covering it */
+		for(; i < segments.size() && segments[i].level == level && segments[i].file_number == file_number; ++i) {
+			const ImageRegionRequest<T> &request = requests[segments[i].request_no];
+			for(IndexMethodInterface::IndexType index = segments[i].range.front; index < segments[i].range.tail; ++index) {
+				RowMajorPoint point = level_index_method.get_origin_index(index);
+				T *row_ptr = reinterpret_cast<T*>(reinterpret_cast<char*>(request.dst) + (point.row - request.start_row)*request.row_stride);
+				row_ptr[point.col - request.start_col] = file_data[size_t(index - file_front)];
+			}
+		}
+	}
+
+	if(prefetch_policy != PREFETCH_NONE) {
+		for(size_t i = 0; i < requests.size(); ++i) {
+			prefetch_around(requests[i].level, requests[i].start_row, requests[i].start_col, requests[i].rows, requests[i].cols);
+		}
+	}
+
+	return true;
+}
+
+template<typename T>
+bool DiskBigImage<T>::get_region_view(int level, int start_row, int start_col, int rows, int cols, 
+	ImageRegionView<T> &view) const
+{
+	view.reset();
+	if(!check_level_rectangle("get_region_view", level, start_row, start_col, rows, cols) || rows == 0 || cols == 0) return false;
+
+	/* the ranges are sorted, so the area lies in one file if the first and the last cells do */
+	std::vector<IndexMethodInterface::IndexRange> index_ranges;
+	level_index_methods[level]->get_index_ranges(start_row, start_col, rows, cols, index_ranges);
+
+	size_t file_number = size_t(index_ranges.front().front >> file_node_shift_num);
+	if(size_t((index_ranges.back().tail - 1) >> file_node_shift_num) != file_number) return false;
+
+	if(mapped_file) {
+		const MappedNode &node = mapped_nodes[level][file_number];
+		if(node.data != NULL && node.cell_number >= size_t(file_node_size) && 
+			reinterpret_cast<size_t>(node.data) % boost::alignment_of<T>::value == 0) {
+			/* the view keeps the mapping */
+			view.m_cells = boost::shared_ptr<const T>(mapped_file, reinterpret_cast<const T*>(node.data));
+		} else {
+			/* the uniform, partial or not aligned node is copied */
+			boost::shared_ptr<std::vector<T> > cells = boost::make_shared<std::vector<T> >(size_t(file_node_size));
+			for(size_t i = 0; i < cells->size(); ++i) {
+				node.get_cell(i, (*cells)[i]);
+			}
+			view.m_cells = boost::shared_ptr<const T>(cells, &(*cells)[0]);
+		}
+	} else {
+		const boost::shared_ptr<ImageFileLRU<T> > &lru_image_files = get_cache_shard(level, file_number);
+		boost::mutex::scoped_lock lock(lru_image_files->get_mutex());
+		int file_index = lru_image_files->put_into_lru(lock, level, file_number);
+		if(file_index == lru_image_files->npos) return false;
+
+		boost::shared_ptr<const std::vector<T> > file_data = ImageFileLRU<T>::pin_data(lru_image_files, file_index);
+		view.m_cells = boost::shared_ptr<const T>(file_data, &(*file_data)[0]);
+	}
+	view.m_index_method = level_index_methods[level];
+	view.m_node_front = IndexMethodInterface::IndexType(file_number) << file_node_shift_num;
+	view.m_start_row = start_row;
+	view.m_start_col = start_col;
+	view.m_rows = rows;
+	view.m_cols = cols;
+
+	if(prefetch_policy != PREFETCH_NONE) prefetch_around(level, start_row, start_col, rows, cols);
+
+	return true;
+}
+
+template<typename T>
+size_t DiskBigImage<T>::get_cached_bytes(size_t level) const
+{
+	size_t bytes = 0;
+	for(size_t i = 0; i < lru_shards.size(); ++i) {
+		boost::mutex::scoped_lock lock(lru_shards[i]->get_mutex());
+		bytes += lru_shards[i]->get_cached_bytes(level);
+	}
+	return bytes;
+}
+
+template<typename T>
+ImageAccessMode DiskBigImage<T>::get_access_mode() const
+{
+	return access_mode;
+}
+
 template<typename T>
 size_t DiskBigImage<T>::get_max_image_level() const 
 {
@@ -46,17 +554,19 @@ bool DiskBigImage<T>::set_current_level(int level)
 	/* if set the same level, do nothing */
 	if(m_current_level == level)	return true;
 
+	/* change the new index method, the level index method is decided by the full size image index method */
+	if(!level_index_methods[level]) {
+		std::cerr << "DiskBigImage::set_current_level function error : the index method " 
+			<< origin_index_method->get_index_method_name() << " doesn't support level " << level << std::endl;
+		return false;
+	}
+	index_method = level_index_methods[level];
+
 	m_current_level = level;
 
 	/* current image size */
-	img_current_level_size.rows = std::ceil((double)(img_size.rows) / (1 << level));
-	img_current_level_size.cols = std::ceil((double)(img_size.cols) / (1 << level));
-
-	/* change the new index method */
-	index_method = boost::shared_ptr<IndexMethodInterface>(new ZOrderIndex(img_current_level_size.rows, img_current_level_size.cols));
-
-	/* change the image level data path to the specific level*/
-	img_level_data_path = img_data_path + "/level_" + boost::lexical_cast<std::string>(level);
+	img_current_level_size.rows = (size_t)level_infos[level].rows;
+	img_current_level_size.cols = (size_t)level_infos[level].cols;
 
 	return true;
 }
@@ -68,50 +578,44 @@ size_t DiskBigImage<T>::get_current_level() const
 }
 
 template<typename T>
-bool DiskBigImage<T>::read_from_index_range(size_t front, size_t tail, ZOrderIndex::IndexType start_index, 
-	const std::vector<DataIndexInfo> &index_info_vector, std::vector<T> &data_vector)
+bool DiskBigImage<T>::read_from_index_range(size_t level, const IndexMethodInterface &level_index_method, 
+	const IndexMethodInterface::IndexRange &range, int start_row, int start_col, T *dst, size_t row_stride) const
 {
 	using namespace std;
 
-	BOOST_ASSERT(tail > front);
+	BOOST_ASSERT(range.tail > range.front);
 
-	/* total number for reading */
-	size_t total = tail - front;
-
-	/* save the actually first zorder index (take account of the start_index) */
-	size_t zorder_index_front = index_info_vector[front].zorder_index + start_index;
+	IndexMethodInterface::IndexType index = range.front;
 
 	/* the first image file number */
-	size_t start_file_number = (zorder_index_front >> file_node_shift_num);
+	size_t start_file_number = (index >> file_node_shift_num);
 
 	/* the seekg cell size in the file */
-	size_t start_seekg = zorder_index_front - (start_file_number << file_node_shift_num);
+	size_t start_seekg = index - (start_file_number << file_node_shift_num);
 
 	/* while the cell number has not been finished */
-	while(total > 0) {
-		/* image file name */
-		string img_file_name = img_level_data_path + '/' + boost::lexical_cast<string>(start_file_number);
+	while(index < range.tail) {
+		ImageFileLRU<T> &lru_image_files = *get_cache_shard(level, start_file_number);
+		boost::mutex::scoped_lock lock(lru_image_files.get_mutex());
 
-		/* the file_index means the index of the img_file_name in lru_image_files */
-		int file_index = lru_image_files.put_into_lru(img_file_name);
+		/* the file_index means the index of the image file (level, start_file_number) in lru_image_files */
+		int file_index = lru_image_files.put_into_lru(lock, level, start_file_number);
 
 		/* if not get the reasonable position, there must be some kind of error, so just return false */
 		if(file_index == lru_image_files.npos)	return false;
 
-		const vector<Vec3b> &file_data = lru_image_files.get_data(file_index);
+		const vector<T> &file_data = lru_image_files.get_const_data(file_index);
 
-		size_t read_number = min<size_t>(tail - front, file_node_size - start_seekg);
+		size_t read_number = min<size_t>(range.tail - index, file_node_size - start_seekg);
 
-		/* write data into the front location */
-		for(size_t i = 0; i < read_number; ++i) {
-			data_vector[index_info_vector[front++].index] = file_data[start_seekg + i];
+		/* scatter the data into the row-major location */
+		for(size_t i = 0; i < read_number; ++i, ++index) {
+			RowMajorPoint point = level_index_method.get_origin_index(index);
+			T *row_ptr = reinterpret_cast<T*>(reinterpret_cast<char*>(dst) + (point.row - start_row)*row_stride);
+			row_ptr[point.col - start_col] = file_data[start_seekg + i];
 		}
 
-		total -= read_number;
-		if(total <= 0)	break;
-
-		/* here means prepare for next loop */
-		/* make the seekg = 0, means in later loop the seekg will just begin from the start point of each file for reading */
+		/* make the seekg = 0, means in later loop the seekg will just begin from the start point of each file */
 		start_seekg = 0;
 
 		/* the next file is just one number larger than formal image */
@@ -122,132 +626,183 @@ bool DiskBigImage<T>::read_from_index_range(size_t front, size_t tail, ZOrderInd
 }
 
 template<typename T>
-bool DiskBigImage<T>::check_para_validation(int level, int start_row, int start_col, int rows, int cols) 
+bool DiskBigImage<T>::read_from_mapped_range(size_t level, const IndexMethodInterface &level_index_method, 
+	const IndexMethodInterface::IndexRange &range, int start_row, int start_col, T *dst, size_t row_stride) const
 {
-	using namespace std;
+	BOOST_ASSERT(range.tail > range.front);
 
-	if(!set_current_level(level)) return false;
+	IndexMethodInterface::IndexType index = range.front;
+	size_t start_file_number = (index >> file_node_shift_num);
+	size_t start_seekg = index - (start_file_number << file_node_shift_num);
 
-	if(start_row >= img_current_level_size.rows || start_row < 0) {
-		cerr << "DiskBigImage::get_pixels_by_level function para error : invalid start_rows" << endl;
-		return false;
-	}
+	while(index < range.tail) {
+		if(start_file_number >= mapped_nodes[level].size()) return false;
+		const MappedNode &node = mapped_nodes[level][start_file_number];
 
-	if(start_col >= img_current_level_size.cols || start_col < 0) {
-		cerr << "DiskBigImage::get_pixels_by_level function para error : invalid start_cols" << endl;
-		return false;
-	}
+		size_t read_number = std::min<size_t>(range.tail - index, file_node_size - start_seekg);
 
-	if(start_row + rows > img_current_level_size.rows || rows < 0) {
-		cerr << "DiskBigImage::get_pixels_by_level function para error : invalid rows"<< endl;
-		return false;
-	}
+		/* scatter the cells of the mapping into the row-major location, no lock is needed */
+		for(size_t i = 0; i < read_number; ++i, ++index) {
+			RowMajorPoint point = level_index_method.get_origin_index(index);
+			T *row_ptr = reinterpret_cast<T*>(reinterpret_cast<char*>(dst) + (point.row - start_row)*row_stride);
+			node.get_cell(start_seekg + i, row_ptr[point.col - start_col]);
+		}
 
-	if(start_col + cols > img_current_level_size.cols || cols < 0) {
-		cerr << "DiskBigImage::get_pixels_by_level function para err : invalid cols" << endl;
-		return false;
+		start_seekg = 0;
+		++start_file_number;
 	}
 
 	return true;
 }
 
 template<typename T>
-bool DiskBigImage<T>::get_pixels_by_level(int level, int start_row, int start_col, int rows, int cols, std::vector<T> &vec)
+bool DiskBigImage<T>::write_to_index_range(const IndexMethodInterface::IndexRange &range, 
+	int start_row, int start_col, int cols, const std::vector<T> &data_vector)
 {
 	using namespace std;
 
-	if(!check_para_validation(level, start_row, start_col, rows, cols)) return false;
+	BOOST_ASSERT(range.tail > range.front);
 
-	/* save the zorder indexing method information*/
-	std::vector<DataIndexInfo> index_info_vector(rows*cols);
+	IndexMethodInterface::IndexType index = range.front;
 
-	/* save the actual image data in row-major */
-	vec.resize(rows*cols);
+	/* the first image file number */
+	size_t start_file_number = (index >> file_node_shift_num);
+
+	/* the seekg cell size in the file */
+	size_t start_seekg = index - (start_file_number << file_node_shift_num);
+
+	/* while the cell number has not been finished */
+	while(index < range.tail) {
+		ImageFileLRU<T> &lru_image_files = *get_cache_shard(m_current_level, start_file_number);
+		boost::mutex::scoped_lock lock(lru_image_files.get_mutex());
+
+		/* the file_index means the index of the image file (level, start_file_number) in lru_image_files */
+		int file_index = lru_image_files.put_into_lru(lock, m_current_level, start_file_number, true);
+
+		/* if not get the reasonable position, there must be some kind of error, so just return false */
+		if(file_index == lru_image_files.npos)	return false;
+
+		size_t write_number = min<size_t>(range.tail - index, file_node_size - start_seekg);
 
-	/* the start index of the image range, thus the zorder index of the top-left point */
-	ZOrderIndex::IndexType start_zorder_index = index_method->get_index(start_row, start_col);
-
-	/* initialize the data index information */ 
-	for(size_t i = 0; i < rows; ++i) {
-		ZOrderIndex::IndexType row_result = index_method->get_row_result(i + start_row);
-		size_t row_index = i*cols;	
-		for(size_t j = 0; j < cols; ++j) {
-			index_info_vector[row_index + j].index = row_index + j;
-			index_info_vector[row_index + j].zorder_index = 
-				index_method->get_index_by_row_result(row_result, j + start_col) - start_zorder_index; 
+		/* using get_data function will make the written cells of the file_index cache be dirty, thus will be write 
+		 * back when the cache is swap out of the memory or flushed */
+		vector<T> &file_data = lru_image_files.get_data(file_index, start_seekg, write_number);
+
+		/* gather the data from the row-major location */
+		for(size_t i = 0; i < write_number; ++i, ++index) {
+			RowMajorPoint point = index_method->get_origin_index(index);
+			file_data[start_seekg + i] = data_vector[(point.row - start_row)*cols + (point.col - start_col)];
 		}
+
+		/* make the seekg = 0, means in later loop the seekg will just begin from the start point of each file */
+		start_seekg = 0;
+
+		/* the next file is just one number larger than formal image */
+		++start_file_number;
 	}
 
-	/* sort the index info vector by the zorder index value */
-	std::sort(index_info_vector.begin(), index_info_vector.end());
+	return true;
+}
 
-	/* front and tail means a range of the successive zorder index in format [front, tail) */
-	size_t front = 0, tail = 0;
-	const size_t end = rows*cols;  
+template<typename T>
+bool DiskBigImage<T>::check_para_validation(const char *caller, int level, int start_row, int start_col, int rows, int cols) 
+{
+	if(!set_current_level(level)) return false;
 
-	/* first make the front and tail the same, the expect_index means the expect zorder index when searching in successive way*/
-	front = tail = 0;
-	ZOrderIndex::IndexType expect_index = index_info_vector[front].zorder_index;
-	while(front < end) {
-		expect_index = index_info_vector[front].zorder_index;
+	return check_level_rectangle(caller, level, start_row, start_col, rows, cols);
+}
 
-		while(tail < end && expect_index == index_info_vector[tail].zorder_index) {
-			++tail;
-			++expect_index;
-		}
+template<typename T>
+bool DiskBigImage<T>::check_level_rectangle(const char *caller, int level, int start_row, int start_col, int rows, int cols) const
+{
+	using namespace std;
 
-		/*now get the successive zorder index range [front, tail) */
-		{
-			BOOST_ASSERT(tail > front);
+	if(level < 0 || size_t(level) > m_max_level || !level_index_methods[level]) {
+		cerr << "DiskBigImage::" << caller << " para error : invalid level" << endl;
+		return false;
+	}
 
-			/* total number for reading */
-			size_t total = tail - front;
+	int64 level_rows = level_infos[level].rows, level_cols = level_infos[level].cols;
 
-			/* save the actually first zorder index (take account of the start_zorder_index) */
-			size_t zorder_index_front = index_info_vector[front].zorder_index + start_zorder_index;
+	if(start_row >= level_rows || start_row < 0) {
+		cerr << "DiskBigImage::" << caller << " para error : invalid start_rows" << endl;
+		return false;
+	}
 
-			/* the first image file number */
-			size_t start_file_number = (zorder_index_front >> file_node_shift_num);
+	if(start_col >= level_cols || start_col < 0) {
+		cerr << "DiskBigImage::" << caller << " para error : invalid start_cols" << endl;
+		return false;
+	}
 
-			/* the seekg cell size in the file */
-			size_t start_seekg = zorder_index_front - (start_file_number << file_node_shift_num);
+	if(start_row + rows > level_rows || rows < 0) {
+		cerr << "DiskBigImage::" << caller << " para error : invalid rows"<< endl;
+		return false;
+	}
 
-			/* while the cell number has not been finished */
-			while(total > 0) {
-				/* image file name */
-				string img_file_name = img_level_data_path + '/' + boost::lexical_cast<string>(start_file_number);
+	if(start_col + cols > level_cols || cols < 0) {
+		cerr << "DiskBigImage::" << caller << " para error : invalid cols" << endl;
+		return false;
+	}
 
-				/* the file_index means the index of the img_file_name in lru_image_files */
-				int file_index = lru_image_files.put_into_lru(img_file_name);
+	return true;
+}
 
-				/* if not get the reasonable position, there must be some kind of error, so just return false */
-				if(file_index == lru_image_files.npos)	return false;
+template<typename T>
+bool DiskBigImage<T>::get_pixels_by_level(int level, int start_row, int start_col, int rows, int cols, std::vector<T> &vec)
+{
+	if(!set_current_level(level)) return false;
+
+	return read_pixels_by_level(level, start_row, start_col, rows, cols, vec);
+}
 
-				const vector<Vec3b> &file_data = lru_image_files.get_const_data(file_index);
+template<typename T>
+bool DiskBigImage<T>::read_pixels_by_level(int level, int start_row, int start_col, int rows, int cols, std::vector<T> &vec) const
+{
+	if(!check_level_rectangle("read_pixels_by_level", level, start_row, start_col, rows, cols)) return false;
 
-				size_t read_number = min<size_t>(tail - front, file_node_size - start_seekg);
+	/* save the actual image data in row-major */
+	vec.resize(rows*cols);
+	if(rows == 0 || cols == 0)	return true;
 
-				/* write data into the front location */
-				for(size_t i = 0; i < read_number; ++i) {
-					vec[index_info_vector[front++].index] = file_data[start_seekg + i];
-				}
+	return read_pixels_by_level(level, start_row, start_col, rows, cols, &vec[0], cols*sizeof(T));
+}
 
-				total -= read_number;
-				if(total <= 0)	break;
+template<typename T>
+bool DiskBigImage<T>::read_pixels_by_level(int level, int start_row, int start_col, int rows, int cols, 
+	T *dst, size_t row_stride) const
+{
+	if(!check_level_rectangle("read_pixels_by_level", level, start_row, start_col, rows, cols)) return false;
+	if(rows == 0 || cols == 0)	return true;
 
-				/* here means prepare for next loop */
-				/* make the seekg = 0, means in later loop the seekg will just begin from the */
-				/* start point of each file for reading */
-				start_seekg = 0;
+	if(dst == NULL || row_stride < cols*sizeof(T)) {
+		std::cerr << "DiskBigImage::read_pixels_by_level function para error : invalid buffer" << std::endl;
+		return false;
+	}
 
-				/* the next file is just one number larger than formal image */
-				++start_file_number;
-			}
-		}
+	/* decompose the range area into the successive index ranges, the ranges are sorted by the index
+	 * thus the image files are visited in order */
+	const IndexMethodInterface &level_index_method = *level_index_methods[level];
+	std::vector<IndexMethodInterface::IndexRange> index_ranges;
+	level_index_method.get_index_ranges(start_row, start_col, rows, cols, index_ranges);
 
-		front = tail;
+	/* the missing files are read together */
+	std::vector<ImagePrefetcher::Node> nodes;
+	get_file_nodes(level, index_ranges, nodes);
+
+	if(mapped_file) {
+		if(nodes.size() > 1) advise_file_nodes(nodes);
+		for(size_t i = 0; i < index_ranges.size(); ++i) {
+			if(!read_from_mapped_range(level, level_index_method, index_ranges[i], start_row, start_col, dst, row_stride)) return false;
+		}
+	} else {
+		if(nodes.size() > 1) load_file_nodes(nodes);
+		for(size_t i = 0; i < index_ranges.size(); ++i) {
+			if(!read_from_index_range(level, level_index_method, index_ranges[i], start_row, start_col, dst, row_stride)) return false;
+		}
 	}
 
+	if(prefetch_policy != PREFETCH_NONE) prefetch_around(level, start_row, start_col, rows, cols);
+
 	return true;
 }
 
@@ -257,7 +812,7 @@ bool DiskBigImage<T>::get_pixels_by_level_fast(int level, int &start_row, int &s
 {
 	using namespace std;
 
-	if(!check_para_validation(level, start_row, start_col, rows, cols)) return false;
+	if(!check_para_validation("get_pixels_by_level_fast", level, start_row, start_col, rows, cols)) return false;
 
 	/* first recalculate the para to get the most fast suitable para */
 	start_row = make_less_four_multiply(start_row);
@@ -272,97 +827,22 @@ template<typename T>
 bool DiskBigImage<T>::set_pixel_by_level(int level, int start_row, int start_col, 
 	int rows, int cols, const std::vector<T> &vec)
 {	
-	using namespace std;
-
-	if(!check_para_validation(level, start_row, start_col, rows, cols)) return false;
+	if(!check_para_validation("set_pixel_by_level", level, start_row, start_col, rows, cols)) return false;
 
-	/* save the zorder indexing method information*/
-	std::vector<DataIndexInfo> index_info_vector(rows*cols);
-
-	/* the start index of the image range, thus the zorder index of the top-left point */
-	ZOrderIndex::IndexType start_zorder_index = index_method->get_index(start_row, start_col);
-
-	/* initialize the data index information */ 
-	for(size_t i = 0; i < rows; ++i) {
-		ZOrderIndex::IndexType row_result = index_method->get_row_result(i + start_row);
-		size_t row_index = i*cols;	
-		for(size_t j = 0; j < cols; ++j) {
-			index_info_vector[row_index + j].index = row_index + j;
-			index_info_vector[row_index + j].zorder_index = 
-				index_method->get_index_by_row_result(row_result, j + start_col) - start_zorder_index; 
-		}
+	if(mapped_file) {
+		std::cerr << "DiskBigImage::set_pixel_by_level fail : the mapped image is read-only" << std::endl;
+		return false;
 	}
 
-	/* sort the index info vector by the zorder index value */
-	std::sort(index_info_vector.begin(), index_info_vector.end());
-
-	/* front and tail means a range of the successive zorder index in format [front, tail) */
-	size_t front = 0, tail = 0;
-	const size_t end = rows*cols;  
-
-	/* first make the front and tail the same, the expect_index means the expect zorder index when searching in successive way*/
-	front = tail = 0;
-	ZOrderIndex::IndexType expect_index = index_info_vector[front].zorder_index;
-	while(front < end) {
-		expect_index = index_info_vector[front].zorder_index;
-
-		while(tail < end && expect_index == index_info_vector[tail].zorder_index) {
-			++tail;
-			++expect_index;
-		}
-
-		/*now get the successive zorder index range [front, tail) */
-		{
-			BOOST_ASSERT(tail > front);
-
-			/* total number for reading */
-			size_t total = tail - front;
-
-			/* save the actually first zorder index (take account of the start_zorder_index) */
-			size_t zorder_index_front = index_info_vector[front].zorder_index + start_zorder_index;
-
-			/* the first image file number */
-			size_t start_file_number = (zorder_index_front >> file_node_shift_num);
-
-			/* the seekg cell size in the file */
-			size_t start_seekg = zorder_index_front - (start_file_number << file_node_shift_num);
-
-			/* while the cell number has not been finished */
-			while(total > 0) {
-				/* image file name */
-				string img_file_name = img_level_data_path + '/' + boost::lexical_cast<string>(start_file_number);
-
-				/* the file_index means the index of the img_file_name in lru_image_files */
-				int file_index = lru_image_files.put_into_lru(img_file_name);
-
-				/* if not get the reasonable position, there must be some kind of error, so just return false */
-				if(file_index == lru_image_files.npos)	return false;
-
-				/* using get_data function will make the file_index cache be dirty, thus will be write back when the cache is swap out 
-				 * of the memory */
-				vector<Vec3b> &file_data = lru_image_files.get_data(file_index);
+	if(vec.size() < size_t(rows)*size_t(cols))	return false;
+	if(rows == 0 || cols == 0)	return true;
 
-				size_t read_number = std::min<size_t>(tail - front, file_node_size - start_seekg);
+	/* decompose the range area into the successive index ranges */
+	std::vector<IndexMethodInterface::IndexRange> index_ranges;
+	index_method->get_index_ranges(start_row, start_col, rows, cols, index_ranges);
 
-				/* just read the data into the right place */
-				for(size_t i = 0; i < read_number; ++i) {
-					file_data[start_seekg + i] = vec[index_info_vector[front++].index];
-				}
-
-				total -= read_number;
-				if(total <= 0)	break;
-
-				/* here means prepare for next loop */
-				/* make the seekg = 0, means in later loop the seekg will just begin from the */
-				/* start point of each file for reading */
-				start_seekg = 0;
-
-				/* the next file is just one number larger than formal image */
-				++start_file_number;
-			}
-		}
-
-		front = tail;
+	for(size_t i = 0; i < index_ranges.size(); ++i) {
+		if(!write_to_index_range(index_ranges[i], start_row, start_col, cols, vec)) return false;
 	}
 
 	return true;
@@ -394,137 +874,132 @@ bool DiskBigImage<T>::load_image_head_file(const char* file_name)
 		return false;
 	}
 
-	ifstream fin(file_name, ios::in);
-	if(!fin.is_open()) {
-		cerr << file_name << " can't be opened for reading" << endl;
+	BigImageHead head;
+	if(!head.load(file_name)) return false;
+
+	/* the binary head saves the cell type, the text head doesn't */
+	if(head.cell_size != 0 && (head.cell_size != sizeof(T) || 
+		(!head.cell_type.empty() && *CellTypeName<T>::name() != '\0' && head.cell_type != CellTypeName<T>::name()))) {
+		cerr << "image format is not correct : the cell type is " << head.cell_type << ", not " << CellTypeName<T>::name() << endl;
 		return false;
 	}
 
-	string str;
-	string::size_type index = 0;
-	getline(fin, str);
-
-	/* check image head type */
-	if(str != "type=BlockwiseImage") {
-		cerr << "image format is not correct" << endl;
+	img_size = head.img_size;
+	file_node_size = head.file_node_size;
+	file_node_shift_num = head.file_node_shift_num;
+	m_mini_rows = head.mini_rows;
+	m_mini_cols = head.mini_cols;
+	m_max_level = head.max_level;
+	storage_format = head.storage_format;
+	packed_directory_offset = head.packed_directory_offset;
+	compression_codec = head.compression_codec;
+
+	index_method = create_index_method(head.index_method_name, img_size.rows, img_size.cols, head.index_method_para);
+	if(!index_method) {
+		cerr << "image format is not correct : unknown index method " << head.index_method_name << endl;
 		return false;
 	}
+	origin_index_method = index_method;
 
-	try {
-		/* get the image rows */
-		getline(fin, str);
-		index = str.find('=');
-		if(index == string::npos || str.substr(0, index) != "rows") {
-			cerr << "image format is not correct" << endl;
-			return false;
-		}
-		img_size.rows = boost::lexical_cast<size_t>(str.substr(index+1));
-
-		/* get the image cols */
-		getline(fin, str);
-		index = str.find('=');
-		if(index == string::npos || str.substr(0, index) != "cols") {
-			cerr << "image format is not correct" << endl;
-			return false;
-		}
-		img_size.cols = boost::lexical_cast<size_t>(str.substr(index+1));
-
-		/* get the file node size */
-		getline(fin, str);
-		index = str.find('=');
-		if(index == string::npos || str.substr(0, index) != "filenodesize") {
-			cerr << "image format is not correct" << endl;
-			return false;
-		}
-		file_node_size = boost::lexical_cast<size_t>(str.substr(index+1));
+	/* the text head doesn't save the levels, compute them from the index method */
+	if(head.levels.empty()) head.set_levels(origin_index_method->get_max_index() + 1);
+	level_infos = head.levels;
 
-		/* get the file node shift number */
-		getline(fin, str);
-		index = str.find('=');
-		if(index == string::npos || str.substr(0, index) != "filenodeshiftnum") {
-			cerr << "image format is not correct" << endl;
-			return false;
-		}
-		file_node_shift_num = boost::lexical_cast<size_t>(str.substr(index+1));
+	/* the index methods of all the levels are created here, so reading a level changes nothing */
+	level_index_methods.assign(m_max_level + 1, boost::shared_ptr<IndexMethodInterface>());
+	level_index_methods[0] = origin_index_method;
+	for(size_t level = 1; level <= m_max_level; ++level) {
+		level_index_methods[level] = origin_index_method->get_level_index_method(level);
+	}
 
-		/* get the index method */
-		getline(fin, str);
-		index = str.find('=');
-		if(index == string::npos || str.substr(0, index) != "indexmethod") {
-			cerr << "image format is not correct" << endl;
-			return false;
-		}
-		string index_str = str.substr(index+1);
-		if(index_str == "ZOrderIndex") {
-			index_method = boost::make_shared<ZOrderIndex>(img_size.rows, img_size.cols);
-		} else if (index_str == "ZOrderIndexIntuition") {
-			index_method = boost::make_shared<ZOrderIndexIntuition>(img_size.rows, img_size.cols);
-		} else {
-			cerr << "image format is not correct" << endl;
-			return false;
-		}
+	return true;
+}
 
-        /* get the image mini rows */
-        getline(fin, str);
-        index = str.find('=');
-        if(index == string::npos || str.substr(0, index) != "minirows") {
-            cerr << "image format is not correct" << endl;
-            return false;
-        }
-        m_mini_rows = boost::lexical_cast<size_t>(str.substr(index+1));
-
-        /* get the image mini cols */
-        getline(fin, str);
-        index = str.find('=');
-        if(index == string::npos || str.substr(0, index) != "minicols") {
-            cerr << "image format is not correct" << endl;
-            return false;
-        }
-        m_mini_cols = boost::lexical_cast<size_t>(str.substr(index+1));
-
-		/* this is hierarchical part */
-        /* get the hierarchal image max scale level */
-        getline(fin, str);
-
-		/* this means this is just the blockwiseimage, so the max level is 0 only */
-		if(fin.eof()) {
-			m_max_level = 0;
-			return true;
-		}
+template<typename T>
+inline void DiskBigImage<T>::set_image_data_path(const char * file_name) 
+{
+	namespace bf = boost::filesystem;
 
-        index = str.find('=');
-        if(index == string::npos || str.substr(0, index) != "maxlevel") {
-            cerr << "image format is not correct" << endl;
-            return false;
-        }
-        m_max_level = boost::lexical_cast<size_t>(str.substr(index+1));
+	/* save the img_data_path */
+	bf::path file_path = file_name;
+	img_data_path = (file_path.parent_path() / file_path.stem()).generic_string();
+}
 
-		getline(fin, str);
-        if(fin.eof()) return true;
-        if(fin.fail()) return false;
+template<typename T>
+bool DiskBigImage<T>::open_image_storage(const char *file_name)
+{
+	if(storage_format == ImageStorage::PACKED_STORAGE) {
+		boost::shared_ptr<PackedImageStorage> storage = boost::make_shared<PackedImageStorage>();
+		if(!storage->open(file_name, packed_directory_offset, BigImageHead::DIRECTORY_OFFSET_POS)) return false;
+		image_storage = storage;
+	} else {
+		image_storage = boost::make_shared<DirectoryImageStorage>(img_data_path);
+	}
 
-        fin.close();
-		return true;
+	/* the nodes are decompressed when filling the cache and compressed when written back */
+	if(compression_codec != NodeCodec::NO_CODEC) {
+		boost::shared_ptr<NodeCodec> codec = NodeCodec::create(compression_codec, sizeof(T));
+		if(!codec) {
+			std::cerr << "image format is not correct : unknown compression codec " << compression_codec << std::endl;
+			return false;
+		}
+		image_storage = boost::make_shared<CompressedImageStorage>(image_storage, codec);
+	}
 
-	} catch(boost::bad_lexical_cast &err) {
-		cerr << err.what() << endl;
-		fin.close();
-		return false;
+	for(size_t i = 0; i < lru_shards.size(); ++i) {
+		lru_shards[i]->set_storage(image_storage);
 	}
+	return true;
 }
 
 template<typename T>
-inline void DiskBigImage<T>::set_image_data_path(const char * file_name) 
+bool DiskBigImage<T>::open_mapped_file(const char *file_name)
 {
-	namespace bf = boost::filesystem;
+	using namespace std;
 
-	/* save the img_data_path */
-	bf::path file_path = file_name;
-	img_data_path = (file_path.parent_path() / file_path.stem()).generic_string();
+	PackedImageStorage *storage = dynamic_cast<PackedImageStorage*>(image_storage.get());
+	if(storage == NULL || compression_codec != NodeCodec::NO_CODEC) return false;
+
+	boost::shared_ptr<MappedFile> file = boost::make_shared<MappedFile>();
+	if(!file->open(file_name)) return false;
+
+	/* the regions visit the file nodes randomly, the system shouldn't read ahead */
+	file->advise(0, file->size(), MappedFile::ADVICE_RANDOM);
+
+	vector<vector<MappedNode> > nodes(level_infos.size());
+	for(size_t level = 0; level < level_infos.size(); ++level) {
+		nodes[level].resize(level_infos[level].node_number);
+		for(size_t node_no = 0; node_no < nodes[level].size(); ++node_no) {
+			MappedNode &node = nodes[level][node_no];
+			node.data = NULL;
+			node.cell_number = 0;
+			memset(&node.uniform_cell, 0, sizeof(T));
+
+			UniformCell cell;
+			size_t bytes = 0;
+			if(storage->get_uniform_node(level, node_no, cell, bytes)) {
+				memcpy(&node.uniform_cell, cell.value, min<size_t>(cell.cell_bytes, sizeof(T)));
+				continue;
+			}
+
+			int64 offset = 0;
+			if(!storage->get_node_location(level, node_no, offset, bytes) || offset + int64(bytes) > file->size()) {
+				cerr << "the node " << node_no << " of level " << level << " is not saved in " << file_name << endl;
+				return false;
+			}
+			node.data = file->data() + offset;
+			node.cell_number = bytes/sizeof(T);
+		}
+	}
+
+	mapped_file = file;
+	mapped_nodes.swap(nodes);
+	access_mode = MAPPED_IMAGE_ACCESS;
+	return true;
 }
 
 template<typename T>
-boost::shared_ptr<DiskBigImage<T> > load_disk_image(const char *file_name)
+boost::shared_ptr<DiskBigImage<T> > load_disk_image(const char *file_name, ImageAccessMode access_mode)
 {
 	typedef boost::shared_ptr<DiskBigImage<T> > PtrType;
 	PtrType dst_image(new DiskBigImage<T>);
@@ -538,11 +1013,20 @@ boost::shared_ptr<DiskBigImage<T> > load_disk_image(const char *file_name)
 
 	/* set the image data path for some kind of optimization when calling set or get pixels functions */
 	dst_image->set_image_data_path(file_name);
+	if(!dst_image->open_image_storage(file_name)) return null_image;
+
+	/* the image which can't be mapped is still readable by the file caches */
+	if(access_mode == MAPPED_IMAGE_ACCESS && !dst_image->open_mapped_file(file_name)) {
+		std::cerr << "can't map the image data of " << file_name << ", the file caches are used instead" << std::endl;
+	}
 
 	/* set the current level to be the max : let it different from the first level user will be 
 	 * set in the set_current_level() function */
 	dst_image->m_current_level = std::numeric_limits<size_t>::max();
 
+	/* the file nodes used before the image was closed last time */
+	if(dst_image->load_hot_set()) dst_image->preload_hot_set();
+
 	/*
 	 * hierarchical image don't save specific level image data
 	 * when using set_current_level function to set current level
@@ -553,9 +1037,15 @@ boost::shared_ptr<DiskBigImage<T> > load_disk_image(const char *file_name)
 }
 
 template<typename T>
-boost::shared_ptr<DiskBigImage<T> > load_disk_image(const std::string &file_name)
+boost::shared_ptr<DiskBigImage<T> > load_disk_image(const char *file_name)
+{
+	return load_disk_image<T>(file_name, CACHED_IMAGE_ACCESS);
+}
+
+template<typename T>
+boost::shared_ptr<DiskBigImage<T> > load_disk_image(const std::string &file_name, ImageAccessMode access_mode = CACHED_IMAGE_ACCESS)
 {
-	return load_disk_image<T>(file_name.c_str());
+	return load_disk_image<T>(file_name.c_str(), access_mode);
 }
 
 #endif
\ No newline at end of file
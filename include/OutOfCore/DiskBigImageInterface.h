@@ -4,6 +4,28 @@
 #include "GiantImageInterface.h"
 #include "UtlityFunc.h"
 
+/**
+ * @class ImageRegionRequest DiskBigImageInterface.h
+ *
+ * @brief One area to read by DiskBigImageInterface::read_regions(), the cells are written into the dst buffer
+ * whose rows are row_stride bytes apart.
+ */
+
+template<typename T>
+struct ImageRegionRequest
+{
+	ImageRegionRequest(int _level = 0, int _start_row = 0, int _start_col = 0, int _rows = 0, int _cols = 0,
+		T *_dst = NULL, size_t _row_stride = 0)
+		: level(_level), start_row(_start_row), start_col(_start_col), rows(_rows), cols(_cols), 
+		dst(_dst), row_stride(_row_stride) {}
+
+	int level;
+	int start_row, start_col;
+	int rows, cols;
+	T *dst;
+	size_t row_stride;
+};
+
 /**
  * @class DiskBigImageInterface DiskBigImageInterface.h
  *
@@ -37,6 +59,36 @@ public:
 	virtual bool get_pixels_by_level_fast(int level, int &start_row, int &start_col,
 		int &rows, int &cols, std::vector<T> &vec) = 0;
 
+	/**
+	 *	@brief The same as get_pixels_by_level(), but the current level is not changed, so it can be called
+	 *	by multiply threads concurrently (while nobody calls the non-const functions).
+	 */
+	virtual bool read_pixels_by_level(int level, int start_row, int start_col,
+		int rows, int cols, std::vector<T> &vec) const = 0;
+
+	/**
+	 *	@brief The same as read_pixels_by_level(), but the image data is written into the caller's buffer
+	 *	directly, such as the scanlines of a QImage or the ROI of a cv::Mat.
+	 *
+	 *	@param dst the first cell of the rectangle in the buffer
+	 *	@param row_stride the bytes from one row to the next in the buffer, at least cols*sizeof(T)
+	 */
+	virtual bool read_pixels_by_level(int level, int start_row, int start_col,
+		int rows, int cols, T *dst, size_t row_stride) const = 0;
+
+	/**
+	 *	@brief Read many areas at once, the file nodes needed by all the areas are read in the storage order,
+	 *	and each one is read once and scattered into all the areas it covers.
+	 *	@return false if any request is invalid (then nothing is read) or fails to read
+	 */
+	virtual bool read_regions(const std::vector<ImageRegionRequest<T> > &requests) const = 0;
+
+	/**
+	 *	@brief Tell that the area of the level will be needed soon, the image data is loaded into the
+	 *	cache in the background, the function returns at once.
+	 */
+	virtual bool prefetch_region(int level, int start_row, int start_col, int rows, int cols) const = 0;
+
     /**
 	 *	@brief get the current level image rows after calling the set_current_level function
 	 */
@@ -60,6 +112,19 @@ public:
 	 */
 	virtual bool set_file_cache_number(int _file_cache_number) = 0;
 
+	/**
+	 *	@brief set the file cache by the bytes instead of the file number, the file number is the bytes
+	 *	divided by the file size (at least one file). The bytes of all the images are also limited by
+	 *	ImageCacheManager::set_byte_budget()
+	 */
+	virtual bool set_file_cache_bytes(size_t bytes) = 0;
+
+	/**
+	 *	@brief write back the changed image data in the file caches, so the image on disk is up to date.
+	 *	The data is also written back when the cached files are evicted or the image is destroyed
+	 */
+	virtual bool flush() = 0;
+
 	/**
 	 *	@brief get the maximum image level thus the minimal size image's scale level
 	 */
@@ -4,6 +4,7 @@
 #include <string>
 
 #include "BlockwiseImage.h"
+#include "PixelAccumulator.h"
 
 /**
  * @class HierarchicalImage HierarchicalImage.h
@@ -12,14 +13,17 @@
  *
  * HierarchicalImage can support very big image processing and storing, different with the BlockwiseImage, HierarchicalImage 
  * can write the image into different levels, but the BlockwiseImage can only save the full size of the image.
+ * The level image is the 2x2 box averaging of the lower level, and all the levels are built in one sequential pass
+ * over the image container, the cell type must be supported by PixelAccumulator.
  *
  * @tparam T The type of the image cell
- * @tparam memory_usage The memory usage used as a I/O cache in the main memory, and it must be bigger than 8 (in the unit of M).
- *		 By default, memory_usage is set to 64M
+ * @tparam memory_usage The default memory usage used as a I/O cache in the main memory (in the unit of M), it is used when 
+ *		 the constructor is not given the runtime memory budget. By default, memory_usage is set to 64M
+ * @tparam IndexMethod The compile-time index method type @see BlockwiseImage
  */
 
-template<typename T, size_t memory_usage = 64>
-class HierarchicalImage: public BlockwiseImage<T, memory_usage>
+template<typename T, size_t memory_usage = 64, typename IndexMethod = IndexMethodInterface>
+class HierarchicalImage: public BlockwiseImage<T, memory_usage, IndexMethod>
 {
 public:
 
@@ -28,10 +32,12 @@ public:
 	 * @param cols the image total cols
 	 * @param mini_rows the minimum size image rows
 	 * @param mini_cols the minimum size image cols
-	 * @param method : the index method shared_ptr object(default is zorder index method)
+	 * @param method : the index method shared_ptr object(default is created by IndexPolicy<IndexMethod>)
+	 * @param memory_budget : the I/O cache size in bytes, 0 means using the memory_usage template parameter
 	 */
 	HierarchicalImage(size_t rows, size_t cols, size_t mini_rows, size_t mini_cols,
-		boost::shared_ptr<IndexMethodInterface> method = boost::shared_ptr<IndexMethodInterface>());
+		boost::shared_ptr<IndexMethodInterface> method = boost::shared_ptr<IndexMethodInterface>(),
+		int64 memory_budget = 0);
 
 	virtual ~HierarchicalImage();
 
@@ -46,22 +52,14 @@ public:
 public:
 
 	/**
-	 * @brief set the number for writing image files concurrently
+	 * @brief set the number of the threads writing image files concurrently
 	 * 
 	 * If the image has n levels(thus max level is n-1), then when write the image data in a hierarchical way into disk
-	 * the maximum concurrent number is n.
+	 * the maximum concurrent number is n. The writer threads flush the full file buffers while the calling thread 
+	 * keeps scanning the image container.
 	 */
 	inline void set_mutliply_ways_writing_number(size_t number);
 
-protected:
-
-	/**
-	 * @brief set the image data path from the big image file name. 
-	 *
-	 * For example : the file_name is /a/x.bigimage then the data_path is /a/x/
-	 */
-	inline void set_image_data_path(const char *file_name); 
-
 protected:
 
 	/**
@@ -70,41 +68,33 @@ protected:
 	bool write_image_head_file(const char *file_name);
 
 	/** 
-	 * @brief write the start_level image data in the write image inner loop
+	 * @brief write all the level images into the storage in one sequential pass over the image container.
+	 *
+	 * With the index methods supporting the levels, the 4^k successive cells beginning from the multiply of 4^k 
+	 * are exactly one 2^k x 2^k square, thus one cell of the level k. So every level keeps a carry of the 
+	 * accumulated sum and the number of the valid cells, and when the fourth child arrives, the averaged 
+	 * cell is written into the level and the carry is passed to the upper level. The cells outside the image
+	 * (the padding of the index method) are not counted in the average.
 	 */
-	bool write_image_inner_loop(size_t start_level, size_t merge_number, 
-        const boost::filesystem::path &data_path, const int64 &file_number);
+	bool write_level_images(ImageStorage &storage);
 
 protected:
-	/** the number for writing image data files in concurrently */
+	/** the number of the threads writing image data files concurrently */
 	size_t concurrent_number;
 
-	/** the data of the image file data */
-	std::string img_data_path;
-
 	/** the image current level */
 	Size img_current_level_size;
 };
 
-template<typename T, size_t memory_usage>
-inline void HierarchicalImage<T, memory_usage>::set_mutliply_ways_writing_number(size_t number) {
+template<typename T, size_t memory_usage, typename IndexMethod>
+inline void HierarchicalImage<T, memory_usage, IndexMethod>::set_mutliply_ways_writing_number(size_t number) {
 	size_t max_number = get_max_image_level() + 1;
 	concurrent_number = (number > max_number) ? max_number : number;
 } 
 
-template<typename T, size_t memory_usage>
-inline void HierarchicalImage<T, memory_usage>::set_image_data_path(const char * file_name) 
-{
-	namespace bf = boost::filesystem;
-
-	/* save the img_data_path */
-	bf::path file_path = file_name;
-	img_data_path = (file_path.parent_path() / file_path.stem()).generic_string();
-}
-
 /**
- * @brief return the hierarchical image by memroy_usage, maximum support 4G
- * @param memory_usage the memory usage of the main memory
+ * @brief return the hierarchical image by memroy_usage, the memory usage is not limited to the power of 2.
+ * @param memory_usage the memory usage of the main memory (in the unit of M), at least 8M
  * @param method the index method shared_ptr object
  * @param rows the image total rows
  * @param cols the image total cols
@@ -121,36 +111,7 @@ boost::shared_ptr<GiantImageInterface<T> > get_hierarchical_image_by_meomory_usa
 	/* ensure memory_usage is bigger than 8 */
 	memory_usage = (memory_usage < 8) ? 8 : memory_usage;
 
-	/* make memory_usage = 2^order (order >=3 && order <= 12) */
-	while(memory_usage & (memory_usage - 1)) {
-		memory_usage &= (memory_usage - 1);
-	}
-
-	switch(memory_usage)
-	{
-	case 8:
-		return boost::make_shared<HierarchicalImage<T, 8> >(rows, cols, mini_rows, mini_cols, method);
-	case 16:
-		return boost::make_shared<HierarchicalImage<T, 16> >(rows, cols, mini_rows, mini_cols, method);
-	case 32:
-		return boost::make_shared<HierarchicalImage<T, 32> >(rows, cols, mini_rows, mini_cols, method);
-	case 64:
-		return boost::make_shared<HierarchicalImage<T, 64> >(rows, cols, mini_rows, mini_cols, method);
-	case 128:
-		return boost::make_shared<HierarchicalImage<T, 128> >(rows, cols, mini_rows, mini_cols, method);
-	case 256:
-		return boost::make_shared<HierarchicalImage<T, 256> >(rows, cols, mini_rows, mini_cols, method);
-	case 512:
-		return boost::make_shared<HierarchicalImage<T, 512> >(rows, cols, mini_rows, mini_cols, method);
-	case 1024:
-		return boost::make_shared<HierarchicalImage<T, 1024> >(rows, cols, mini_rows, mini_cols, method);
-	case 2048:
-		return boost::make_shared<HierarchicalImage<T, 2048> >(rows, cols, mini_rows, mini_cols, method);
-	case 4096:
-		return boost::make_shared<HierarchicalImage<T, 4096> >(rows, cols, mini_rows, mini_cols, method);
-	default:
-		return boost::make_shared<HierarchicalImage<T, 64> >(rows, cols, mini_rows, mini_cols, method);
-	}
+	return boost::make_shared<HierarchicalImage<T> >(rows, cols, mini_rows, mini_cols, method, int64(memory_usage) << 20);
 }
 
 /**
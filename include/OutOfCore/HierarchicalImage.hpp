@@ -6,48 +6,34 @@
 
 #include "HierarchicalImage.h"
 #include "BlockwiseImage.hpp"
+#include "AsyncFileWriter.hpp"
 
 #include <boost/lexical_cast.hpp>
 #include <algorithm>
 
-template<typename T, size_t memory_usage>
-HierarchicalImage<T, memory_usage>::HierarchicalImage(size_t rows, size_t cols, size_t mini_rows, size_t mini_cols,
-	boost::shared_ptr<IndexMethodInterface> method)
-	: BlockwiseImage<T, memory_usage>(rows, cols, mini_rows, mini_cols, method)
+template<typename T, size_t memory_usage, typename IndexMethod>
+HierarchicalImage<T, memory_usage, IndexMethod>::HierarchicalImage(size_t rows, size_t cols, size_t mini_rows, size_t mini_cols,
+	boost::shared_ptr<IndexMethodInterface> method, int64 memory_budget)
+	: BlockwiseImage<T, memory_usage, IndexMethod>(rows, cols, mini_rows, mini_cols, method, memory_budget)
 {
 	/* default is maximum way concurrent writing */
 	set_mutliply_ways_writing_number(get_max_image_level() + 1);
 }
 
-template<typename T, size_t memory_usage>
-HierarchicalImage<T, memory_usage>::~HierarchicalImage()
+template<typename T, size_t memory_usage, typename IndexMethod>
+HierarchicalImage<T, memory_usage, IndexMethod>::~HierarchicalImage()
 {
 }
 
-template<typename T, size_t memory_usage>
-bool HierarchicalImage<T, memory_usage>::write_image_head_file(const char *file_name)
+template<typename T, size_t memory_usage, typename IndexMethod>
+bool HierarchicalImage<T, memory_usage, IndexMethod>::write_image_head_file(const char *file_name)
 {
-	/* write the block wise image head info */
-	if(!BlockwiseImage::write_image_head_file(file_name))	return false;
-
-	/* append the specific hierarchical image head info */
-	{
-		std::ofstream fout(file_name, std::ios::out | std::ios::app);
-		if(!fout.is_open()) {
-			std::cerr << "open " << file_name << " failure" << std::endl;
-			return false;
-		}
-
-		/* just write the max level para */
-		fout << "maxlevel=" << m_max_level << std::endl;
-		fout.close();
-	}
-
-	return true;
+	/* the block wise image head with the levels */
+	return BlockwiseImage::write_image_head_file(file_name, m_max_level);
 }
 
-template<typename T, size_t memory_usage>
-bool HierarchicalImage<T, memory_usage>::write_image(const char *file_name)
+template<typename T, size_t memory_usage, typename IndexMethod>
+bool HierarchicalImage<T, memory_usage, IndexMethod>::write_image(const char *file_name)
 {
 	using namespace std;
 	namespace bf = boost::filesystem;
@@ -56,37 +42,11 @@ bool HierarchicalImage<T, memory_usage>::write_image(const char *file_name)
 	try {
 		if(!write_image_head_file(file_name))	return false;
 
-		/* set the img_data_path */
-		set_image_data_path(file_name);
-
-		/* check the validation of img_data_path */
-		bf::path data_path(img_data_path);
-		if(bf::exists(data_path)) {
-			bf::remove_all(data_path);
-			cout << "[Warning] : " << data_path.generic_string() 
-				<< " is existing, and the original directory will be removed" << endl;
-		}
-		if(!bf::create_directory(data_path)) {
-			cerr << "create directory " << data_path.generic_string() << " failure" << endl;
-			return false;
-		}
-
-		const int64 file_number = std::ceil((double)(img_container.size()) / file_node_size);
+		boost::shared_ptr<ImageStorage> storage = create_image_storage(file_name);
+		if(!storage) return false;
 
-		/* now write the code for multiply ways concurrently writing image data */
-		size_t max_concurrent_loop = (get_max_image_level() + 1) / concurrent_number;
-		for(size_t concurrent_loop = 0; concurrent_loop < max_concurrent_loop; ++concurrent_loop) {
-			size_t start_level = concurrent_loop*concurrent_number;
-
-			/* write concurrent_number level in concurrent begging from the start_level */
-			if(!write_image_inner_loop(start_level, concurrent_number, data_path, file_number))
-				return false;
-		} // end for concurrent loop
-
-		/* write the residual concurrent_loop */
-		size_t start_level = max_concurrent_loop * concurrent_number;
-		if(!write_image_inner_loop(start_level, get_max_image_level() - start_level + 1, data_path, file_number))
-			return false;
+		/* write all the levels in one pass */
+		if(!write_level_images(*storage) || !storage->close()) return false;
 
 		/* save the mini image as a jpg format */
 		if(!save_mini_image(file_name)) return false;
@@ -100,162 +60,111 @@ bool HierarchicalImage<T, memory_usage>::write_image(const char *file_name)
 }
 
 
-template<typename T, size_t memory_usage>
-bool HierarchicalImage<T, memory_usage>::write_image_inner_loop(size_t start_level, size_t merge_number,
-	const boost::filesystem::path &data_path, const int64 &file_number)
+template<typename T, size_t memory_usage, typename IndexMethod>
+bool HierarchicalImage<T, memory_usage, IndexMethod>::write_level_images(ImageStorage &storage)
 {
-	/*
-	*	fout_array : different ofstream for multiply ways writing into files
-	*	fout_complete : tells whether the ofstream of a file has complete the writing
-	*	the file name of ofstream is decided by fout_file_level_number and fout_level_path
-	*	for example :
-	*	write file into ./some image
-	*	then fout_level_path saves like ./some image/level_0 ./some image/level_1	 etc
-	*	fout_file_level_number saves the current number of each level
-	*	the entire file name is like:
-	*	./some image/level_0/fout_file_level_number;
-	*/
-
-	using boost::lexical_cast;
-	using namespace std;
-	namespace bf = boost::filesystem;
+	typedef PixelAccumulator<T> Accumulator;
+	typedef typename Accumulator::AccumType AccumType;
+	typedef IndexMethodInterface::IndexType IndexType;
 
-	static const ContainerType &c_img_container = img_container;
-
-	std::vector<ofstream> fout_array(merge_number);
-	std::vector<bool> fout_complete(merge_number, true);
-	std::vector<size_t> fout_file_level_number(merge_number, 0);
-	std::vector<bf::path> fout_level_path(merge_number);
-	std::vector<size_t> mask(merge_number, 0);
-
-	/* saving different image data before compress */
-	std::vector<std::vector<T> > file_temp_data(merge_number);
-	/* saving different image data index position in the loop */
-	std::vector<int64> file_temp_data_index(merge_number);
-	for(size_t i = 0; i < merge_number; ++i) {
-		file_temp_data[i].resize(file_node_size);
-		file_temp_data_index[i] = -1;
+	const size_t level_number = get_max_image_level() + 1;
+	const IndexType total_size = img_container.size();
+
+	for(size_t k = 0; k < level_number; ++k) {
+		if(!storage.create_level(k)) return false;
 	}
 
-	/* initialization */
-	for(size_t k = 0; k < merge_number; ++k) {
-		fout_level_path[k] = data_path / (string("level_") + lexical_cast<std::string>(k+start_level));
+	/* the full file buffers are written by the writer threads, and each level gets a recycled buffer back,
+	 * so the writing of the last file overlaps the scanning of the next one */
+	AsyncFileWriter<T> writer(storage, concurrent_number, 2*concurrent_number);
 
-		/* mask is 4^n - 1, start_level is the level delta from last loop */
-		mask[k] = (1 << (2*(k + start_level))) - 1;
+	/* the file buffer of each level, the level 0 buffer is filled from the container directly */
+	std::vector<std::vector<T> > level_data(level_number);
+	std::vector<size_t> level_data_count(level_number, 0);
+	std::vector<size_t> level_file_no(level_number, 0);
+	for(size_t k = 0; k < level_number; ++k) {
+		level_data[k].resize(std::min<IndexType>(file_node_size, (total_size >> (2*k)) + 1));
 	}
 
-	/* Before writing, first create the needed directories */
-	for(size_t k = 0; k < merge_number; ++k) {
-		if(!bf::create_directory(fout_level_path[k])) {
-			cerr << "create directory " << fout_level_path[k].generic_string() << " failure" << endl;
-			return false;
-		}
-	}
+	/* the carry of each level : the sum of the valid cells, the number of the valid cells and the children */
+	std::vector<AccumType> carry_sum(level_number);
+	std::vector<int64> carry_weight(level_number, 0);
+	std::vector<int> carry_children(level_number, 0);
+	for(size_t k = 0; k < level_number; ++k) Accumulator::clear(carry_sum[k]);
+
+	/* the valid cells of the image, sorted by index */
+	std::vector<IndexMethodInterface::IndexRange> valid_ranges;
+	if(level_number > 1) index_method->get_index_ranges(0, 0, img_size.rows, img_size.cols, valid_ranges);
+	size_t range_no = 0;
+
+	for(IndexType front = 0; front < total_size; front += file_node_size) {
+		const size_t count = (size_t)std::min<IndexType>(file_node_size, total_size - front);
+		read_container_range(front, count, &level_data[0][0]);
+		const T *cells = &level_data[0][0];
+
+		for(size_t i = 0; level_number > 1 && i < count; ++i) {
+			const IndexType index = front + i;
+			while(range_no < valid_ranges.size() && valid_ranges[range_no].tail <= index) ++range_no;
+			const bool valid = range_no < valid_ranges.size() && valid_ranges[range_no].front <= index;
+
+			/* add the cell into the level 1 carry */
+			if(valid) {
+				Accumulator::add(carry_sum[1], cells[i]);
+				++carry_weight[1];
+			}
 
-	/* writing the first (file_number - 1) data files */
-	int64 file_loop = 0, start_index = 0;
-	for(; file_loop < (file_number - 1); ++file_loop) {
-		/* check ofstream status to decide to whether to open a new file for writing */
-		for(size_t k = 0; k < merge_number; ++k) {
-			if(fout_complete[k]) {
-				string level_file_name =
-					(fout_level_path[k] / lexical_cast<string>(fout_file_level_number[k])).generic_string();
-
-				/* open file for writing */
-				fout_array[k].open(level_file_name, ios::out | ios::binary);
-				if(!fout_array[k].is_open()) {
-					cerr << "open file " << level_file_name << " failure" << endl;
-					return false;
+			/* when the carry of level k has 4 children, pass it to the level k+1 */
+			for(size_t k = 1; k < level_number && ++carry_children[k] == 4; ++k) {
+				std::vector<T> &data = level_data[k];
+				data[level_data_count[k]++] = Accumulator::average(carry_sum[k], carry_weight[k]);
+				if(level_data_count[k] == data.size()) {
+					if(!writer.write(k, level_file_no[k]++, data, level_data_count[k]))
+						return false;
+					level_data_count[k] = 0;
 				}
 
-				/* tells the ofstream is in using, thus not complete for creating a new file */
-				fout_complete[k] = false;
-			}
-		}
-
-		/* write one file data */
-		start_index = file_loop << file_node_shift_num;
-		T temp_data;
-		for(int64 i = start_index; i < start_index + file_node_size; ++i) {
-			temp_data = c_img_container[i];
-			for(size_t k = 0; k < merge_number; ++k) {
-				/* if index i is the multiply of 2^k, then write the data into the fout_array[k] */
-				if((i & mask[k]) == 0)
-					file_temp_data[k][++file_temp_data_index[k]] = temp_data;
+				if(k + 1 < level_number) {
+					Accumulator::merge(carry_sum[k+1], carry_sum[k]);
+					carry_weight[k+1] += carry_weight[k];
+				}
+				Accumulator::clear(carry_sum[k]);
+				carry_weight[k] = 0;
+				carry_children[k] = 0;
 			}
 		}
 
-		/* check ofstream status again to decide whether to close a file for writing */
-		for(size_t k = 0; k < merge_number; ++k) {
-			/* attention : using file_loop+1, because the file is counted from 1 
-			 * if just using file_loop, when file_loop is 0, all the ofstream 
-			 * will be closed that's certainly not correct 
-			 */
-
-			if(((file_loop+1) & mask[k]) == 0) {
-				BOOST_ASSERT(file_temp_data[k].size() == file_node_size);
-
-				fout_array[k].write(reinterpret_cast<const char*>(file_temp_data[k].data()), file_node_size*sizeof(T));
-				fout_array[k].close();
+		if(!writer.write(0, level_file_no[0]++, level_data[0], count)) return false;
+	}
 
-				/* prepare for next file writing */
-				file_temp_data_index[k] = -1;
-				fout_file_level_number[k]++;
-				fout_complete[k] = true;
+	/* the partial carries at the end of the container are also the cells of the levels */
+	for(size_t k = 1; k < level_number; ++k) {
+		if(carry_children[k] > 0) {
+			level_data[k][level_data_count[k]++] = Accumulator::average(carry_sum[k], carry_weight[k]);
+			if(k + 1 < level_number) {
+				Accumulator::merge(carry_sum[k+1], carry_sum[k]);
+				carry_weight[k+1] += carry_weight[k];
+				++carry_children[k+1];
 			}
 		}
-	} // end loop for writing of first (file_number - 1) files
-
-	/* now just has left one file for writing */
-
-	/* still first checks whether to open a new file for each ofstream */
-	for(size_t k = 0; k < merge_number; ++k) {
-		if(fout_complete[k]) {
-			string level_file_name = 
-				(fout_level_path[k] / lexical_cast<string>(fout_file_level_number[k])).generic_string();
 
-			fout_array[k].open(level_file_name, ios::out | ios::binary);
-			if(!fout_array[k].is_open()) {
-				cerr << "open file " << level_file_name << " failure" << endl;
+		if(level_data_count[k] > 0) {
+			if(!writer.write(k, level_file_no[k]++, level_data[k], level_data_count[k]))
 				return false;
-			}
-		}
-	}
-
-	/* write the file data */
-	start_index = file_loop << file_node_shift_num;
-	T temp_data;
-	for(int64 last_index = start_index; last_index < c_img_container.size(); ++last_index) {
-		temp_data = c_img_container[last_index];
-		for(size_t k = 0; k < merge_number; ++k) {
-			/* if index last_index is the multiply of 2^k, then write the data into the fout_array[k] */
-			if((last_index & mask[k]) == 0)
-				file_temp_data[k][++file_temp_data_index[k]] = temp_data;
 		}
 	}
 
-	/* write back all the last file image data */
-	for(size_t k = 0; k < merge_number; ++k) {
-		fout_array[k].write(reinterpret_cast<const char*>(file_temp_data[k].data()), 
-			(file_temp_data_index[k]+1)*sizeof(T));
-
-        /* now just close all the files */
-		fout_array[k].close();
-	}
-
-	return true;
+	return writer.wait();
 }
 
-template<typename T, size_t memory_usage>
-bool HierarchicalImage<T, memory_usage>::write_image(const std::string &file_name)
+template<typename T, size_t memory_usage, typename IndexMethod>
+bool HierarchicalImage<T, memory_usage, IndexMethod>::write_image(const std::string &file_name)
 {
 	return write_image(file_name.c_str());
 }
 
 #include "DiskBigImage.hpp"
-template<typename T, size_t memory_usage>
-bool HierarchicalImage<T, memory_usage>::save_mini_image(const char* file_name)
+template<typename T, size_t memory_usage, typename IndexMethod>
+bool HierarchicalImage<T, memory_usage, IndexMethod>::save_mini_image(const char* file_name)
 {
 
 #ifdef SAVE_MINI_IMAGE
@@ -0,0 +1,282 @@
+#ifndef _IMAGE_CACHE_MANAGER_HPP
+#define _IMAGE_CACHE_MANAGER_HPP
+
+#include "BasicType.h"
+
+#include <map>
+#include <vector>
+#include <algorithm>
+
+#include <boost/assert.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/noncopyable.hpp>
+
+/**
+ * @class ImageCacheClient ImageCacheManager.hpp
+ *
+ * @brief The cache which keeps its memory under the byte budget of ImageCacheManager.
+ */
+
+class ImageCacheClient
+{
+public:
+	virtual ~ImageCacheClient() {}
+
+	/**
+	 *	@brief write back and free the least recently used cache, called by ImageCacheManager when another
+	 *	cache needs the memory. It must not block : if the cache is being used, just return 0
+	 *	@return the bytes freed
+	 */
+	virtual size_t try_evict() = 0;
+};
+
+/**
+ * @class ImageCacheManager ImageCacheManager.hpp
+ *
+ * @brief The process-wide byte budget of the image file caches, all the ImageFileLRU (thus all the
+ * DiskBigImage of all the levels) register with it.
+ *
+ * The caches are registered in the groups, all the cache shards of one DiskBigImage are one group, so the
+ * memory is shared fairly by the images whatever their shard numbers are.
+ *
+ * Before a cache allocates a new file node, it acquires the bytes from the manager. If the budget is full,
+ * the manager evicts from the group which exceeds its fair share (the budget divided by the groups) the
+ * most, the largest cache of the group is evicted. When the group of the requesting cache is the one, the
+ * cache is asked to reuse its own least recently used node, so a busy image can't drive the others out of
+ * memory.
+ *
+ * The victim writes back and frees its node with the manager unlocked, so the other caches acquiring the
+ * memory don't wait for the writing. The bytes of the requester are reserved before the eviction, and the
+ * victim is kept registered until its eviction is settled.
+ *
+ * The budget is 0 (unlimited) by default, then only the file cache number of each image limits the memory.
+ * @see ImageFileLRU DiskBigImage
+ */
+
+class ImageCacheManager : private boost::noncopyable
+{
+public:
+	/**
+	 *	@brief the manager of the process, it is never destroyed, so the static images can unregister
+	 *	at the exit
+	 */
+	static ImageCacheManager& instance()
+	{
+		static ImageCacheManager *manager = new ImageCacheManager;
+		return *manager;
+	}
+
+	/**
+	 *	@brief set the byte budget of all the caches, 0 means unlimited. The caches exceeding the new
+	 *	budget are evicted, except those being used now
+	 */
+	void set_byte_budget(uint64 bytes)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		m_budget = bytes;
+		make_room(lock, NULL);
+	}
+
+	uint64 get_byte_budget() const
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		return m_budget;
+	}
+
+	/**
+	 *	@brief the bytes used by all the caches
+	 */
+	uint64 get_used_bytes() const
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		return m_used;
+	}
+
+	/**
+	 *	@brief the bytes used by the cache
+	 */
+	uint64 get_client_bytes(const ImageCacheClient *client) const
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		ClientMap::const_iterator ite = m_clients.find(const_cast<ImageCacheClient*>(client));
+		return ite == m_clients.end() ? 0 : ite->second.bytes;
+	}
+
+	/**
+	 *	@brief the bytes used by the caches of the group
+	 */
+	uint64 get_group_bytes(const void *group) const
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		GroupMap::const_iterator ite = m_groups.find(group);
+		return ite == m_groups.end() ? 0 : ite->second.bytes;
+	}
+
+	/**
+	 *	@param group the key of the group sharing one fair share, NULL for the group of the cache itself
+	 */
+	void register_client(ImageCacheClient *client, const void *group = NULL)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		if(group == NULL) group = client;
+
+		GroupMap::iterator group_ite = m_groups.insert(std::make_pair(group, GroupInfo())).first;
+		++group_ite->second.clients;
+		m_clients.insert(std::make_pair(client, ClientInfo(group_ite)));
+	}
+
+	/**
+	 *	@brief remove the cache and its bytes, the cache is never evicted by the manager after it returns. It
+	 *	waits for the eviction of the cache by another thread, so the cache must not be locked by the caller
+	 */
+	void unregister_client(ImageCacheClient *client)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		ClientMap::iterator ite = m_clients.find(client);
+		if(ite == m_clients.end()) return;
+
+		ite->second.removed = true;
+		while(ite->second.evictions > 0) m_evicted.wait(lock);
+
+		charge(ite, -int64(ite->second.bytes));
+		GroupMap::iterator group_ite = ite->second.group;
+		if(--group_ite->second.clients == 0) m_groups.erase(group_ite);
+		m_clients.erase(ite);
+	}
+
+	/**
+	 *	@brief acquire the bytes for a new node of the cache, the other caches may be evicted
+	 *	@param can_reuse whether the cache can reuse its own node instead, if not, the bytes are always granted
+	 *	(maybe over the budget)
+	 *	@return whether the bytes are granted, if not, the cache should reuse its least recently used node
+	 */
+	bool acquire(ImageCacheClient *client, size_t bytes, bool can_reuse)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		ClientMap::iterator ite = m_clients.find(client);
+		BOOST_ASSERT(ite != m_clients.end());
+
+		/* the bytes are reserved first, so the other caches evict for their own bytes meanwhile */
+		charge(ite, int64(bytes));
+		if(!can_reuse || make_room(lock, client)) return true;
+
+		charge(ite, -int64(bytes));
+		return false;
+	}
+
+	/**
+	 *	@brief give back the bytes freed by the cache itself
+	 */
+	void release(ImageCacheClient *client, size_t bytes)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		ClientMap::iterator ite = m_clients.find(client);
+		if(ite == m_clients.end()) return;
+
+		bytes = (size_t)std::min<uint64>(bytes, ite->second.bytes);
+		charge(ite, -int64(bytes));
+	}
+
+private:
+	struct GroupInfo
+	{
+		GroupInfo() : bytes(0), clients(0) {}
+
+		/** the bytes used by the caches of the group */
+		uint64 bytes;
+		/** the number of the caches of the group */
+		size_t clients;
+	};
+	typedef std::map<const void*, GroupInfo> GroupMap;
+
+	struct ClientInfo
+	{
+		explicit ClientInfo(GroupMap::iterator _group) : group(_group), bytes(0), evictions(0), removed(false) {}
+
+		/** the group of the cache */
+		GroupMap::iterator group;
+		/** the bytes used by the cache */
+		uint64 bytes;
+		/** the evictions of the cache running with the manager unlocked */
+		int evictions;
+		/** whether the cache is being unregistered, it is not evicted any more */
+		bool removed;
+	};
+	typedef std::map<ImageCacheClient*, ClientInfo> ClientMap;
+
+	ImageCacheManager() : m_budget(0), m_used(0) {}
+
+	/**
+	 *	@brief add the bytes to the cache, its group and the whole, must be called with m_mutex locked
+	 */
+	void charge(ClientMap::iterator ite, int64 bytes)
+	{
+		ite->second.bytes += bytes;
+		ite->second.group->second.bytes += bytes;
+		m_used += bytes;
+	}
+
+	/**
+	 *	@brief evict the caches until the used bytes fit in the budget, must be called with m_mutex locked.
+	 *	The lock is released while the victim writes back and frees its node, the victim is kept registered
+	 *	by its eviction count meanwhile
+	 *	@return false if the requester should reuse its own node or no cache can be evicted
+	 */
+	bool make_room(boost::mutex::scoped_lock &lock, ImageCacheClient *requester)
+	{
+		std::vector<ImageCacheClient*> busy;
+		while(m_budget != 0 && m_used > m_budget) {
+			/* the victim is the largest cache of the group exceeding its fair share the most */
+			int64 fair_share = int64(m_budget / std::max<size_t>(m_groups.size(), 1));
+			ClientMap::iterator victim = m_clients.end();
+			int64 max_excess = 0;
+			for(ClientMap::iterator ite = m_clients.begin(); ite != m_clients.end(); ++ite) {
+				const ClientInfo &info = ite->second;
+				if(info.bytes == 0 || info.removed || info.evictions > 0 || 
+					std::find(busy.begin(), busy.end(), ite->first) != busy.end()) continue;
+
+				int64 excess = int64(info.group->second.bytes) - fair_share;
+				if(victim == m_clients.end() || excess > max_excess || 
+					(victim->second.group == info.group && info.bytes > victim->second.bytes)) {
+					victim = ite;
+					max_excess = excess;
+				}
+			}
+			if(victim == m_clients.end()) return false;
+			if(requester != NULL && victim->second.group == m_clients.find(requester)->second.group) return false;
+
+			++victim->second.evictions;
+			lock.unlock();
+			size_t freed = victim->first->try_evict();
+			lock.lock();
+
+			ClientInfo &info = victim->second;
+			freed = (size_t)std::min<uint64>(freed, info.bytes);
+			charge(victim, -int64(freed));
+			if(--info.evictions == 0 && info.removed) m_evicted.notify_all();
+			if(freed == 0) busy.push_back(victim->first);
+		}
+		return true;
+	}
+
+private:
+	mutable boost::mutex m_mutex;
+
+	/** notified when an eviction of a cache being unregistered is settled */
+	boost::condition_variable m_evicted;
+
+	/** the byte budget, 0 means unlimited */
+	uint64 m_budget;
+
+	/** the bytes used by all the caches */
+	uint64 m_used;
+
+	/** the caches and their bytes */
+	ClientMap m_clients;
+
+	/** the groups of the caches, a group is removed with its last cache */
+	GroupMap m_groups;
+};
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef _IMAGE_FLUSHER_HPP
+#define _IMAGE_FLUSHER_HPP
+
+#include "BasicType.h"
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include <boost/noncopyable.hpp>
+
+/**
+ * @class ImageFlusher ImageFlusher.hpp
+ *
+ * @brief Write back the changed image data periodically in a background thread, so the changes are saved
+ * before the files are evicted or the image is destroyed.
+ * @see DiskBigImage
+ */
+
+class ImageFlusher : private boost::noncopyable
+{
+public:
+	/** write back the changed data */
+	typedef boost::function<void ()> Flusher;
+
+	/**
+	 * @param flusher the function writing back the data, called by the background thread
+	 * @param interval the milliseconds between two flushes, at least 1
+	 */
+	ImageFlusher(const Flusher &flusher, size_t interval)
+		: m_flusher(flusher), m_interval(interval < 1 ? 1 : interval), m_stopping(false)
+	{
+		m_thread = boost::thread(boost::bind(&ImageFlusher::flusher_loop, this));
+	}
+
+	/**
+	 * @brief stop the thread, the flush being run is finished first
+	 */
+	~ImageFlusher()
+	{
+		{
+			boost::lock_guard<boost::mutex> lock(m_mutex);
+			m_stopping = true;
+		}
+		m_stop.notify_all();
+		m_thread.join();
+	}
+
+private:
+	void flusher_loop()
+	{
+		for(;;) {
+			{
+				boost::unique_lock<boost::mutex> lock(m_mutex);
+				boost::system_time deadline = boost::get_system_time() + boost::posix_time::milliseconds(m_interval);
+				while(!m_stopping && m_stop.timed_wait(lock, deadline)) {}
+				if(m_stopping) return;
+			}
+
+			m_flusher();
+		}
+	}
+
+private:
+	Flusher m_flusher;
+	size_t m_interval;
+
+	boost::thread m_thread;
+	boost::mutex m_mutex;
+
+	/** signaled when the flusher is stopping */
+	boost::condition_variable m_stop;
+	bool m_stopping;
+};
+
+#endif
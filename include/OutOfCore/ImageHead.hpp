@@ -0,0 +1,388 @@
+#ifndef _IMAGE_HEAD_HPP
+#define _IMAGE_HEAD_HPP
+
+#include "BasicType.h"
+#include "ImageStorage.hpp"
+#include "NodeCodec.hpp"
+#include "IndexMethodInterface.h"
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+#include <boost/lexical_cast.hpp>
+#include <boost/filesystem.hpp>
+
+/**
+ * @brief the name of the image cell type saved in the image head, empty means unknown type
+ */
+template<typename T> struct CellTypeName { static const char* name() { return ""; } };
+template<> struct CellTypeName<uchar> { static const char* name() { return "uchar"; } };
+template<> struct CellTypeName<ushort> { static const char* name() { return "ushort"; } };
+template<> struct CellTypeName<uint> { static const char* name() { return "uint"; } };
+template<> struct CellTypeName<float> { static const char* name() { return "float"; } };
+template<> struct CellTypeName<double> { static const char* name() { return "double"; } };
+template<> struct CellTypeName<Vec3b> { static const char* name() { return "Vec3b"; } };
+template<> struct CellTypeName<Vec3s> { static const char* name() { return "Vec3s"; } };
+template<> struct CellTypeName<Vec3i> { static const char* name() { return "Vec3i"; } };
+
+/**
+ * @class BigImageHead ImageHead.hpp
+ *
+ * @brief The head of the .bigimage file, which is written by BlockwiseImage or HierarchicalImage,
+ * and loaded by DiskBigImage.
+ *
+ * The head is saved in the versioned binary format, all the fields are little-endian and have the fixed offset,
+ * so the head can be loaded by one small read (or mapped directly) :
+ *
+ *	offset	size	field
+ *	0		8		magic "BIGIMAGE"
+ *	8		4		version
+ *	12		4		head size in bytes, including the level table
+ *	16		8		rows
+ *	24		8		cols
+ *	32		8		file node size (cells)
+ *	40		8		file node shift number
+ *	48		8		mini rows
+ *	56		8		mini cols
+ *	64		4		max level
+ *	68		4		cell size in bytes
+ *	72		16		cell type name
+ *	88		4		storage format
+ *	92		4		compression codec
+ *	96		8		packed directory offset
+ *	104		32		index method name
+ *	136		64		index method parameters
+ *	200		32*n	level table : (rows, cols, cell number, node number) of each level
+ *
+ * The former text format (key=value lines) of the directory storage image is still readable.
+ */
+
+class BigImageHead
+{
+public:
+	enum
+	{
+		HEAD_VERSION = 1,
+		FIXED_HEAD_SIZE = 200,
+		LEVEL_INFO_SIZE = 32,
+		CELL_TYPE_SIZE = 16,
+		INDEX_NAME_SIZE = 32,
+		INDEX_PARA_SIZE = 64,
+		DIRECTORY_OFFSET_POS = 96
+	};
+
+	/** the geometry of one level */
+	struct LevelInfo
+	{
+		LevelInfo() : rows(0), cols(0), cell_number(0), node_number(0) {}
+
+		uint64 rows;
+		uint64 cols;
+		/** the number of the cells saved in the level, including the padding of the index method */
+		uint64 cell_number;
+		/** the number of the data nodes (files) of the level */
+		uint64 node_number;
+	};
+
+	BigImageHead()
+		: version(HEAD_VERSION), file_node_size(0), file_node_shift_num(0), mini_rows(0), mini_cols(0), max_level(0),
+		cell_size(0), storage_format(ImageStorage::DIRECTORY_STORAGE), compression_codec(NodeCodec::NO_CODEC), packed_directory_offset(0)
+	{
+	}
+
+	/**
+	 *	@brief compute the level table from the image size and the number of the full size level cells
+	 */
+	void set_levels(uint64 cell_number)
+	{
+		levels.resize(max_level + 1);
+		for(size_t k = 0; k <= max_level; ++k) {
+			levels[k].rows = (img_size.rows + (uint64(1) << k) - 1) >> k;
+			levels[k].cols = (img_size.cols + (uint64(1) << k) - 1) >> k;
+			levels[k].cell_number = (cell_number + (uint64(1) << (2*k)) - 1) >> (2*k);
+			levels[k].node_number = (levels[k].cell_number + file_node_size - 1) / file_node_size;
+		}
+	}
+
+	/**
+	 *	@brief save the head in the binary format
+	 */
+	bool save(const char *file_name) const
+	{
+		using namespace std;
+
+		std::vector<char> buffer(FIXED_HEAD_SIZE + LEVEL_INFO_SIZE*levels.size(), 0);
+		memcpy(&buffer[0], "BIGIMAGE", 8);
+		put_value<uint>(buffer, 8, HEAD_VERSION);
+		put_value<uint>(buffer, 12, (uint)buffer.size());
+		put_value<uint64>(buffer, 16, img_size.rows);
+		put_value<uint64>(buffer, 24, img_size.cols);
+		put_value<uint64>(buffer, 32, file_node_size);
+		put_value<uint64>(buffer, 40, file_node_shift_num);
+		put_value<uint64>(buffer, 48, mini_rows);
+		put_value<uint64>(buffer, 56, mini_cols);
+		put_value<uint>(buffer, 64, (uint)max_level);
+		put_value<uint>(buffer, 68, (uint)cell_size);
+		if(!put_string(buffer, 72, CELL_TYPE_SIZE, cell_type)) return false;
+		put_value<uint>(buffer, 88, (uint)storage_format);
+		put_value<uint>(buffer, 92, (uint)compression_codec);
+		put_value<int64>(buffer, DIRECTORY_OFFSET_POS, packed_directory_offset);
+		if(!put_string(buffer, 104, INDEX_NAME_SIZE, index_method_name)) return false;
+		if(!put_string(buffer, 136, INDEX_PARA_SIZE, index_method_para)) return false;
+
+		for(size_t k = 0; k < levels.size(); ++k) {
+			size_t pos = FIXED_HEAD_SIZE + k*LEVEL_INFO_SIZE;
+			put_value<uint64>(buffer, pos, levels[k].rows);
+			put_value<uint64>(buffer, pos + 8, levels[k].cols);
+			put_value<uint64>(buffer, pos + 16, levels[k].cell_number);
+			put_value<uint64>(buffer, pos + 24, levels[k].node_number);
+		}
+
+		ofstream fout(file_name, ios::out | ios::binary | ios::trunc);
+		if(!fout.is_open()) {
+			cerr << "create " << file_name << " failure" << endl;
+			return false;
+		}
+		fout.write(&buffer[0], buffer.size());
+		if(!fout) {
+			cerr << "write " << file_name << " failure" << endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	/**
+	 *	@brief load the head in the binary format or the text format.
+	 *	@note the level table of the text format is empty, call set_levels() after the index method is created
+	 */
+	bool load(const char *file_name)
+	{
+		using namespace std;
+
+		ifstream fin(file_name, ios::in | ios::binary);
+		if(!fin.is_open()) {
+			cerr << file_name << " can't be opened for reading" << endl;
+			return false;
+		}
+
+		/* one read is enough for the head with a few levels */
+		std::vector<char> buffer(4096);
+		fin.read(&buffer[0], buffer.size());
+		buffer.resize((size_t)fin.gcount());
+
+		if(buffer.size() >= 8 && memcmp(&buffer[0], "BIGIMAGE", 8) == 0) {
+			if(buffer.size() < FIXED_HEAD_SIZE) {
+				cerr << "image format is not correct : the head is truncated" << endl;
+				return false;
+			}
+
+			uint head_size = get_value<uint>(buffer, 12);
+			if(head_size > buffer.size()) {
+				fin.clear();
+				fin.seekg(0);
+				buffer.resize(head_size);
+				if(!fin.read(&buffer[0], head_size)) {
+					cerr << "image format is not correct : the head is truncated" << endl;
+					return false;
+				}
+			}
+			return load_binary(buffer);
+		}
+
+		fin.close();
+		return load_text(file_name);
+	}
+
+protected:
+	bool load_binary(const std::vector<char> &buffer)
+	{
+		using namespace std;
+
+		version = get_value<uint>(buffer, 8);
+		if(version < 1 || version > HEAD_VERSION) {
+			cerr << "image format is not correct : unsupported version " << version << endl;
+			return false;
+		}
+
+		img_size.rows = (size_t)get_value<uint64>(buffer, 16);
+		img_size.cols = (size_t)get_value<uint64>(buffer, 24);
+		file_node_size = get_value<uint64>(buffer, 32);
+		file_node_shift_num = get_value<uint64>(buffer, 40);
+		mini_rows = (size_t)get_value<uint64>(buffer, 48);
+		mini_cols = (size_t)get_value<uint64>(buffer, 56);
+		max_level = get_value<uint>(buffer, 64);
+		cell_size = get_value<uint>(buffer, 68);
+		cell_type = get_string(buffer, 72, CELL_TYPE_SIZE);
+		storage_format = (ImageStorage::StorageFormat)get_value<uint>(buffer, 88);
+		compression_codec = (NodeCodec::CodecType)get_value<uint>(buffer, 92);
+		packed_directory_offset = get_value<int64>(buffer, DIRECTORY_OFFSET_POS);
+		index_method_name = get_string(buffer, 104, INDEX_NAME_SIZE);
+		index_method_para = get_string(buffer, 136, INDEX_PARA_SIZE);
+
+		if(file_node_size <= 0 || buffer.size() < FIXED_HEAD_SIZE + LEVEL_INFO_SIZE*(max_level + 1)) {
+			cerr << "image format is not correct" << endl;
+			return false;
+		}
+
+		levels.resize(max_level + 1);
+		for(size_t k = 0; k <= max_level; ++k) {
+			size_t pos = FIXED_HEAD_SIZE + k*LEVEL_INFO_SIZE;
+			levels[k].rows = get_value<uint64>(buffer, pos);
+			levels[k].cols = get_value<uint64>(buffer, pos + 8);
+			levels[k].cell_number = get_value<uint64>(buffer, pos + 16);
+			levels[k].node_number = get_value<uint64>(buffer, pos + 24);
+		}
+
+		return true;
+	}
+
+	/**
+	 *	@brief load the former text head : the fixed order key=value lines, followed by the optional
+	 *	maxlevel line. The text head image is always saved in the directory storage
+	 */
+	bool load_text(const char *file_name)
+	{
+		using namespace std;
+
+		ifstream fin(file_name, ios::in);
+		if(!fin.is_open()) {
+			cerr << file_name << " can't be opened for reading" << endl;
+			return false;
+		}
+
+		string str;
+		getline(fin, str);
+
+		/* check image head type */
+		if(str != "type=BlockwiseImage") {
+			cerr << "image format is not correct" << endl;
+			return false;
+		}
+
+		version = 0;
+		try {
+			if(!get_text_value(fin, "rows", str)) return false;
+			img_size.rows = boost::lexical_cast<size_t>(str);
+			if(!get_text_value(fin, "cols", str)) return false;
+			img_size.cols = boost::lexical_cast<size_t>(str);
+			if(!get_text_value(fin, "filenodesize", str)) return false;
+			file_node_size = boost::lexical_cast<int64>(str);
+			if(!get_text_value(fin, "filenodeshiftnum", str)) return false;
+			file_node_shift_num = boost::lexical_cast<int64>(str);
+
+			/* the index method is saved as "name" or "name:para" */
+			if(!get_text_value(fin, "indexmethod", str)) return false;
+			string::size_type para_index = str.find(':');
+			index_method_name = str.substr(0, para_index);
+			index_method_para = (para_index == string::npos) ? string() : str.substr(para_index+1);
+
+			if(!get_text_value(fin, "minirows", str)) return false;
+			mini_rows = boost::lexical_cast<size_t>(str);
+			if(!get_text_value(fin, "minicols", str)) return false;
+			mini_cols = boost::lexical_cast<size_t>(str);
+
+			/* the optional part : the hierarchical max level */
+			max_level = 0;
+			storage_format = ImageStorage::DIRECTORY_STORAGE;
+			compression_codec = NodeCodec::NO_CODEC;
+			packed_directory_offset = 0;
+			while(getline(fin, str)) {
+				if(str.empty()) continue;
+
+				string::size_type index = str.find('=');
+				if(index != string::npos && str.substr(0, index) == "storage") {
+					cerr << "image format is not correct : the text head only supports the directory storage" << endl;
+					return false;
+				}
+				if(index == string::npos || str.substr(0, index) != "maxlevel") {
+					cerr << "image format is not correct" << endl;
+					return false;
+				}
+				max_level = boost::lexical_cast<size_t>(str.substr(index+1));
+			}
+		} catch(boost::bad_lexical_cast &err) {
+			cerr << err.what() << endl;
+			return false;
+		}
+
+		/* the text head doesn't save the cell type and the levels */
+		cell_size = 0;
+		cell_type.clear();
+		levels.clear();
+		return true;
+	}
+
+	static bool get_text_value(std::istream &fin, const char *key, std::string &value)
+	{
+		std::string str;
+		getline(fin, str);
+		std::string::size_type index = str.find('=');
+		if(index == std::string::npos || str.substr(0, index) != key) {
+			std::cerr << "image format is not correct" << std::endl;
+			return false;
+		}
+		value = str.substr(index+1);
+		return true;
+	}
+
+	template<typename U>
+	static void put_value(std::vector<char> &buffer, size_t pos, U value)
+	{
+		memcpy(&buffer[pos], &value, sizeof(U));
+	}
+
+	template<typename U>
+	static U get_value(const std::vector<char> &buffer, size_t pos)
+	{
+		U value;
+		memcpy(&value, &buffer[pos], sizeof(U));
+		return value;
+	}
+
+	static bool put_string(std::vector<char> &buffer, size_t pos, size_t size, const std::string &str)
+	{
+		if(str.size() >= size) {
+			std::cerr << "the image head field " << str << " is too long" << std::endl;
+			return false;
+		}
+		memcpy(&buffer[pos], str.c_str(), str.size());
+		return true;
+	}
+
+	static std::string get_string(const std::vector<char> &buffer, size_t pos, size_t size)
+	{
+		const char *begin = &buffer[pos];
+		return std::string(begin, std::find(begin, begin + size, '\0'));
+	}
+
+public:
+	/** the head version, 0 means the text head */
+	uint version;
+
+	Size img_size;
+	int64 file_node_size;
+	int64 file_node_shift_num;
+	size_t mini_rows, mini_cols;
+	size_t max_level;
+
+	/** the size and the name of the cell type, 0 or empty means unknown */
+	size_t cell_size;
+	std::string cell_type;
+
+	std::string index_method_name;
+	std::string index_method_para;
+
+	ImageStorage::StorageFormat storage_format;
+	NodeCodec::CodecType compression_codec;
+	int64 packed_directory_offset;
+
+	/** the geometry of each level */
+	std::vector<LevelInfo> levels;
+};
+
+#endif
@@ -0,0 +1,592 @@
+#ifndef _IMAGE_IO_ENGINE_HPP
+#define _IMAGE_IO_ENGINE_HPP
+
+#include "BasicType.h"
+
+#include <vector>
+#include <deque>
+#include <cstring>
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/noncopyable.hpp>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
+/**
+ * The io_uring engine is only built on linux, and used if the kernel allows creating the ring at runtime.
+ * Define IMAGE_IO_NO_URING to build without it (the kernel headers are too old).
+ */
+#if defined(__linux__) && !defined(IMAGE_IO_NO_URING)
+#define IMAGE_IO_HAS_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <cerrno>
+#endif
+
+/**
+ * @class PositionalFile ImageIOEngine.hpp
+ *
+ * @brief The file accessed by the explicit offset (pread/pwrite), so one opened descriptor can be shared
+ * by multiply threads without seeking.
+ */
+
+class PositionalFile : private boost::noncopyable
+{
+public:
+#ifdef _WIN32
+	PositionalFile() : m_handle(INVALID_HANDLE_VALUE) {}
+#else
+	PositionalFile() : m_fd(-1) {}
+#endif
+
+	~PositionalFile() { close(); }
+
+	/**
+	 *	@brief open the existing file
+	 *	@param writable whether open for writing too
+	 */
+	bool open(const std::string &file_name, bool writable)
+	{
+		close();
+#ifdef _WIN32
+		m_handle = CreateFileA(file_name.c_str(), GENERIC_READ | (writable ? GENERIC_WRITE : 0),
+			FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		return m_handle != INVALID_HANDLE_VALUE;
+#else
+		m_fd = ::open(file_name.c_str(), writable ? O_RDWR : O_RDONLY);
+		return m_fd >= 0;
+#endif
+	}
+
+	bool is_open() const
+	{
+#ifdef _WIN32
+		return m_handle != INVALID_HANDLE_VALUE;
+#else
+		return m_fd >= 0;
+#endif
+	}
+
+	void close()
+	{
+#ifdef _WIN32
+		if(m_handle != INVALID_HANDLE_VALUE) CloseHandle(m_handle);
+		m_handle = INVALID_HANDLE_VALUE;
+#else
+		if(m_fd >= 0) ::close(m_fd);
+		m_fd = -1;
+#endif
+	}
+
+	/**
+	 *	@brief read at most bytes from the offset
+	 *	@return the bytes read, -1 if fails
+	 */
+	int64 pread(void *data, size_t bytes, int64 offset) const
+	{
+		char *dst = reinterpret_cast<char*>(data);
+		size_t done = 0;
+		while(done < bytes) {
+#ifdef _WIN32
+			OVERLAPPED overlapped;
+			memset(&overlapped, 0, sizeof(overlapped));
+			overlapped.Offset = DWORD(offset + done);
+			overlapped.OffsetHigh = DWORD((offset + done) >> 32);
+			DWORD count = 0;
+			DWORD request = DWORD(std::min<size_t>(bytes - done, 1 << 30));
+			if(!ReadFile(m_handle, dst + done, request, &count, &overlapped)) {
+				if(GetLastError() == ERROR_HANDLE_EOF) break;
+				return -1;
+			}
+#else
+			ssize_t count = ::pread(m_fd, dst + done, bytes - done, off_t(offset + done));
+			if(count < 0) return -1;
+#endif
+			if(count == 0) break;
+			done += count;
+		}
+		return done;
+	}
+
+	/**
+	 *	@brief write the bytes at the offset
+	 */
+	bool pwrite(const void *data, size_t bytes, int64 offset)
+	{
+		const char *src = reinterpret_cast<const char*>(data);
+		size_t done = 0;
+		while(done < bytes) {
+#ifdef _WIN32
+			OVERLAPPED overlapped;
+			memset(&overlapped, 0, sizeof(overlapped));
+			overlapped.Offset = DWORD(offset + done);
+			overlapped.OffsetHigh = DWORD((offset + done) >> 32);
+			DWORD count = 0;
+			DWORD request = DWORD(std::min<size_t>(bytes - done, 1 << 30));
+			if(!WriteFile(m_handle, src + done, request, &count, &overlapped)) return false;
+#else
+			ssize_t count = ::pwrite(m_fd, src + done, bytes - done, off_t(offset + done));
+			if(count <= 0) return false;
+#endif
+			done += count;
+		}
+		return true;
+	}
+
+	/**
+	 *	@brief write the data written before onto the disk
+	 */
+	bool sync()
+	{
+#ifdef _WIN32
+		return FlushFileBuffers(m_handle) != 0;
+#else
+		return fsync(m_fd) == 0;
+#endif
+	}
+
+#ifndef _WIN32
+	/**
+	 *	@brief the descriptor for the I/O engine submitting the requests itself
+	 */
+	int get_fd() const
+	{
+		return m_fd;
+	}
+#endif
+
+private:
+#ifdef _WIN32
+	HANDLE m_handle;
+#else
+	int m_fd;
+#endif
+};
+
+
+/**
+ * @brief one positional read or write of the ImageIOEngine
+ */
+struct ImageIORequest
+{
+	ImageIORequest() : file(NULL), data(NULL), bytes(0), offset(0), write(false), result(0) {}
+	ImageIORequest(PositionalFile *_file, void *_data, size_t _bytes, int64 _offset, bool _write)
+		: file(_file), data(_data), bytes(_bytes), offset(_offset), write(_write), result(0) {}
+
+	PositionalFile *file;
+	void *data;
+	size_t bytes;
+	int64 offset;
+	bool write;
+	/** the bytes read or written, -1 if fails. The reading stops at the end of the file */
+	int64 result;
+};
+
+/**
+ * @class ImageIOEngine ImageIOEngine.hpp
+ *
+ * @brief Run a batch of the positional reads and writes concurrently, so loading the file nodes of a region
+ * costs about one disk round trip instead of one per node.
+ *
+ * The engine of the process is the io_uring engine on linux if the kernel supports it, otherwise the
+ * thread pool engine running pread/pwrite. It is shared by all the storages and never destroyed.
+ * @see ImageStorage::read_nodes() ImageStorage::write_node_ranges()
+ */
+
+class ImageIOEngine : private boost::noncopyable
+{
+public:
+	/** the thread number of the thread pool engine */
+	enum { THREAD_NUMBER = 8 };
+
+	virtual ~ImageIOEngine() {}
+
+	/**
+	 *	@brief the engine of the process, it is never destroyed, so the static images can use it at the exit
+	 */
+	static ImageIOEngine& instance()
+	{
+		static ImageIOEngine *engine = create_engine();
+		return *engine;
+	}
+
+	/**
+	 *	@brief run the requests and wait until all of them are finished, the result of each request is set
+	 *	@return whether all the requests succeed (the writes are complete)
+	 */
+	virtual bool submit(std::vector<ImageIORequest> &requests) = 0;
+
+	virtual const char* get_name() const = 0;
+
+protected:
+	/**
+	 *	@brief create the io_uring engine if the kernel supports it, otherwise the thread pool engine
+	 */
+	static ImageIOEngine* create_engine();
+
+	/**
+	 *	@brief run the request in the caller thread
+	 */
+	static void run_request(ImageIORequest &request)
+	{
+		if(!request.write) {
+			request.result = request.file->pread(request.data, request.bytes, request.offset);
+		} else {
+			request.result = request.file->pwrite(request.data, request.bytes, request.offset) ? int64(request.bytes) : -1;
+		}
+	}
+
+	static bool all_succeed(const std::vector<ImageIORequest> &requests)
+	{
+		for(size_t i = 0; i < requests.size(); ++i) {
+			if(requests[i].result < 0 || (requests[i].write && requests[i].result != int64(requests[i].bytes))) return false;
+		}
+		return true;
+	}
+};
+
+/**
+ * @class ThreadPoolIOEngine ImageIOEngine.hpp
+ *
+ * @brief Run the requests by pread/pwrite in the pool threads, the submitting thread runs the requests too.
+ */
+
+class ThreadPoolIOEngine : public ImageIOEngine
+{
+public:
+	explicit ThreadPoolIOEngine(size_t thread_number) : m_stopping(false)
+	{
+		if(thread_number < 1) thread_number = 1;
+		for(size_t i = 0; i < thread_number; ++i) {
+			m_threads.create_thread(boost::bind(&ThreadPoolIOEngine::worker_loop, this));
+		}
+	}
+
+	~ThreadPoolIOEngine()
+	{
+		{
+			boost::lock_guard<boost::mutex> lock(m_mutex);
+			m_stopping = true;
+		}
+		m_job_ready.notify_all();
+		m_threads.join_all();
+	}
+
+	virtual bool submit(std::vector<ImageIORequest> &requests)
+	{
+		if(requests.size() <= 1) {
+			if(!requests.empty()) run_request(requests[0]);
+			return all_succeed(requests);
+		}
+
+		size_t remaining = requests.size();
+		{
+			boost::lock_guard<boost::mutex> lock(m_mutex);
+			for(size_t i = 0; i < requests.size(); ++i) {
+				m_jobs.push_back(Job(&requests[i], &remaining));
+			}
+		}
+		m_job_ready.notify_all();
+
+		/* help the pool until the queue is empty, then wait for the requests being run */
+		for(;;) {
+			Job job;
+			{
+				boost::unique_lock<boost::mutex> lock(m_mutex);
+				if(m_jobs.empty()) {
+					while(remaining > 0) {
+						m_job_done.wait(lock);
+					}
+					break;
+				}
+				job = m_jobs.front();
+				m_jobs.pop_front();
+			}
+			run_job(job);
+		}
+
+		return all_succeed(requests);
+	}
+
+	virtual const char* get_name() const
+	{
+		return "thread pool";
+	}
+
+private:
+	/** the request and the remaining request number of its batch */
+	typedef std::pair<ImageIORequest*, size_t*> Job;
+
+	void run_job(const Job &job)
+	{
+		run_request(*job.first);
+		{
+			boost::lock_guard<boost::mutex> lock(m_mutex);
+			--*job.second;
+		}
+		m_job_done.notify_all();
+	}
+
+	void worker_loop()
+	{
+		for(;;) {
+			Job job;
+			{
+				boost::unique_lock<boost::mutex> lock(m_mutex);
+				while(m_jobs.empty() && !m_stopping) {
+					m_job_ready.wait(lock);
+				}
+				if(m_stopping) return;
+
+				job = m_jobs.front();
+				m_jobs.pop_front();
+			}
+			run_job(job);
+		}
+	}
+
+private:
+	boost::thread_group m_threads;
+	boost::mutex m_mutex;
+
+	/** signaled when the jobs are pushed or the engine is stopping */
+	boost::condition_variable m_job_ready;
+	/** signaled when a job is finished */
+	boost::condition_variable m_job_done;
+
+	std::deque<Job> m_jobs;
+	bool m_stopping;
+};
+
+#ifdef IMAGE_IO_HAS_URING
+
+/**
+ * @class UringIOEngine ImageIOEngine.hpp
+ *
+ * @brief Submit the requests to the io_uring of the kernel by one system call, and wait for all the
+ * completions by the same call.
+ *
+ * Each submitting thread takes a ring from the pool, so the rings are never shared. The buffers and the
+ * files are not registered : the buffers are the cache slots allocated and freed all the time, and the
+ * files of the directory storage are opened per node, so registering them costs as many calls as it saves.
+ * The failed or short request (maybe not supported by the old kernel) is run again by pread/pwrite.
+ */
+
+class UringIOEngine : public ImageIOEngine
+{
+public:
+	enum { RING_ENTRIES = 64 };
+
+	~UringIOEngine()
+	{
+		for(size_t i = 0; i < m_free_rings.size(); ++i) {
+			delete m_free_rings[i];
+		}
+	}
+
+	/**
+	 *	@brief checks whether the kernel allows creating the ring
+	 */
+	static bool is_supported()
+	{
+		Ring ring;
+		return ring.init(RING_ENTRIES);
+	}
+
+	virtual bool submit(std::vector<ImageIORequest> &requests)
+	{
+		Ring *ring = acquire_ring();
+		for(size_t first = 0; first < requests.size(); first += RING_ENTRIES) {
+			size_t count = std::min<size_t>(RING_ENTRIES, requests.size() - first);
+			if(ring == NULL || !ring->run(&requests[first], count)) {
+				/* the broken ring is dropped, the rest are run synchronously */
+				delete ring;
+				ring = NULL;
+				for(size_t i = first; i < first + count; ++i) run_request(requests[i]);
+			}
+		}
+		if(ring != NULL) release_ring(ring);
+
+		return all_succeed(requests);
+	}
+
+	virtual const char* get_name() const
+	{
+		return "io_uring";
+	}
+
+private:
+	class Ring : private boost::noncopyable
+	{
+	public:
+		Ring() : m_fd(-1), m_sq_ptr(NULL), m_cq_ptr(NULL), m_sqes(NULL), m_sq_bytes(0), m_cq_bytes(0), m_sqes_bytes(0) {}
+
+		~Ring()
+		{
+			if(m_sqes != NULL) munmap(m_sqes, m_sqes_bytes);
+			if(m_cq_ptr != NULL && m_cq_ptr != m_sq_ptr) munmap(m_cq_ptr, m_cq_bytes);
+			if(m_sq_ptr != NULL) munmap(m_sq_ptr, m_sq_bytes);
+			if(m_fd >= 0) ::close(m_fd);
+		}
+
+		bool init(unsigned entries)
+		{
+			io_uring_params params;
+			memset(&params, 0, sizeof(params));
+			m_fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+			if(m_fd < 0) return false;
+
+			/* the rings share one mapping on the new kernel */
+			m_sq_bytes = params.sq_off.array + params.sq_entries*sizeof(unsigned);
+			m_cq_bytes = params.cq_off.cqes + params.cq_entries*sizeof(io_uring_cqe);
+			bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+			if(single_mmap) m_sq_bytes = m_cq_bytes = std::max(m_sq_bytes, m_cq_bytes);
+
+			m_sq_ptr = map(m_sq_bytes, IORING_OFF_SQ_RING);
+			if(m_sq_ptr == NULL) return false;
+			m_cq_ptr = single_mmap ? m_sq_ptr : map(m_cq_bytes, IORING_OFF_CQ_RING);
+			if(m_cq_ptr == NULL) return false;
+			m_sqes_bytes = params.sq_entries*sizeof(io_uring_sqe);
+			m_sqes = reinterpret_cast<io_uring_sqe*>(map(m_sqes_bytes, IORING_OFF_SQES));
+			if(m_sqes == NULL) return false;
+
+			char *sq = reinterpret_cast<char*>(m_sq_ptr);
+			m_sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+			m_sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+			m_sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+			char *cq = reinterpret_cast<char*>(m_cq_ptr);
+			m_cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+			m_cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+			m_cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+			m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+			return true;
+		}
+
+		/**
+		 *	@brief run at most RING_ENTRIES requests
+		 *	@return false if the ring is broken, the unfinished requests are left
+		 */
+		bool run(ImageIORequest *requests, size_t count)
+		{
+			unsigned tail = *m_sq_tail;
+			unsigned queued = 0;
+			for(size_t i = 0; i < count; ++i) {
+				ImageIORequest &request = requests[i];
+				if(request.bytes > (1u << 30)) {
+					run_request(request);
+					continue;
+				}
+
+				unsigned index = tail & m_sq_mask;
+				io_uring_sqe &sqe = m_sqes[index];
+				memset(&sqe, 0, sizeof(sqe));
+				sqe.opcode = request.write ? IORING_OP_WRITE : IORING_OP_READ;
+				sqe.fd = request.file->get_fd();
+				sqe.addr = reinterpret_cast<uint64>(request.data);
+				sqe.len = unsigned(request.bytes);
+				sqe.off = uint64(request.offset);
+				sqe.user_data = i;
+				m_sq_array[index] = index;
+				++tail;
+				++queued;
+			}
+			__atomic_store_n(m_sq_tail, tail, __ATOMIC_RELEASE);
+
+			unsigned submitted = 0, completed = 0;
+			while(completed < queued) {
+				int ret = (int)syscall(__NR_io_uring_enter, m_fd, queued - submitted, queued - completed, 
+					IORING_ENTER_GETEVENTS, NULL, 0);
+				if(ret < 0) {
+					if(errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+					return false;
+				}
+				submitted += ret;
+
+				unsigned head = *m_cq_head;
+				unsigned cq_tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+				for(; head != cq_tail; ++head) {
+					const io_uring_cqe &cqe = m_cqes[head & m_cq_mask];
+					ImageIORequest &request = requests[cqe.user_data];
+					request.result = cqe.res;
+					if(cqe.res != int(request.bytes)) run_request(request);
+					++completed;
+				}
+				__atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+			}
+			return true;
+		}
+
+	private:
+		void* map(size_t bytes, uint64 offset)
+		{
+			void *ptr = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, off_t(offset));
+			return ptr == MAP_FAILED ? NULL : ptr;
+		}
+
+	private:
+		int m_fd;
+		void *m_sq_ptr, *m_cq_ptr;
+		io_uring_sqe *m_sqes;
+		size_t m_sq_bytes, m_cq_bytes, m_sqes_bytes;
+
+		unsigned *m_sq_tail, *m_sq_array, m_sq_mask;
+		unsigned *m_cq_head, *m_cq_tail, m_cq_mask;
+		io_uring_cqe *m_cqes;
+	};
+
+	Ring* acquire_ring()
+	{
+		{
+			boost::lock_guard<boost::mutex> lock(m_mutex);
+			if(!m_free_rings.empty()) {
+				Ring *ring = m_free_rings.back();
+				m_free_rings.pop_back();
+				return ring;
+			}
+		}
+
+		Ring *ring = new Ring;
+		if(!ring->init(RING_ENTRIES)) {
+			delete ring;
+			return NULL;
+		}
+		return ring;
+	}
+
+	void release_ring(Ring *ring)
+	{
+		boost::lock_guard<boost::mutex> lock(m_mutex);
+		m_free_rings.push_back(ring);
+	}
+
+private:
+	boost::mutex m_mutex;
+	/** the rings not used by any thread */
+	std::vector<Ring*> m_free_rings;
+};
+
+#endif
+
+inline ImageIOEngine* ImageIOEngine::create_engine()
+{
+#ifdef IMAGE_IO_HAS_URING
+	if(UringIOEngine::is_supported()) return new UringIOEngine;
+#endif
+	return new ThreadPoolIOEngine(THREAD_NUMBER);
+}
+
+#endif
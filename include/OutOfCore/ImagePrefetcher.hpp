@@ -0,0 +1,126 @@
+#ifndef _IMAGE_PREFETCHER_HPP
+#define _IMAGE_PREFETCHER_HPP
+
+#include "BasicType.h"
+
+#include <deque>
+#include <set>
+#include <vector>
+#include <utility>
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include <boost/noncopyable.hpp>
+
+/**
+ * @class ImagePrefetcher ImagePrefetcher.hpp
+ *
+ * @brief Load the image file nodes into the cache in the background I/O threads, so the later access of them
+ * doesn't wait for the disk.
+ *
+ * The prefetching is only a hint : the node already waiting is not pushed again, and when max_pending nodes
+ * are waiting, the oldest one is dropped for the new one, so push() never blocks. Each thread takes at most
+ * MAX_BATCH waiting nodes at once, so they are read together.
+ * @see DiskBigImage
+ */
+
+class ImagePrefetcher : private boost::noncopyable
+{
+public:
+	/** the most nodes loaded by a thread at once */
+	enum { MAX_BATCH = 32 };
+
+	/** the node (level, node_no) */
+	typedef std::pair<size_t, size_t> Node;
+
+	/** load the nodes into the cache */
+	typedef boost::function<void (const std::vector<Node>&)> Loader;
+
+	/**
+	 * @param loader the function loading the node, called by the I/O threads concurrently
+	 * @param thread_number the number of the I/O threads, at least 1
+	 * @param max_pending the maximum number of the nodes waiting to be loaded, at least 1
+	 */
+	ImagePrefetcher(const Loader &loader, size_t thread_number, size_t max_pending)
+		: m_loader(loader), m_max_pending(max_pending < 1 ? 1 : max_pending), m_stopping(false)
+	{
+		if(thread_number < 1) thread_number = 1;
+		for(size_t i = 0; i < thread_number; ++i) {
+			m_threads.create_thread(boost::bind(&ImagePrefetcher::loader_loop, this));
+		}
+	}
+
+	~ImagePrefetcher()
+	{
+		{
+			boost::lock_guard<boost::mutex> lock(m_mutex);
+			m_stopping = true;
+			m_jobs.clear();
+			m_pending.clear();
+		}
+		m_job_ready.notify_all();
+		m_threads.join_all();
+	}
+
+	/**
+	 * @brief load the node (level, node_no) in the background
+	 */
+	void push(size_t level, size_t node_no)
+	{
+		{
+			boost::lock_guard<boost::mutex> lock(m_mutex);
+			Node job(level, node_no);
+			if(m_stopping || !m_pending.insert(job).second) return;
+
+			if(m_jobs.size() >= m_max_pending) {
+				m_pending.erase(m_jobs.front());
+				m_jobs.pop_front();
+			}
+			m_jobs.push_back(job);
+		}
+		m_job_ready.notify_one();
+	}
+
+private:
+	void loader_loop()
+	{
+		std::vector<Node> jobs;
+		for(;;) {
+			{
+				boost::unique_lock<boost::mutex> lock(m_mutex);
+				while(m_jobs.empty() && !m_stopping) {
+					m_job_ready.wait(lock);
+				}
+				if(m_stopping) return;
+
+				jobs.clear();
+				while(!m_jobs.empty() && jobs.size() < MAX_BATCH) {
+					jobs.push_back(m_jobs.front());
+					m_jobs.pop_front();
+					m_pending.erase(jobs.back());
+				}
+			}
+
+			m_loader(jobs);
+		}
+	}
+
+private:
+	Loader m_loader;
+
+	boost::thread_group m_threads;
+	boost::mutex m_mutex;
+
+	/** signaled when a job is pushed or the prefetcher is stopping */
+	boost::condition_variable m_job_ready;
+
+	/** the nodes waiting to be loaded in order, and the set of them */
+	std::deque<Node> m_jobs;
+	std::set<Node> m_pending;
+
+	size_t m_max_pending;
+	bool m_stopping;
+};
+
+#endif
@@ -0,0 +1,1278 @@
+#ifndef _IMAGE_STORAGE_HPP
+#define _IMAGE_STORAGE_HPP
+
+#include "BasicType.h"
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <map>
+
+#include <boost/noncopyable.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/filesystem.hpp>
+
+#include "ImageIOEngine.hpp"
+
+/**
+ * @class UniformCell ImageStorage.hpp
+ *
+ * @brief The cell of the uniform node, whose cells are all the same (for example the blank background).
+ * The uniform node is saved as the one cell, and synthesized when reading without touching the disk.
+ */
+
+struct UniformCell
+{
+	enum { MAX_CELL_BYTES = 16 };
+
+	UniformCell() : cell_bytes(0)
+	{
+		memset(value, 0, sizeof(value));
+	}
+
+	/**
+	 *	@brief check whether the data is made of the same cell, and keep the cell if it is
+	 *	@param cell_bytes the bytes of one cell, the cell larger than MAX_CELL_BYTES is never uniform
+	 */
+	bool detect(const void *data, size_t bytes, size_t cell_bytes)
+	{
+		const char *src = reinterpret_cast<const char*>(data);
+		if(cell_bytes == 0 || cell_bytes > MAX_CELL_BYTES || bytes < cell_bytes || bytes % cell_bytes != 0) return false;
+
+		/* the data is uniform iff it equals itself shifted by one cell */
+		if(memcmp(src, src + cell_bytes, bytes - cell_bytes) != 0) return false;
+
+		memcpy(value, src, cell_bytes);
+		this->cell_bytes = (uint)cell_bytes;
+		return true;
+	}
+
+	/**
+	 *	@brief fill the data with the cell
+	 */
+	void fill(void *data, size_t bytes) const
+	{
+		char *dst = reinterpret_cast<char*>(data);
+		size_t done = std::min<size_t>(bytes, cell_bytes);
+		memcpy(dst, value, done);
+
+		/* copy the filled part in doubling chunks */
+		while(done < bytes) {
+			size_t chunk = std::min(done, bytes - done);
+			memcpy(dst + done, dst, chunk);
+			done += chunk;
+		}
+	}
+
+	uint cell_bytes;
+	char value[MAX_CELL_BYTES];
+};
+
+/**
+ * @class NodeHash ImageStorage.hpp
+ *
+ * @brief The 128 bits hash of the node data, used to find the nodes of the same content.
+ * The hash mixes 16 bytes per step in the way of MurmurHash3 (x64, 128 bits).
+ */
+
+struct NodeHash
+{
+	NodeHash() : low(0), high(0) {}
+
+	static NodeHash compute(const void *data, size_t bytes)
+	{
+		const uchar *src = reinterpret_cast<const uchar*>(data);
+		const uint64 c1 = 0x87c37b91114253d5ULL, c2 = 0x4cf5ad432745937fULL;
+		uint64 h1 = 0, h2 = 0;
+
+		size_t blocks = bytes / 16;
+		for(size_t i = 0; i < blocks; ++i) {
+			uint64 k1, k2;
+			memcpy(&k1, src + i*16, sizeof(k1));
+			memcpy(&k2, src + i*16 + 8, sizeof(k2));
+
+			h1 ^= mix_key(k1, c1, c2, 31);
+			h1 = rotl(h1, 27) + h2;
+			h1 = h1*5 + 0x52dce729;
+
+			h2 ^= mix_key(k2, c2, c1, 33);
+			h2 = rotl(h2, 31) + h1;
+			h2 = h2*5 + 0x38495ab5;
+		}
+
+		/* the tail is zero padded to one block */
+		uint64 tail[2] = {0, 0};
+		if(bytes % 16 != 0) {
+			memcpy(tail, src + blocks*16, bytes % 16);
+			h1 ^= mix_key(tail[0], c1, c2, 31);
+			h2 ^= mix_key(tail[1], c2, c1, 33);
+		}
+
+		h1 ^= bytes;
+		h2 ^= bytes;
+		h1 += h2;
+		h2 += h1;
+		h1 = fmix(h1);
+		h2 = fmix(h2);
+		h1 += h2;
+		h2 += h1;
+
+		NodeHash hash;
+		hash.low = h1;
+		hash.high = h2;
+		return hash;
+	}
+
+	bool operator < (const NodeHash &other) const
+	{
+		return high < other.high || (high == other.high && low < other.low);
+	}
+
+	uint64 low, high;
+
+private:
+	static uint64 rotl(uint64 x, int r)
+	{
+		return (x << r) | (x >> (64 - r));
+	}
+
+	static uint64 mix_key(uint64 k, uint64 c1, uint64 c2, int r)
+	{
+		return rotl(k*c1, r)*c2;
+	}
+
+	static uint64 fmix(uint64 k)
+	{
+		k ^= k >> 33;
+		k *= 0xff51afd7ed558ccdULL;
+		k ^= k >> 33;
+		k *= 0xc4ceb9fe1a85ec53ULL;
+		k ^= k >> 33;
+		return k;
+	}
+};
+
+/**
+ * @class NodeContentKey ImageStorage.hpp
+ *
+ * @brief The identity of the saved content of a node, the nodes sharing one saved content have the same key,
+ * so the cache keeps the shared content only once.
+ */
+
+struct NodeContentKey
+{
+	NodeContentKey(uint64 _blob = 0, uint64 _node = 0) : blob(_blob), node(_node) {}
+
+	/**
+	 *	@brief the key owned by the node itself, which is never shared
+	 */
+	static NodeContentKey node_key(size_t level, size_t node_no)
+	{
+		return NodeContentKey(0, (uint64(level) << 56) | node_no);
+	}
+
+	/**
+	 *	@brief the key of the saved data blob, which may be shared by several nodes
+	 */
+	static NodeContentKey blob_key(uint64 blob_id)
+	{
+		return NodeContentKey(blob_id + 1, 0);
+	}
+
+	bool operator == (const NodeContentKey &other) const
+	{
+		return blob == other.blob && node == other.node;
+	}
+
+	bool operator != (const NodeContentKey &other) const
+	{
+		return !(*this == other);
+	}
+
+	uint64 blob;
+	uint64 node;
+};
+
+/**
+ * @class ImageStorage ImageStorage.hpp
+ *
+ * @brief The storage of the image data nodes, each node keeps file_node_size cells of one level.
+ *
+ * The image data can be saved in two formats :
+ * 1) DirectoryImageStorage : one file per node, the file is data_path/level_k/node_no
+ * 2) PackedImageStorage : all the nodes are packed into the .bigimage file after the image head,
+ *    and the offsets of the nodes are saved in the binary directory at the end of the file
+ *
+ * The node whose cells are all the same is saved as a uniform node, which keeps only one cell.
+ * write_node() and write_uniform_node() can be called by multiply threads concurrently. The saved nodes
+ * read by read_nodes() and the ranges written by write_node_ranges() are submitted to ImageIOEngine together.
+ * @see BlockwiseImage HierarchicalImage DiskBigImage ImageIOEngine
+ */
+
+class ImageStorage : private boost::noncopyable
+{
+public:
+	enum StorageFormat
+	{
+		DIRECTORY_STORAGE,
+		PACKED_STORAGE
+	};
+
+	/**
+	 *	@brief one node of read_nodes()
+	 */
+	struct NodeRead
+	{
+		NodeRead(size_t _level = 0, size_t _node_no = 0, void *_data = NULL, size_t _bytes = 0)
+			: level(_level), node_no(_node_no), data(_data), bytes(_bytes), read_bytes(0), success(false) {}
+
+		size_t level;
+		size_t node_no;
+		void *data;
+		size_t bytes;
+		/** [Out] the bytes actually read, and whether the node is read */
+		size_t read_bytes;
+		bool success;
+	};
+
+	/**
+	 *	@brief one range of write_node_ranges()
+	 */
+	struct NodeRangeWrite
+	{
+		NodeRangeWrite(size_t _level = 0, size_t _node_no = 0, size_t _offset = 0, const void *_data = NULL, size_t _bytes = 0)
+			: level(_level), node_no(_node_no), offset(_offset), data(_data), bytes(_bytes), success(false) {}
+
+		size_t level;
+		size_t node_no;
+		size_t offset;
+		const void *data;
+		size_t bytes;
+		/** [Out] whether the range is written, if not, the caller writes the whole node instead */
+		bool success;
+	};
+
+	virtual ~ImageStorage() {}
+
+	/**
+	 *	@brief prepare the level for writing the nodes, must be called before writing the nodes of the level
+	 */
+	virtual bool create_level(size_t level) = 0;
+
+	/**
+	 *	@brief write the node data, if the node exists, the data is written in place
+	 *	(at most the existing node size), otherwise a new node is created
+	 */
+	virtual bool write_node(size_t level, size_t node_no, const void *data, size_t bytes) = 0;
+
+	/**
+	 *	@brief write the bytes at the offset of the existing node in place, the rest of the node is kept.
+	 *	The caller writes the whole node by write_cells() instead if it returns false
+	 *	@return false if the node can't be written partially (not saved, uniform, shared or encoded)
+	 */
+	virtual bool write_node_range(size_t /*level*/, size_t /*node_no*/, size_t /*offset*/, const void * /*data*/, size_t /*bytes*/)
+	{
+		return false;
+	}
+
+	/**
+	 *	@brief write the ranges as write_node_range(), the storage may write them concurrently
+	 *	@return whether all the ranges are written
+	 */
+	virtual bool write_node_ranges(std::vector<NodeRangeWrite> &writes)
+	{
+		bool success = true;
+		for(size_t i = 0; i < writes.size(); ++i) {
+			NodeRangeWrite &write = writes[i];
+			write.success = write_node_range(write.level, write.node_no, write.offset, write.data, write.bytes);
+			if(!write.success) success = false;
+		}
+		return success;
+	}
+
+	/**
+	 *	@brief save the node of bytes as the uniform cell, the former data of the node is dropped
+	 */
+	virtual bool write_uniform_node(size_t level, size_t node_no, const UniformCell &cell, size_t bytes) = 0;
+
+	/**
+	 *	@brief check whether the node is a uniform node
+	 *	@param cell [Out] the cell of the uniform node
+	 *	@param bytes [Out] the bytes of the uniform node
+	 */
+	virtual bool get_uniform_node(size_t level, size_t node_no, UniformCell &cell, size_t &bytes) = 0;
+
+	/**
+	 *	@brief write the node of the cells, the node is saved as the uniform node if all the cells are the same
+	 *	@param cell_bytes the bytes of one cell
+	 */
+	bool write_cells(size_t level, size_t node_no, const void *data, size_t bytes, size_t cell_bytes)
+	{
+		UniformCell cell;
+		if(cell.detect(data, bytes, cell_bytes)) return write_uniform_node(level, node_no, cell, bytes);
+		return write_node(level, node_no, data, bytes);
+	}
+
+	/**
+	 *	@brief read the node data, the uniform node is filled by its cell
+	 *	@param read_bytes [Out] the bytes actually read, maybe less than bytes for the last node of the level
+	 */
+	virtual bool read_node(size_t level, size_t node_no, void *data, size_t bytes, size_t &read_bytes) = 0;
+
+	/**
+	 *	@brief read the nodes as read_node(), the storage may read them concurrently
+	 *	@return whether all the nodes are read
+	 */
+	virtual bool read_nodes(std::vector<NodeRead> &reads)
+	{
+		bool success = true;
+		for(size_t i = 0; i < reads.size(); ++i) {
+			NodeRead &read = reads[i];
+			read.success = read_node(read.level, read.node_no, read.data, read.bytes, read.read_bytes);
+			if(!read.success) success = false;
+		}
+		return success;
+	}
+
+	/**
+	 *	@brief get the key of the saved content of the node
+	 *	@param shared [Out] whether the content is shared by other nodes, writing the node must not change
+	 *	the shared content (the storage writes the node elsewhere)
+	 */
+	virtual NodeContentKey get_content_key(size_t level, size_t node_no, bool &shared)
+	{
+		shared = false;
+		return NodeContentKey::node_key(level, node_no);
+	}
+
+	/**
+	 *	@brief save the changed node information (the uniform nodes, the directory), so the written nodes
+	 *	are readable by reopening the image without closing the storage
+	 */
+	virtual bool flush()
+	{
+		return true;
+	}
+
+	/**
+	 *	@brief finish the writing, all the nodes must be written before calling it
+	 */
+	virtual bool close() = 0;
+};
+
+/**
+ * @class DirectoryImageStorage ImageStorage.hpp
+ *
+ * @brief One file per node, the file name is data_path/level_k/node_no
+ *
+ * The uniform nodes of a level are listed in the file data_path/level_k/uniform : the magic "UNIFORM1",
+ * uint64 node number, and (uint64 node_no, UniformEntry) of each uniform node. The list is loaded when
+ * the level is visited first, and saved when closing.
+ */
+
+class DirectoryImageStorage : public ImageStorage
+{
+public:
+	explicit DirectoryImageStorage(const std::string &data_path) : m_data_path(data_path) {}
+
+	virtual ~DirectoryImageStorage()
+	{
+		close();
+	}
+
+	virtual bool create_level(size_t level)
+	{
+		namespace bf = boost::filesystem;
+
+		try {
+			bf::path level_path(get_level_path(level));
+			if(!bf::exists(level_path) && !bf::create_directories(level_path)) {
+				std::cerr << "create directory " << level_path.generic_string() << " failure" << std::endl;
+				return false;
+			}
+		} catch(bf::filesystem_error &err) {
+			std::cerr << err.what() << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	virtual bool write_node(size_t level, size_t node_no, const void *data, size_t bytes)
+	{
+		using namespace std;
+
+		{
+			/* the node is not uniform any more */
+			boost::mutex::scoped_lock lock(m_mutex);
+			UniformLevel &uniform_level = get_uniform_level(level);
+			if(uniform_level.nodes.erase(node_no) > 0) uniform_level.dirty = true;
+		}
+
+		string file_name = get_node_file_name(level, node_no);
+		ofstream fout(file_name.c_str(), ios::out | ios::binary);
+		if(!fout.is_open()) {
+			cerr << "open file " << file_name << " failure" << endl;
+			return false;
+		}
+
+		fout.write(reinterpret_cast<const char*>(data), bytes);
+		if(!fout) {
+			cerr << "write file " << file_name << " failure" << endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	virtual bool write_node_range(size_t level, size_t node_no, size_t offset, const void *data, size_t bytes)
+	{
+		std::vector<NodeRangeWrite> writes(1, NodeRangeWrite(level, node_no, offset, data, bytes));
+		return write_node_ranges(writes);
+	}
+
+	/**
+	 *	@brief write the ranges into the node files concurrently, the files are not truncated
+	 */
+	virtual bool write_node_ranges(std::vector<NodeRangeWrite> &writes)
+	{
+		std::vector<boost::shared_ptr<PositionalFile> > files;
+		std::vector<ImageIORequest> requests;
+		std::vector<size_t> write_nos;
+		for(size_t i = 0; i < writes.size(); ++i) {
+			NodeRangeWrite &write = writes[i];
+			write.success = false;
+
+			UniformCell cell;
+			size_t uniform_bytes = 0;
+			if(get_uniform_node(write.level, write.node_no, cell, uniform_bytes)) continue;
+
+			boost::shared_ptr<PositionalFile> file = boost::make_shared<PositionalFile>();
+			if(!file->open(get_node_file_name(write.level, write.node_no), true)) continue;
+
+			files.push_back(file);
+			requests.push_back(ImageIORequest(file.get(), const_cast<void*>(write.data), write.bytes, write.offset, true));
+			write_nos.push_back(i);
+		}
+
+		bool success = ImageIOEngine::instance().submit(requests) && write_nos.size() == writes.size();
+
+		for(size_t i = 0; i < requests.size(); ++i) {
+			NodeRangeWrite &write = writes[write_nos[i]];
+			write.success = (requests[i].result == int64(write.bytes));
+			if(!write.success) std::cerr << "write file " << get_node_file_name(write.level, write.node_no) << " failure" << std::endl;
+		}
+		return success;
+	}
+
+	virtual bool write_uniform_node(size_t level, size_t node_no, const UniformCell &cell, size_t bytes)
+	{
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			UniformLevel &uniform_level = get_uniform_level(level);
+			UniformEntry &entry = uniform_level.nodes[node_no];
+			entry.bytes = bytes;
+			entry.cell = cell;
+			uniform_level.dirty = true;
+		}
+
+		/* drop the former node file */
+		boost::system::error_code err;
+		boost::filesystem::remove(get_node_file_name(level, node_no), err);
+		return true;
+	}
+
+	virtual bool get_uniform_node(size_t level, size_t node_no, UniformCell &cell, size_t &bytes)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		UniformLevel &uniform_level = get_uniform_level(level);
+		std::map<size_t, UniformEntry>::const_iterator ite = uniform_level.nodes.find(node_no);
+		if(ite == uniform_level.nodes.end()) return false;
+
+		cell = ite->second.cell;
+		bytes = (size_t)ite->second.bytes;
+		return true;
+	}
+
+	virtual bool read_node(size_t level, size_t node_no, void *data, size_t bytes, size_t &read_bytes)
+	{
+		using namespace std;
+
+		UniformCell cell;
+		size_t uniform_bytes = 0;
+		if(get_uniform_node(level, node_no, cell, uniform_bytes)) {
+			read_bytes = std::min(bytes, uniform_bytes);
+			cell.fill(data, read_bytes);
+			return true;
+		}
+
+		string file_name = get_node_file_name(level, node_no);
+		ifstream fin(file_name.c_str(), ios::in | ios::binary);
+		if(!fin.is_open()) {
+			cerr << "can't open file " << file_name << endl;
+			return false;
+		}
+
+		fin.read(reinterpret_cast<char*>(data), bytes);
+		if(!fin.eof() && fin.fail()) {
+			cerr << "read image file " << file_name << " fails" << endl;
+			return false;
+		}
+
+		read_bytes = (size_t)fin.gcount();
+		return true;
+	}
+
+	/**
+	 *	@brief read the node files concurrently
+	 */
+	virtual bool read_nodes(std::vector<NodeRead> &reads)
+	{
+		std::vector<boost::shared_ptr<PositionalFile> > files;
+		std::vector<ImageIORequest> requests;
+		std::vector<size_t> read_nos;
+		bool success = true;
+		for(size_t i = 0; i < reads.size(); ++i) {
+			NodeRead &read = reads[i];
+			read.success = false;
+
+			UniformCell cell;
+			size_t uniform_bytes = 0;
+			if(get_uniform_node(read.level, read.node_no, cell, uniform_bytes)) {
+				read.read_bytes = std::min(read.bytes, uniform_bytes);
+				cell.fill(read.data, read.read_bytes);
+				read.success = true;
+				continue;
+			}
+
+			std::string file_name = get_node_file_name(read.level, read.node_no);
+			boost::shared_ptr<PositionalFile> file = boost::make_shared<PositionalFile>();
+			if(!file->open(file_name, false)) {
+				std::cerr << "can't open file " << file_name << std::endl;
+				success = false;
+				continue;
+			}
+
+			files.push_back(file);
+			requests.push_back(ImageIORequest(file.get(), read.data, read.bytes, 0, false));
+			read_nos.push_back(i);
+		}
+
+		ImageIOEngine::instance().submit(requests);
+
+		for(size_t i = 0; i < requests.size(); ++i) {
+			NodeRead &read = reads[read_nos[i]];
+			read.success = (requests[i].result >= 0);
+			if(!read.success) {
+				std::cerr << "read image file " << get_node_file_name(read.level, read.node_no) << " fails" << std::endl;
+				success = false;
+				continue;
+			}
+			read.read_bytes = (size_t)requests[i].result;
+		}
+		return success;
+	}
+
+	virtual bool flush()
+	{
+		return close();
+	}
+
+	/**
+	 *	@brief save the changed uniform node lists
+	 */
+	virtual bool close()
+	{
+		using namespace std;
+
+		boost::mutex::scoped_lock lock(m_mutex);
+		bool success = true;
+		for(size_t level = 0; level < m_uniform_levels.size(); ++level) {
+			UniformLevel &uniform_level = m_uniform_levels[level];
+			if(!uniform_level.dirty) continue;
+
+			string file_name = get_uniform_file_name(level);
+			if(uniform_level.nodes.empty()) {
+				boost::system::error_code err;
+				boost::filesystem::remove(file_name, err);
+				uniform_level.dirty = false;
+				continue;
+			}
+
+			ofstream fout(file_name.c_str(), ios::out | ios::binary | ios::trunc);
+			uint64 node_number = uniform_level.nodes.size();
+			fout.write("UNIFORM1", 8);
+			fout.write(reinterpret_cast<const char*>(&node_number), sizeof(node_number));
+			for(std::map<size_t, UniformEntry>::const_iterator ite = uniform_level.nodes.begin();
+				ite != uniform_level.nodes.end(); ++ite) {
+				uint64 node_no = ite->first;
+				fout.write(reinterpret_cast<const char*>(&node_no), sizeof(node_no));
+				fout.write(reinterpret_cast<const char*>(&ite->second), sizeof(UniformEntry));
+			}
+
+			if(!fout) {
+				cerr << "write " << file_name << " failure" << endl;
+				success = false;
+				continue;
+			}
+			uniform_level.dirty = false;
+		}
+
+		return success;
+	}
+
+protected:
+	std::string get_level_path(size_t level) const
+	{
+		return m_data_path + "/level_" + boost::lexical_cast<std::string>(level);
+	}
+
+	std::string get_node_file_name(size_t level, size_t node_no) const
+	{
+		return get_level_path(level) + '/' + boost::lexical_cast<std::string>(node_no);
+	}
+
+	std::string get_uniform_file_name(size_t level) const
+	{
+		return get_level_path(level) + "/uniform";
+	}
+
+protected:
+	struct UniformEntry
+	{
+		UniformEntry() : bytes(0) {}
+		uint64 bytes;
+		UniformCell cell;
+	};
+
+	struct UniformLevel
+	{
+		UniformLevel() : loaded(false), dirty(false) {}
+		std::map<size_t, UniformEntry> nodes;
+		bool loaded;
+		bool dirty;
+	};
+
+	/**
+	 *	@brief get the uniform node list of the level, load it from the disk if it is the first visit.
+	 *	@note must be called with m_mutex locked
+	 */
+	UniformLevel& get_uniform_level(size_t level)
+	{
+		using namespace std;
+
+		if(m_uniform_levels.size() <= level) m_uniform_levels.resize(level + 1);
+		UniformLevel &uniform_level = m_uniform_levels[level];
+		if(uniform_level.loaded) return uniform_level;
+		uniform_level.loaded = true;
+
+		/* no list means no uniform node */
+		ifstream fin(get_uniform_file_name(level).c_str(), ios::in | ios::binary);
+		if(!fin.is_open()) return uniform_level;
+
+		char magic[8];
+		uint64 node_number = 0;
+		fin.read(magic, sizeof(magic));
+		fin.read(reinterpret_cast<char*>(&node_number), sizeof(node_number));
+		if(!fin || memcmp(magic, "UNIFORM1", 8) != 0) {
+			cerr << "the uniform node list of level " << level << " is not correct" << endl;
+			return uniform_level;
+		}
+
+		for(uint64 i = 0; i < node_number; ++i) {
+			uint64 node_no = 0;
+			UniformEntry entry;
+			fin.read(reinterpret_cast<char*>(&node_no), sizeof(node_no));
+			fin.read(reinterpret_cast<char*>(&entry), sizeof(entry));
+			if(!fin) {
+				cerr << "the uniform node list of level " << level << " is not correct" << endl;
+				break;
+			}
+			uniform_level.nodes[(size_t)node_no] = entry;
+		}
+
+		return uniform_level;
+	}
+
+protected:
+	std::string m_data_path;
+
+	/** the uniform nodes of each level */
+	std::vector<UniformLevel> m_uniform_levels;
+	boost::mutex m_mutex;
+};
+
+/**
+ * @class PackedImageStorage ImageStorage.hpp
+ *
+ * @brief All the nodes are packed into the .bigimage file.
+ *
+ * The file layout is :
+ * 1) the image head, which saves the offset of the directory (@see BigImageHead)
+ * 2) the node data, beginning from the alignment of PACKED_ALIGNMENT bytes
+ * 3) the binary directory at the offset : the magic "BIGPACK2", uint64 level number, and for each level
+ *    uint64 node number followed by the NodeEntry of each node, the uniform node keeps its cell in the
+ *    entry and has no data.
+ *
+ * The file is opened once, and the nodes are read or written by the positional I/O, so a cache miss
+ * costs no open/close and the writer threads append the nodes without seeking.
+ *
+ * When the image is written, the nodes of the same content (by NodeHash) are saved once, and the
+ * duplicated nodes point to the same offset. A shared node is moved to the end when it is written again,
+ * so the other nodes keep the former content.
+ */
+
+class PackedImageStorage : public ImageStorage
+{
+public:
+	enum { PACKED_ALIGNMENT = 4096 };
+
+	PackedImageStorage() : m_file_end(0), m_directory_offset_pos(0), m_writing(false), m_directory_dirty(false), m_unsynced(false) {}
+
+	virtual ~PackedImageStorage()
+	{
+		close();
+	}
+
+	/**
+	 *	@brief append the nodes into the written head file, the nodes begin from the alignment after the head
+	 *	@param directory_offset_pos the position in the head to save the directory offset (int64) when closing
+	 */
+	bool create(const std::string &file_name, int64 directory_offset_pos)
+	{
+		using namespace std;
+
+		if(!m_file.open(file_name, true)) {
+			cerr << "open " << file_name << " failure" << endl;
+			return false;
+		}
+
+		int64 head_size = 0;
+		try {
+			head_size = (int64)boost::filesystem::file_size(file_name);
+		} catch(boost::filesystem::filesystem_error &err) {
+			cerr << err.what() << endl;
+			return false;
+		}
+
+		/* the node data is aligned, the gap after the head is left as a hole */
+		m_file_end = (head_size + PACKED_ALIGNMENT - 1) / PACKED_ALIGNMENT * PACKED_ALIGNMENT;
+		m_directory_offset_pos = directory_offset_pos;
+		m_file_name = file_name;
+		m_nodes.clear();
+		m_blob_references.clear();
+		m_blob_hashes.clear();
+		m_writing = true;
+		m_directory_dirty = true;
+		m_unsynced = false;
+		return true;
+	}
+
+	/**
+	 *	@brief open the packed image file, the directory offset comes from the image head
+	 *	@param directory_offset_pos the position in the head to update the directory offset if the nodes are moved
+	 */
+	bool open(const std::string &file_name, int64 directory_offset, int64 directory_offset_pos)
+	{
+		using namespace std;
+
+		/* open for writing back the modified nodes, or just read only */
+		if(!m_file.open(file_name, true) && !m_file.open(file_name, false)) {
+			cerr << "open " << file_name << " failure" << endl;
+			return false;
+		}
+		m_file_name = file_name;
+		m_writing = false;
+		m_directory_dirty = false;
+		m_unsynced = false;
+		m_directory_offset_pos = directory_offset_pos;
+
+		uint64 level_number = 0;
+		char magic[8];
+		if(m_file.pread(magic, sizeof(magic), directory_offset) != sizeof(magic)
+			|| memcmp(magic, "BIGPACK2", 8) != 0
+			|| m_file.pread(&level_number, sizeof(level_number), directory_offset + 8) != sizeof(level_number)) {
+			cerr << "the packed directory of " << file_name << " is not correct" << endl;
+			return false;
+		}
+
+		int64 offset = directory_offset + 16;
+		m_nodes.resize(level_number);
+		for(size_t level = 0; level < level_number; ++level) {
+			uint64 node_number = 0;
+			if(m_file.pread(&node_number, sizeof(node_number), offset) != sizeof(node_number)) {
+				cerr << "the packed directory of " << file_name << " is not correct" << endl;
+				return false;
+			}
+			offset += sizeof(node_number);
+
+			int64 bytes = node_number * sizeof(NodeEntry);
+			m_nodes[level].resize(node_number);
+			if(node_number > 0 && m_file.pread(&m_nodes[level][0], bytes, offset) != bytes) {
+				cerr << "the packed directory of " << file_name << " is not correct" << endl;
+				return false;
+			}
+			offset += bytes;
+		}
+		/* the head points to the directory until the next one is written, so the nodes are appended after it */
+		m_file_end = offset;
+
+		/* count the nodes sharing each saved data */
+		m_blob_references.clear();
+		m_blob_hashes.clear();
+		for(size_t level = 0; level < m_nodes.size(); ++level) {
+			for(size_t i = 0; i < m_nodes[level].size(); ++i) {
+				const NodeEntry &node = m_nodes[level][i];
+				if(node.bytes > 0 && node.cell.cell_bytes == 0) ++m_blob_references[node.offset];
+			}
+		}
+
+		return true;
+	}
+
+	virtual bool create_level(size_t level)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		if(m_nodes.size() <= level) m_nodes.resize(level + 1);
+		return true;
+	}
+
+	virtual bool write_node(size_t level, size_t node_no, const void *data, size_t bytes)
+	{
+		/* the new nodes are deduplicated when writing the image. The saved data of the same hash is compared
+		 * without the lock, the saved data is never changed while writing the image */
+		NodeHash hash;
+		NodeEntry same_node;
+		bool found_same = false;
+		if(m_writing) {
+			hash = NodeHash::compute(data, bytes);
+			{
+				boost::mutex::scoped_lock lock(m_mutex);
+				std::map<NodeHash, NodeEntry>::const_iterator ite = m_blob_hashes.find(hash);
+				if(ite != m_blob_hashes.end() && ite->second.bytes == bytes) {
+					same_node = ite->second;
+					found_same = true;
+				}
+			}
+			found_same = found_same && same_blob(same_node.offset, data, bytes);
+		}
+
+		int64 offset = 0;
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			if(level >= m_nodes.size()) {
+				std::cerr << "PackedImageStorage::write_node error : level " << level << " is not created" << std::endl;
+				return false;
+			}
+
+			std::vector<NodeEntry> &nodes = m_nodes[level];
+			bool exists = (node_no < nodes.size() && nodes[node_no].bytes > 0);
+			if(!exists && !m_writing) {
+				std::cerr << "the node " << node_no << " of level " << level << " doesn't exist in " << m_file_name << std::endl;
+				return false;
+			}
+			if(node_no >= nodes.size()) nodes.resize(node_no + 1);
+			NodeEntry &node = nodes[node_no];
+
+			if(exists && (node.cell.cell_bytes > 0 || release_blob(node.offset) > 0)) {
+				/* the uniform node has no data space and the shared data can't be changed,
+				 * so the node is moved to the end */
+				node.cell = UniformCell();
+				exists = false;
+			}
+
+			/* the compared data is still the saved data of the hash */
+			std::map<NodeHash, NodeEntry>::const_iterator ite = m_blob_hashes.end();
+			if(found_same) ite = m_blob_hashes.find(hash);
+
+			if(ite != m_blob_hashes.end() && ite->second.offset == same_node.offset && ite->second.bytes == same_node.bytes) {
+				/* the same content is saved, just point to it */
+				node.offset = ite->second.offset;
+				node.bytes = bytes;
+				++m_blob_references[node.offset];
+				m_directory_dirty = true;
+				return true;
+			}
+
+			if(exists && bytes <= node.bytes && !m_writing) {
+				/* write in place, the node may shrink (the compressed node). When writing the image, the former
+				 * content may be referred by the hash, so the node is always appended */
+				offset = node.offset;
+			} else {
+				/* append the new node or move the grown node to the end, the nodes of a level may be written out of order */
+				offset = m_file_end;
+				node.offset = offset;
+				m_file_end += bytes;
+				m_directory_dirty = true;
+			}
+			++m_blob_references[offset];
+
+			if(node.bytes != bytes) {
+				node.bytes = bytes;
+				m_directory_dirty = true;
+			}
+
+			if(m_writing) {
+				m_blob_hashes[hash] = node;
+			}
+		}
+
+		if(!m_file.pwrite(data, bytes, offset)) {
+			std::cerr << "write " << m_file_name << " failure" << std::endl;
+			return false;
+		}
+		mark_unsynced();
+		return true;
+	}
+
+	virtual bool write_node_range(size_t level, size_t node_no, size_t offset, const void *data, size_t bytes)
+	{
+		std::vector<NodeRangeWrite> writes(1, NodeRangeWrite(level, node_no, offset, data, bytes));
+		return write_node_ranges(writes);
+	}
+
+	/**
+	 *	@brief write the ranges of the normal nodes in place concurrently. The shared node must be moved by
+	 *	write_node(), and the node written when writing the image may be referred by its hash
+	 */
+	virtual bool write_node_ranges(std::vector<NodeRangeWrite> &writes)
+	{
+		std::vector<ImageIORequest> requests;
+		std::vector<size_t> write_nos;
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			for(size_t i = 0; i < writes.size(); ++i) {
+				NodeRangeWrite &write = writes[i];
+				write.success = false;
+				if(m_writing || write.level >= m_nodes.size() || write.node_no >= m_nodes[write.level].size()) continue;
+
+				const NodeEntry &node = m_nodes[write.level][write.node_no];
+				if(node.bytes == 0 || node.cell.cell_bytes > 0 || write.offset + write.bytes > node.bytes) continue;
+
+				std::map<uint64, size_t>::const_iterator ite = m_blob_references.find(node.offset);
+				if(ite != m_blob_references.end() && ite->second > 1) continue;
+
+				requests.push_back(ImageIORequest(&m_file, const_cast<void*>(write.data), write.bytes, node.offset + write.offset, true));
+				write_nos.push_back(i);
+			}
+		}
+
+		bool success = ImageIOEngine::instance().submit(requests) && write_nos.size() == writes.size();
+		if(!requests.empty()) mark_unsynced();
+
+		for(size_t i = 0; i < requests.size(); ++i) {
+			writes[write_nos[i]].success = (requests[i].result == int64(requests[i].bytes));
+			if(!writes[write_nos[i]].success) std::cerr << "write " << m_file_name << " failure" << std::endl;
+		}
+		return success;
+	}
+
+	virtual bool write_uniform_node(size_t level, size_t node_no, const UniformCell &cell, size_t bytes)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		if(level >= m_nodes.size()) {
+			std::cerr << "PackedImageStorage::write_uniform_node error : level " << level << " is not created" << std::endl;
+			return false;
+		}
+
+		std::vector<NodeEntry> &nodes = m_nodes[level];
+		if(!m_writing && (node_no >= nodes.size() || nodes[node_no].bytes == 0)) {
+			std::cerr << "the node " << node_no << " of level " << level << " doesn't exist in " << m_file_name << std::endl;
+			return false;
+		}
+
+		/* the former data space of the node is left unused */
+		if(node_no >= nodes.size()) nodes.resize(node_no + 1);
+		if(nodes[node_no].bytes > 0 && nodes[node_no].cell.cell_bytes == 0) release_blob(nodes[node_no].offset);
+		nodes[node_no].offset = 0;
+		nodes[node_no].bytes = bytes;
+		nodes[node_no].cell = cell;
+		m_directory_dirty = true;
+		return true;
+	}
+
+	virtual bool get_uniform_node(size_t level, size_t node_no, UniformCell &cell, size_t &bytes)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		if(level >= m_nodes.size() || node_no >= m_nodes[level].size() || m_nodes[level][node_no].cell.cell_bytes == 0)
+			return false;
+
+		cell = m_nodes[level][node_no].cell;
+		bytes = (size_t)m_nodes[level][node_no].bytes;
+		return true;
+	}
+
+	virtual bool read_node(size_t level, size_t node_no, void *data, size_t bytes, size_t &read_bytes)
+	{
+		NodeEntry node;
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			if(level >= m_nodes.size() || node_no >= m_nodes[level].size()) {
+				std::cerr << "the node " << node_no << " of level " << level << " doesn't exist in " << m_file_name << std::endl;
+				return false;
+			}
+			node = m_nodes[level][node_no];
+		}
+
+		/* synthesize the uniform node */
+		if(node.cell.cell_bytes > 0) {
+			read_bytes = std::min<size_t>(bytes, node.bytes);
+			node.cell.fill(data, read_bytes);
+			return true;
+		}
+
+		int64 count = m_file.pread(data, std::min<size_t>(bytes, node.bytes), node.offset);
+		if(count < 0) {
+			std::cerr << "read " << m_file_name << " failure" << std::endl;
+			return false;
+		}
+
+		read_bytes = (size_t)count;
+		return true;
+	}
+
+	/**
+	 *	@brief read the nodes from the file concurrently
+	 */
+	virtual bool read_nodes(std::vector<NodeRead> &reads)
+	{
+		std::vector<ImageIORequest> requests;
+		std::vector<size_t> read_nos;
+		bool success = true;
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			for(size_t i = 0; i < reads.size(); ++i) {
+				NodeRead &read = reads[i];
+				read.success = false;
+				if(read.level >= m_nodes.size() || read.node_no >= m_nodes[read.level].size()) {
+					std::cerr << "the node " << read.node_no << " of level " << read.level << " doesn't exist in " << m_file_name << std::endl;
+					success = false;
+					continue;
+				}
+
+				/* synthesize the uniform node */
+				const NodeEntry &node = m_nodes[read.level][read.node_no];
+				if(node.cell.cell_bytes > 0) {
+					read.read_bytes = std::min<size_t>(read.bytes, node.bytes);
+					node.cell.fill(read.data, read.read_bytes);
+					read.success = true;
+					continue;
+				}
+
+				requests.push_back(ImageIORequest(&m_file, read.data, std::min<size_t>(read.bytes, node.bytes), node.offset, false));
+				read_nos.push_back(i);
+			}
+		}
+
+		ImageIOEngine::instance().submit(requests);
+
+		for(size_t i = 0; i < requests.size(); ++i) {
+			NodeRead &read = reads[read_nos[i]];
+			read.success = (requests[i].result >= 0);
+			if(!read.success) {
+				std::cerr << "read " << m_file_name << " failure" << std::endl;
+				success = false;
+				continue;
+			}
+			read.read_bytes = (size_t)requests[i].result;
+		}
+		return success;
+	}
+
+	/**
+	 *	@brief the key of the normal node is its offset, so the nodes sharing the data have the same key
+	 */
+	virtual NodeContentKey get_content_key(size_t level, size_t node_no, bool &shared)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		shared = false;
+		if(level >= m_nodes.size() || node_no >= m_nodes[level].size()) return NodeContentKey::node_key(level, node_no);
+
+		const NodeEntry &node = m_nodes[level][node_no];
+		if(node.bytes == 0 || node.cell.cell_bytes > 0) return NodeContentKey::node_key(level, node_no);
+
+		std::map<uint64, size_t>::const_iterator ite = m_blob_references.find(node.offset);
+		shared = (ite != m_blob_references.end() && ite->second > 1);
+		return NodeContentKey::blob_key(node.offset);
+	}
+
+	/**
+	 *	@brief get the position of the saved data of the normal node in the file
+	 *	@return false if the node doesn't exist or is uniform
+	 */
+	bool get_node_location(size_t level, size_t node_no, int64 &offset, size_t &bytes)
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		if(level >= m_nodes.size() || node_no >= m_nodes[level].size()) return false;
+
+		const NodeEntry &node = m_nodes[level][node_no];
+		if(node.bytes == 0 || node.cell.cell_bytes > 0) return false;
+
+		offset = (int64)node.offset;
+		bytes = (size_t)node.bytes;
+		return true;
+	}
+
+	/**
+	 *	@brief write the changed directory and sync the file, the file is kept open. The nodes appended later
+	 *	go after the directory, so the file stays loadable until the next flush() or close()
+	 */
+	virtual bool flush()
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		if(!m_file.is_open()) return true;
+		if(m_directory_dirty) return write_directory();
+		return sync_file();
+	}
+
+	/**
+	 *	@brief write the directory at the end of the file and patch its offset in the head, 
+	 *	the directory of the opened file is rewritten only if the nodes are changed in size
+	 */
+	virtual bool close()
+	{
+		if(!m_file.is_open()) return true;
+		if(m_directory_dirty) {
+			m_writing = false;
+			m_blob_hashes.clear();
+			if(!write_directory()) return false;
+		} else if(!sync_file()) {
+			return false;
+		}
+
+		m_file.close();
+		return true;
+	}
+
+private:
+	/**
+	 *	@brief write the directory at the end of the file and patch its offset in the head,
+	 *	must be called with m_mutex locked or by close()
+	 */
+	bool write_directory()
+	{
+		using namespace std;
+
+		std::vector<char> directory(16);
+		memcpy(&directory[0], "BIGPACK2", 8);
+		uint64 level_number = m_nodes.size();
+		memcpy(&directory[8], &level_number, sizeof(level_number));
+		for(size_t level = 0; level < m_nodes.size(); ++level) {
+			uint64 node_number = m_nodes[level].size();
+			size_t pos = directory.size();
+			directory.resize(pos + sizeof(node_number) + node_number*sizeof(NodeEntry));
+			memcpy(&directory[pos], &node_number, sizeof(node_number));
+			if(node_number > 0)
+				memcpy(&directory[pos + sizeof(node_number)], &m_nodes[level][0], node_number*sizeof(NodeEntry));
+		}
+
+		/* the nodes and the new directory are on the disk before the head points to it, so a crash leaves 
+		 * either the former directory or the new one */
+		int64 directory_offset = m_file_end;
+		if(!m_file.pwrite(&directory[0], directory.size(), directory_offset) || !m_file.sync() ||
+			!m_file.pwrite(&directory_offset, sizeof(directory_offset), m_directory_offset_pos) || !m_file.sync()) {
+			cerr << "write the packed directory of " << m_file_name << " failure" << endl;
+			return false;
+		}
+
+		m_file_end = directory_offset + (int64)directory.size();
+		m_directory_dirty = false;
+		m_unsynced = false;
+		return true;
+	}
+
+	/**
+	 *	@brief sync the nodes written in place, must be called with m_mutex locked or by close()
+	 */
+	bool sync_file()
+	{
+		if(!m_unsynced) return true;
+		if(!m_file.sync()) {
+			std::cerr << "sync " << m_file_name << " failure" << std::endl;
+			return false;
+		}
+		m_unsynced = false;
+		return true;
+	}
+
+	/**
+	 *	@brief remember the written nodes to be synced, called after the writing is finished
+	 */
+	void mark_unsynced()
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		m_unsynced = true;
+	}
+
+	/**
+	 *	@brief whether the saved data at the offset is the same as the data, the hashes may collide.
+	 *	The data being written by another thread doesn't match, so the node is just appended.
+	 *	It reads the file, so it is called without m_mutex
+	 */
+	bool same_blob(uint64 offset, const void *data, size_t bytes) const
+	{
+		if(bytes == 0) return true;
+
+		std::vector<char> saved(bytes);
+		return m_file.pread(&saved[0], bytes, (int64)offset) == int64(bytes) && memcmp(&saved[0], data, bytes) == 0;
+	}
+
+	/**
+	 *	@brief drop one reference of the saved data at the offset, must be called with m_mutex locked
+	 *	@return the references left
+	 */
+	size_t release_blob(uint64 offset)
+	{
+		std::map<uint64, size_t>::iterator ite = m_blob_references.find(offset);
+		if(ite == m_blob_references.end()) return 0;
+		if(--ite->second > 0) return ite->second;
+
+		m_blob_references.erase(ite);
+		return 0;
+	}
+
+private:
+	struct NodeEntry
+	{
+		NodeEntry() : offset(0), bytes(0) {}
+		uint64 offset;
+		uint64 bytes;
+		/** the cell of the uniform node, the cell_bytes is 0 for the normal node */
+		UniformCell cell;
+	};
+
+	PositionalFile m_file;
+	std::string m_file_name;
+
+	/** the nodes of each level */
+	std::vector<std::vector<NodeEntry> > m_nodes;
+
+	/** the number of the nodes referring to the saved data at each offset */
+	std::map<uint64, size_t> m_blob_references;
+
+	/** the saved data of each content hash, only kept when writing the image */
+	std::map<NodeHash, NodeEntry> m_blob_hashes;
+
+	/** the end of the node data, where the next node is appended */
+	int64 m_file_end;
+
+	/** the position of the directory offset in the head */
+	int64 m_directory_offset_pos;
+
+	bool m_writing;
+
+	/** whether the directory needs to be written when closing */
+	bool m_directory_dirty;
+
+	/** whether the nodes are written after the last sync */
+	bool m_unsynced;
+
+	boost::mutex m_mutex;
+};
+
+#endif
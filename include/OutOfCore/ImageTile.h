@@ -0,0 +1,85 @@
+#ifndef _IMAGE_TILE_H
+#define _IMAGE_TILE_H
+
+#include "IndexMethodInterface.h"
+#include <vector>
+#include <boost/assert.hpp>
+
+/**
+ * @class ImageTile ImageTile.h
+ *
+ * @brief The pinned aligned square tile of the image, the cells are kept in a row-major plain memory.
+ *
+ * The tile is pinned by BlockwiseImage::pin_tile(), then the processing code can work on the tile
+ * by the raw pointer and the row stride, and at last BlockwiseImage::unpin_tile() writes the tile back.
+ * The tile at the right or bottom border of the image is clipped, so only the [0, get_rows()) x [0, get_cols())
+ * part of the tile is valid.
+ *
+ * @tparam T The type of the image cell
+ */
+
+template<typename T>
+class ImageTile
+{
+public:
+	ImageTile() : m_start_row(0), m_start_col(0), m_rows(0), m_cols(0), m_tile_order(0), m_pinned(false) {}
+
+	/**
+	 *	@brief the row-major data of the tile, the row stride is get_stride()
+	 */
+	T* data() { return m_data.empty() ? NULL : &m_data[0]; }
+	const T* data() const { return m_data.empty() ? NULL : &m_data[0]; }
+
+	/**
+	 *	@brief the cell (row, col) relative to the left-corner of the tile
+	 */
+	T& operator() (int row, int col)
+	{
+		BOOST_ASSERT(0 <= row && row < m_rows && 0 <= col && col < m_cols);
+		return m_data[(row << m_tile_order) + col];
+	}
+	const T& operator() (int row, int col) const
+	{
+		BOOST_ASSERT(0 <= row && row < m_rows && 0 <= col && col < m_cols);
+		return m_data[(row << m_tile_order) + col];
+	}
+
+	/** the number of cells between two successive rows */
+	size_t get_stride() const { return size_t(1) << m_tile_order; }
+
+	/** the tile position in the image */
+	int get_start_row() const { return m_start_row; }
+	int get_start_col() const { return m_start_col; }
+
+	/** the valid rows and cols of the tile */
+	int get_rows() const { return m_rows; }
+	int get_cols() const { return m_cols; }
+
+	int get_tile_order() const { return m_tile_order; }
+
+	bool is_pinned() const { return m_pinned; }
+
+private:
+	template<typename U, unsigned memory_usage, typename IndexMethod>
+	friend class BlockwiseImage;
+
+	int m_start_row, m_start_col;
+	int m_rows, m_cols;
+	int m_tile_order;
+	bool m_pinned;
+
+	/** the row-major tile data */
+	std::vector<T> m_data;
+
+	/**
+	 * the cells of the index span [m_span_front, m_span_front + m_span.size()) that covers the tile,
+	 * empty if the tile is not in a short span (then the cells are accessed one by one)
+	 */
+	std::vector<T> m_span;
+	IndexMethodInterface::IndexType m_span_front;
+
+	/** the index ranges of the tile */
+	std::vector<IndexMethodInterface::IndexRange> m_ranges;
+};
+
+#endif
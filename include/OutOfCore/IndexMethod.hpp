@@ -2,8 +2,11 @@
 #define _INDEX_METHOD_HPP
 
 #include "IndexMethodInterface.h"
+#include "ZOrderKernel.h"
 #include <cmath>
 #include <boost/assert.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/lexical_cast.hpp>
 
 class Block2DIndex : public IndexMethodInterface
 {
@@ -101,6 +104,54 @@ public:
 		return std::string("Block2DIndex");
 	}
 
+	virtual std::string get_index_method_para() const
+	{
+		return boost::lexical_cast<std::string>(m_blockRowSize) + "," + boost::lexical_cast<std::string>(m_blockColSize);
+	}
+
+	virtual void get_index_ranges(RowMajorIndexType start_row, RowMajorIndexType start_col,
+		RowMajorIndexType rows, RowMajorIndexType cols, std::vector<IndexRange> &ranges) const
+	{
+		ranges.clear();
+		if(rows == 0 || cols == 0) return;
+
+		const IndexType end_row = start_row + rows, end_col = start_col + cols;
+
+		/* the blocks are in row-major order, and the cells in each block are in row-major order too */
+		for(IndexType bx = (start_row >> m_blockRowSize); bx <= ((end_row - 1) >> m_blockRowSize); ++bx) {
+			IndexType block_row = (bx << m_blockRowSize);
+			IndexType dx_front = std::max<IndexType>(start_row, block_row) - block_row;
+			IndexType dx_tail = std::min<IndexType>(end_row, block_row + (ONE << m_blockRowSize)) - block_row;
+
+			for(IndexType by = (start_col >> m_blockColSize); by <= ((end_col - 1) >> m_blockColSize); ++by) {
+				IndexType block_col = (by << m_blockColSize);
+				IndexType dy_front = std::max<IndexType>(start_col, block_col) - block_col;
+				IndexType dy_tail = std::min<IndexType>(end_col, block_col + (ONE << m_blockColSize)) - block_col;
+
+				IndexType block_index = (bx*m_blockColCount + by) << m_blockTotalSize;
+
+				/* the whole block row is covered, so the covered rows of the block are successive */
+				if(dy_tail - dy_front == (ONE << m_blockColSize)) {
+					push_index_range(ranges, block_index + (dx_front << m_blockColSize), 
+						block_index + (dx_tail << m_blockColSize));
+					continue;
+				}
+
+				for(IndexType dx = dx_front; dx < dx_tail; ++dx) {
+					push_index_range(ranges, block_index + (dx << m_blockColSize) + dy_front, 
+						block_index + (dx << m_blockColSize) + dy_tail);
+				}
+			}
+		}
+	}
+
+	/* the block of the scaled image is not successive any more, so only the full size level is supported */
+	virtual boost::shared_ptr<IndexMethodInterface> get_level_index_method(size_t level) const
+	{
+		if(level != 0) return boost::shared_ptr<IndexMethodInterface>();
+		return boost::make_shared<Block2DIndex>(*this);
+	}
+
 /* specific method */
 public:
 	IndexType getBlockRowCount() const { return m_blockRowCount; }
@@ -110,6 +161,65 @@ public:
 	IndexType getBlockColSize() const { return (ONE << m_blockColSize); }
 };
 
+/**
+ *	@brief the index ranges of the rectangle for the index method in the zorder (ZOrderIndex, ZOrderIndexIntuition),
+ *	the quadrants of the zorder are successive index ranges. The get_index of the encoder is called without 
+ *	the virtual dispatch.
+ */
+template<typename ZOrderEncoder>
+class ZOrderQuadrantRanges
+{
+	typedef IndexMethodInterface::IndexType IndexType;
+	typedef IndexMethodInterface::RowMajorIndexType RowMajorIndexType;
+	typedef IndexMethodInterface::IndexRange IndexRange;
+
+public:
+	static void get_index_ranges(const ZOrderEncoder &encoder, RowMajorIndexType start_row, RowMajorIndexType start_col,
+		RowMajorIndexType rows, RowMajorIndexType cols, std::vector<IndexRange> &ranges)
+	{
+		ranges.clear();
+		if(rows == 0 || cols == 0) return;
+
+		/* find the smallest quadrant that contains the whole rectangle */
+		RowMajorIndexType max_coord = std::max(start_row + rows, start_col + cols) - 1;
+		int level = 0;
+		while(max_coord >> level) ++level;
+
+		get_quadrant_ranges(encoder, 0, 0, level, start_row, start_col, start_row + rows, start_col + cols, ranges);
+	}
+
+private:
+
+	/*
+	 *	@brief : descend the quadrant (quad_row, quad_col) whose size is 2^level, the quadrant that is inside
+	 *	the rectangle [start_row, end_row) x [start_col, end_col) is just one successive index range
+	 */
+	static void get_quadrant_ranges(const ZOrderEncoder &encoder, RowMajorIndexType quad_row, RowMajorIndexType quad_col,
+		int level, RowMajorIndexType start_row, RowMajorIndexType start_col, RowMajorIndexType end_row, 
+		RowMajorIndexType end_col, std::vector<IndexRange> &ranges)
+	{
+		RowMajorIndexType front_row = (quad_row << level), tail_row = ((quad_row + 1) << level);
+		RowMajorIndexType front_col = (quad_col << level), tail_col = ((quad_col + 1) << level);
+
+		/* the quadrant is outside of the rectangle */
+		if(tail_row <= start_row || front_row >= end_row || tail_col <= start_col || front_col >= end_col)
+			return;
+
+		/* the quadrant is inside of the rectangle */
+		if(front_row >= start_row && tail_row <= end_row && front_col >= start_col && tail_col <= end_col) {
+			IndexType front = (encoder.ZOrderEncoder::get_index(quad_row, quad_col) << (2*level));
+			IndexMethodInterface::push_index_range(ranges, front, front + (IndexType(1) << (2*level)));
+			return;
+		}
+
+		/* visit the four sub quadrants in the zorder : top-left, top-right, bottom-left, bottom-right */
+		for(int i = 0; i < 4; ++i) {
+			get_quadrant_ranges(encoder, (quad_row << 1) | (i >> 1), (quad_col << 1) | (i & 1), level - 1,
+				start_row, start_col, end_row, end_col, ranges);
+		}
+	}
+};
+
 class ZOrderIndexIntuition : public IndexMethodInterface
 {
 private:
@@ -235,127 +345,463 @@ public:
 	{
 		return std::string("ZOrderIndexIntuition");
 	}
+
+	virtual boost::shared_ptr<IndexMethodInterface> get_level_index_method(size_t level) const
+	{
+		return boost::make_shared<ZOrderIndexIntuition>((m_row + (ONE << level) - 1) >> level, 
+			(m_col + (ONE << level) - 1) >> level);
+	}
+
+	/* the same zorder as ZOrderIndex, so the ranges are found by the quadrants */
+	virtual void get_index_ranges(RowMajorIndexType start_row, RowMajorIndexType start_col,
+		RowMajorIndexType rows, RowMajorIndexType cols, std::vector<IndexRange> &ranges) const
+	{
+		ZOrderQuadrantRanges<ZOrderIndexIntuition>::get_index_ranges(*this, start_row, start_col, rows, cols, ranges);
+	}
 };
 
 class ZOrderIndex : public IndexMethodInterface
 {
 private:
 	const IndexType ONE;
-	IndexType *markAll;
 	IndexType m_row, m_col;
 
+	/* whether using the bmi2 (pdep/pext) and avx2 kernel, decided by the cpuid at runtime */
+	const bool m_bmi2;
+	const bool m_avx2;
+
 public:
 	/**
 	 *	@param row_size the row size of the image
 	 *	@param col_size the col size of the image
 	 */
 	ZOrderIndex(RowMajorIndexType row_size, RowMajorIndexType col_size)
-		: ONE(1) , m_row(row_size), m_col(col_size)
+		: ONE(1) , m_row(row_size), m_col(col_size), m_bmi2(cpu_support_bmi2()), m_avx2(cpu_support_avx2())
 	{
-		init();
 	}
-	virtual ~ZOrderIndex() { release(); }
 
 private:
 
 	/*
-	 *	@brief : init the markEven, markOdd, markAll array for boost the calculation
+	 *	@brief : move the lower 32 bit of the number into the even bits
 	 */
-	void init() {
-		int bitSize = 8*sizeof(IndexType);
+	ulonglong spread_bits(ulonglong x) const {
+#ifdef ZORDER_KERNEL_HAS_BMI2
+		if(m_bmi2) return zorder_spread_bits_bmi2(x);
+#endif
+		return zorder_spread_bits(x);
+	}
 
-		markAll = new IndexType[bitSize];
+public:
+	virtual IndexType get_row_result(RowMajorIndexType row_index) const {
+		return (IndexType)(spread_bits(row_index) << 1);
+	}
 
-		IndexType bitAll = 1;
-		for(int i = 0; i < bitSize; ++i) {
-			markAll[i] = bitAll;
-			bitAll <<= 1;
+	virtual IndexType get_index_by_row_result(IndexType row_result, RowMajorIndexType col_index) const {
+		return (IndexType)(spread_bits(col_index)) | row_result;
+	}
+
+	virtual void get_row_indexes(RowMajorIndexType row_index, RowMajorIndexType col_begin, RowMajorIndexType col_end,
+		IndexType *indexes) const {
+		if(col_end > col_begin) 
+			fill_row_indexes(ZOrderIndex::get_row_result(row_index), col_begin, col_end - col_begin, indexes);
+	}
+
+	/**
+	 *	@brief fill the indexes of count successive cols from col_begin, each index is (row_bits | spread col bits).
+	 *	@param row_bits the row result, or any bits that are not overlapped with the col bits
+	 */
+	void fill_row_indexes(IndexType row_bits, RowMajorIndexType col_begin, size_t count, IndexType *indexes) const {
+#ifdef ZORDER_KERNEL_HAS_AVX2
+		if(m_avx2) {
+			zorder_row_indexes_avx2(row_bits, col_begin, count, indexes);
+			return;
 		}
+#endif
+		zorder_row_indexes(row_bits, col_begin, count, indexes);
 	}
 
-	void release() {
-		delete []markAll;
+	virtual IndexType get_index(RowMajorIndexType row_index, RowMajorIndexType col_index) const {
+		//move the lower 32 bit of row_index and col_index into a interleaving bit result
+		//must ensure the row_index and col_index is less than 2^32 - 1, actually thus reasonable
+		return (IndexType)(spread_bits(col_index) | (spread_bits(row_index) << 1));
+	}
+
+	virtual RowMajorPoint get_origin_index(IndexType index) const {
+#ifdef ZORDER_KERNEL_HAS_BMI2
+		if(m_bmi2) {
+			ulonglong row, col;
+			zorder_decode_bmi2(index, row, col);
+			return RowMajorPoint(row, col);
+		}
+#endif
+		return RowMajorPoint(zorder_compact_bits((ulonglong)(index) >> 1), zorder_compact_bits(index));
+	}
+
+	virtual IndexType get_max_index() const
+	{
+		return get_index(m_row - 1, m_col - 1);
+	}
+
+	virtual std::string get_index_method_name() const
+	{
+		return std::string("ZOrderIndex");
+	}
+
+	/* the zorder index of the scaled (row, col) is just the index / 4^level */
+	virtual boost::shared_ptr<IndexMethodInterface> get_level_index_method(size_t level) const
+	{
+		return boost::make_shared<ZOrderIndex>((m_row + (ONE << level) - 1) >> level, 
+			(m_col + (ONE << level) - 1) >> level);
 	}
 
+	virtual void get_index_ranges(RowMajorIndexType start_row, RowMajorIndexType start_col,
+		RowMajorIndexType rows, RowMajorIndexType cols, std::vector<IndexRange> &ranges) const
+	{
+		ZOrderQuadrantRanges<ZOrderIndex>::get_index_ranges(*this, start_row, start_col, rows, cols, ranges);
+	}
+};
+
+class HilbertIndex : public IndexMethodInterface
+{
+private:
+	const IndexType ONE;
+	IndexType m_row, m_col;
+
+	/* the curve fills the square of size 2^m_order, which contains the whole image */
+	int m_order;
+
+	/* the maximum index of the cells inside the image */
+	IndexType m_max_index;
+
 public:
-	virtual IndexType get_row_result(RowMajorIndexType row_index) const {
-		static const IndexType B[] = {0x5555555555555555, 0x3333333333333333,
-			0x0F0F0F0F0F0F0F0F, 0x00FF00FF00FF00FF, 0x0000FFFF0000FFFF};
-		static const IndexType S[] = {1, 2, 4, 8, 16};
+	/**
+	 *	@param row_size the row size of the image
+	 *	@param col_size the col size of the image
+	 */
+	HilbertIndex(RowMajorIndexType row_size, RowMajorIndexType col_size)
+		: ONE(1), m_row(row_size), m_col(col_size), m_order(0), m_max_index(0)
+	{
+		while((ONE << m_order) < (IndexType)(std::max(row_size, col_size))) ++m_order;
 
-		IndexType y = row_index;
+		/* the square is padded, so the maximum index is the tail of the last range of the whole image */
+		std::vector<IndexRange> ranges;
+		HilbertIndex::get_index_ranges(0, 0, row_size, col_size, ranges);
+		if(!ranges.empty()) m_max_index = ranges.back().tail - 1;
+	}
 
-		y = (y | (y << S[4])) & B[4];
-		y = (y | (y << S[3])) & B[3];
-		y = (y | (y << S[2])) & B[2];
-		y = (y | (y << S[1])) & B[1];
-		y = (y | (y << S[0])) & B[0];
+private:
 
-		return (y << 1);
+	/*
+	 *	@brief : rotate the quadrant to the standard orientation of the curve
+	 */
+	static void rotate(IndexType mask, IndexType &x, IndexType &y, IndexType rx, IndexType ry) {
+		if(ry == 0) {
+			if(rx == 1) {
+				x = mask - x;
+				y = mask - y;
+			}
+			std::swap(x, y);
+		}
+	}
+
+public:
+
+	/* the hilbert index can't be separated by row and col, so the row result just keeps the row */
+	virtual IndexType get_row_result(RowMajorIndexType row_index) const {
+		return row_index;
 	}
 
 	virtual IndexType get_index_by_row_result(IndexType row_result, RowMajorIndexType col_index) const {
-		static const IndexType B[] = {0x5555555555555555, 0x3333333333333333,
-			0x0F0F0F0F0F0F0F0F, 0x00FF00FF00FF00FF, 0x0000FFFF0000FFFF};
-		static const IndexType S[] = {1, 2, 4, 8, 16};
+		return HilbertIndex::get_index(row_result, col_index);
+	}
 
-		IndexType x = col_index;
+	virtual IndexType get_index(RowMajorIndexType row_index, RowMajorIndexType col_index) const {
+		const IndexType mask = (ONE << m_order) - 1;
+		IndexType x = col_index, y = row_index, index = 0;
+
+		for(IndexType s = ((ONE << m_order) >> 1); s > 0; s >>= 1) {
+			IndexType rx = (x & s) ? 1 : 0;
+			IndexType ry = (y & s) ? 1 : 0;
+			index += s * s * ((3 * rx) ^ ry);
+			rotate(mask, x, y, rx, ry);
+		}
+		return index;
+	}
 
-		x = (x | (x << S[4])) & B[4];
-		x = (x | (x << S[3])) & B[3];
-		x = (x | (x << S[2])) & B[2];
-		x = (x | (x << S[1])) & B[1];
-		x = (x | (x << S[0])) & B[0];
+	virtual RowMajorPoint get_origin_index(IndexType index) const {
+		IndexType x = 0, y = 0;
+
+		for(IndexType s = 1; s < (ONE << m_order); s <<= 1) {
+			IndexType rx = 1 & (index >> 1);
+			IndexType ry = 1 & (index ^ rx);
+			rotate(s - 1, x, y, rx, ry);
+			x += s * rx;
+			y += s * ry;
+			index >>= 2;
+		}
+		return RowMajorPoint(y, x);
+	}
 
-		return (x | row_result);
+	virtual IndexType get_max_index() const
+	{
+		return m_max_index;
 	}
 
-	virtual IndexType get_index(RowMajorIndexType row_index, RowMajorIndexType col_index) const {
-		static const IndexType B[] = {0x5555555555555555, 0x3333333333333333,
-			0x0F0F0F0F0F0F0F0F, 0x00FF00FF00FF00FF, 0x0000FFFF0000FFFF};
-		static const IndexType S[] = {1, 2, 4, 8, 16};
+	virtual std::string get_index_method_name() const
+	{
+		return std::string("HilbertIndex");
+	}
 
-		//move the lower 32 bit of row_index and col_index into a interleaving bit result
-		//must ensure the row_index and col_index is less than 2^32 - 1, actually thus reasonable
-		IndexType x = col_index;
-		IndexType y = row_index;
+	virtual void get_index_ranges(RowMajorIndexType start_row, RowMajorIndexType start_col,
+		RowMajorIndexType rows, RowMajorIndexType cols, std::vector<IndexRange> &ranges) const
+	{
+		ranges.clear();
+		if(rows == 0 || cols == 0) return;
 
-		x = (x | (x << S[4])) & B[4];
-		x = (x | (x << S[3])) & B[3];
-		x = (x | (x << S[2])) & B[2];
-		x = (x | (x << S[1])) & B[1];
-		x = (x | (x << S[0])) & B[0];
+		get_quadrant_ranges(0, 0, m_order, start_row, start_col, start_row + rows, start_col + cols, ranges);
+	}
 
-		y = (y | (y << S[4])) & B[4];
-		y = (y | (y << S[3])) & B[3];
-		y = (y | (y << S[2])) & B[2];
-		y = (y | (y << S[1])) & B[1];
-		y = (y | (y << S[0])) & B[0];
+	/* 
+	 * the curve of the scaled image visits the 2^level squares in the same order with the full size curve,
+	 * and the square size of the scaled image is just 2^(m_order - level)
+	 */
+	virtual boost::shared_ptr<IndexMethodInterface> get_level_index_method(size_t level) const
+	{
+		boost::shared_ptr<HilbertIndex> level_method = boost::make_shared<HilbertIndex>(
+			(m_row + (ONE << level) - 1) >> level, (m_col + (ONE << level) - 1) >> level);
 
-		return (x | (y << 1));
+		BOOST_ASSERT(level_method->m_order == std::max<int>(m_order - (int)(level), 0));
+		return level_method;
 	}
 
-	virtual RowMajorPoint get_origin_index(IndexType index) const {
-		size_t row = 0, col = 0;
-		IndexType loc = 0;
-		while(index) {
-			if(index & ONE)	col |= markAll[loc];
-			if((index >>= 1) & ONE)	row |= markAll[loc];
-			index >>= 1;
-			++loc;
+private:
+
+	/*
+	 *	@brief : descend the quadrant (quad_row, quad_col) whose size is 2^level, the quadrant that is inside
+	 *	the rectangle [start_row, end_row) x [start_col, end_col) is just one successive index range
+	 */
+	void get_quadrant_ranges(RowMajorIndexType quad_row, RowMajorIndexType quad_col, int level,
+		RowMajorIndexType start_row, RowMajorIndexType start_col, RowMajorIndexType end_row, RowMajorIndexType end_col,
+		std::vector<IndexRange> &ranges) const
+	{
+		RowMajorIndexType front_row = (quad_row << level), tail_row = ((quad_row + 1) << level);
+		RowMajorIndexType front_col = (quad_col << level), tail_col = ((quad_col + 1) << level);
+
+		/* the quadrant is outside of the rectangle */
+		if(tail_row <= start_row || front_row >= end_row || tail_col <= start_col || front_col >= end_col)
+			return;
+
+		/* the quadrant is inside of the rectangle, its cells are the 4^level aligned index range */
+		if(front_row >= start_row && tail_row <= end_row && front_col >= start_col && tail_col <= end_col) {
+			IndexType front = (HilbertIndex::get_index(front_row, front_col) >> (2*level)) << (2*level);
+			push_index_range(ranges, front, front + (ONE << (2*level)));
+			return;
 		}
-		return RowMajorPoint(row, col);
+
+		/* the visiting order of the four sub quadrants depends on the orientation of the curve */
+		IndexType sub_fronts[4];
+		int sub_order[4];
+		for(int i = 0; i < 4; ++i) {
+			RowMajorIndexType sub_row = (quad_row << 1) | (i >> 1), sub_col = (quad_col << 1) | (i & 1);
+			sub_fronts[i] = HilbertIndex::get_index(sub_row << (level - 1), sub_col << (level - 1)) >> (2*(level - 1));
+
+			/* insert sort by the front index */
+			int k = i;
+			for(; k > 0 && sub_fronts[sub_order[k - 1]] > sub_fronts[i]; --k) sub_order[k] = sub_order[k - 1];
+			sub_order[k] = i;
+		}
+
+		for(int i = 0; i < 4; ++i) {
+			get_quadrant_ranges((quad_row << 1) | (sub_order[i] >> 1), (quad_col << 1) | (sub_order[i] & 1), level - 1,
+				start_row, start_col, end_row, end_col, ranges);
+		}
+	}
+};
+
+/**
+ * @class TiledZOrderIndex
+ *
+ * @brief the image is divided into 2^n x 2^n tiles, the tiles are in the row-major order, 
+ * and the cells inside each tile are in the zorder.
+ *
+ * The zorder index pads the image into the square of 2^m x 2^m, so the maximum index of a non power of two image 
+ * is much bigger than the cell number. The tiled zorder only pads the tiles on the right and bottom border, 
+ * so the image container and the image files are nearly as big as the image itself. The hierarchical levels 
+ * are supported till the tile order, since the 4^k aligned index ranges are the 2^k aligned squares only inside the tile.
+ */
+class TiledZOrderIndex : public IndexMethodInterface
+{
+private:
+	const IndexType ONE;
+	IndexType m_row, m_col;
+
+	/* the tile size is 2^m_tile_order */
+	int m_tile_order;
+	IndexType m_tile_mask;
+
+	/* the count of tiles along the row and col */
+	IndexType m_tile_rows, m_tile_cols;
+
+	/* the zorder index inside of one tile */
+	ZOrderIndex m_tile_index;
+
+public:
+	/**
+	 *	@param row_size the row size of the image
+	 *	@param col_size the col size of the image
+	 *	@param tile_order the tile size is 2^tile_order, it is reduced if the image is smaller than the tile.
+	 *	By default, the tile has 1M cells which is the default file node size
+	 */
+	TiledZOrderIndex(RowMajorIndexType row_size, RowMajorIndexType col_size, int tile_order = 10)
+		: ONE(1), m_row(row_size), m_col(col_size), m_tile_order(fit_tile_order(row_size, col_size, tile_order)),
+		m_tile_mask((ONE << m_tile_order) - 1), m_tile_index(ONE << m_tile_order, ONE << m_tile_order)
+	{
+		m_tile_rows = (m_row + m_tile_mask) >> m_tile_order;
+		m_tile_cols = (m_col + m_tile_mask) >> m_tile_order;
+	}
+
+	/* the tile order may be less than the constructed one for the small image */
+	int get_tile_order() const { return m_tile_order; }
+
+private:
+	/* the tile doesn't need to be bigger than the whole image */
+	static int fit_tile_order(RowMajorIndexType row_size, RowMajorIndexType col_size, int tile_order) {
+		BOOST_ASSERT(tile_order >= 0 && tile_order < 32);
+		int order = 0;
+		while(order < tile_order && ((IndexType)(1) << order) < (IndexType)(std::max(row_size, col_size))) ++order;
+		return order;
+	}
+
+public:
+	virtual IndexType get_row_result(RowMajorIndexType row_index) const {
+		return (((row_index >> m_tile_order) * m_tile_cols) << (2*m_tile_order)) 
+			+ m_tile_index.ZOrderIndex::get_row_result(row_index & m_tile_mask);
+	}
+
+	virtual IndexType get_index_by_row_result(IndexType row_result, RowMajorIndexType col_index) const {
+		return row_result + (((IndexType)(col_index) >> m_tile_order) << (2*m_tile_order))
+			+ m_tile_index.ZOrderIndex::get_index_by_row_result(0, col_index & m_tile_mask);
+	}
+
+	virtual IndexType get_index(RowMajorIndexType row_index, RowMajorIndexType col_index) const {
+		return TiledZOrderIndex::get_index_by_row_result(TiledZOrderIndex::get_row_result(row_index), col_index);
+	}
+
+	/* the cols of each tile are filled by the zorder kernel with the tile offset as the row bits */
+	virtual void get_row_indexes(RowMajorIndexType row_index, RowMajorIndexType col_begin, RowMajorIndexType col_end,
+		IndexType *indexes) const {
+		IndexType row_result = TiledZOrderIndex::get_row_result(row_index);
+
+		for(RowMajorIndexType col = col_begin; col < col_end;) {
+			IndexType tile_col = (col >> m_tile_order);
+			RowMajorIndexType tail_col = std::min<RowMajorIndexType>(col_end, (tile_col + 1) << m_tile_order);
+
+			m_tile_index.fill_row_indexes(row_result + (tile_col << (2*m_tile_order)), col & m_tile_mask, 
+				tail_col - col, indexes + (col - col_begin));
+			col = tail_col;
+		}
+	}
+
+	virtual RowMajorPoint get_origin_index(IndexType index) const {
+		IndexType tile = (index >> (2*m_tile_order));
+		RowMajorPoint point = m_tile_index.ZOrderIndex::get_origin_index(index & ((ONE << (2*m_tile_order)) - 1));
+		point.row += (tile / m_tile_cols) << m_tile_order;
+		point.col += (tile % m_tile_cols) << m_tile_order;
+		return point;
 	}
 
+	/* the zorder is monotone along the row and col, so the last cell of the last tile has the maximum index */
 	virtual IndexType get_max_index() const
 	{
-		return get_index(m_row - 1, m_col - 1);
+		return TiledZOrderIndex::get_index(m_row - 1, m_col - 1);
 	}
 
 	virtual std::string get_index_method_name() const
 	{
-		return std::string("ZOrderIndex");
+		return std::string("TiledZOrderIndex");
+	}
+
+	virtual std::string get_index_method_para() const
+	{
+		return boost::lexical_cast<std::string>(m_tile_order);
+	}
+
+	/* the level image has the same tiles, each is 2^level smaller */
+	virtual boost::shared_ptr<IndexMethodInterface> get_level_index_method(size_t level) const
+	{
+		if(level > (size_t)(m_tile_order)) return boost::shared_ptr<IndexMethodInterface>();
+
+		return boost::make_shared<TiledZOrderIndex>((m_row + (ONE << level) - 1) >> level, 
+			(m_col + (ONE << level) - 1) >> level, m_tile_order - (int)(level));
+	}
+
+	virtual void get_index_ranges(RowMajorIndexType start_row, RowMajorIndexType start_col,
+		RowMajorIndexType rows, RowMajorIndexType cols, std::vector<IndexRange> &ranges) const
+	{
+		ranges.clear();
+		if(rows == 0 || cols == 0) return;
+
+		RowMajorIndexType end_row = start_row + rows, end_col = start_col + cols;
+		std::vector<IndexRange> tile_ranges;
+
+		/* the tiles are visited in the row-major order, thus the index order */
+		for(RowMajorIndexType tile_row = (start_row >> m_tile_order); tile_row <= ((end_row - 1) >> m_tile_order); ++tile_row) {
+			RowMajorIndexType tile_front_row = (tile_row << m_tile_order);
+			RowMajorIndexType front_row = std::max(start_row, tile_front_row);
+			RowMajorIndexType tail_row = std::min<RowMajorIndexType>(end_row, tile_front_row + (ONE << m_tile_order));
+
+			for(RowMajorIndexType tile_col = (start_col >> m_tile_order); tile_col <= ((end_col - 1) >> m_tile_order); ++tile_col) {
+				RowMajorIndexType tile_front_col = (tile_col << m_tile_order);
+				RowMajorIndexType front_col = std::max(start_col, tile_front_col);
+				RowMajorIndexType tail_col = std::min<RowMajorIndexType>(end_col, tile_front_col + (ONE << m_tile_order));
+
+				IndexType tile_offset = ((tile_row * m_tile_cols + tile_col) << (2*m_tile_order));
+				m_tile_index.get_index_ranges(front_row - tile_front_row, front_col - tile_front_col, 
+					tail_row - front_row, tail_col - front_col, tile_ranges);
+
+				for(std::vector<IndexRange>::const_iterator ite = tile_ranges.begin(); ite != tile_ranges.end(); ++ite)
+					push_index_range(ranges, tile_offset + ite->front, tile_offset + ite->tail);
+			}
+		}
 	}
 };
 
-#endif
\ No newline at end of file
+/**
+ *	@brief create the index method object by the name that comes from get_index_method_name().
+ *	@param name the index method name
+ *	@param rows the row size of the image
+ *	@param cols the col size of the image
+ *	@param para the parameters that come from get_index_method_para()
+ *	@return the index method object, or null if the name or the parameters are not correct
+ */
+inline boost::shared_ptr<IndexMethodInterface> create_index_method(const std::string &name,
+	IndexMethodInterface::RowMajorIndexType rows, IndexMethodInterface::RowMajorIndexType cols,
+	const std::string &para = std::string())
+{
+	typedef boost::shared_ptr<IndexMethodInterface> PtrType;
+
+	try {
+		if(name == "ZOrderIndex") {
+			return boost::make_shared<ZOrderIndex>(rows, cols);
+		} else if(name == "ZOrderIndexIntuition") {
+			return boost::make_shared<ZOrderIndexIntuition>(rows, cols);
+		} else if(name == "HilbertIndex") {
+			return boost::make_shared<HilbertIndex>(rows, cols);
+		} else if(name == "TiledZOrderIndex") {
+			if(para.empty()) return boost::make_shared<TiledZOrderIndex>(rows, cols);
+			return boost::make_shared<TiledZOrderIndex>(rows, cols, boost::lexical_cast<int>(para));
+		} else if(name == "Block2DIndex") {
+			std::string::size_type index = para.find(',');
+			if(index == std::string::npos) return PtrType();
+			return boost::make_shared<Block2DIndex>(rows, cols, boost::lexical_cast<IndexMethodInterface::IndexType>(para.substr(0, index)),
+				boost::lexical_cast<IndexMethodInterface::IndexType>(para.substr(index+1)));
+		}
+	} catch(boost::bad_lexical_cast &) {
+		return PtrType();
+	}
+
+	return PtrType();
+}
+
+#endif
@@ -3,6 +3,9 @@
 
 #include "BasicType.h"
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <boost/shared_ptr.hpp>
 
 /**
  * @class IndexMethodInterface	IndexMethodInterface.h
@@ -20,6 +23,19 @@ public:
 	/** the type of row-major like index */
 	typedef size_t RowMajorIndexType;
 
+	/**
+	 * @struct IndexRange
+	 *
+	 * @brief a range of the successive index in the format [front, tail)
+	 */
+	struct IndexRange
+	{
+		IndexRange(IndexType _front = 0, IndexType _tail = 0) : front(_front), tail(_tail) {}
+
+		IndexType front;
+		IndexType tail;
+	};
+
 public:
 
 	/**
@@ -61,6 +77,23 @@ public:
 	 */
 	virtual IndexType get_index_by_row_result(IndexType row_result, RowMajorIndexType col_index) const = 0;
 
+	/**
+	 *	@brief get the indexes of the cols [col_begin, col_end) in one row, which is the batch version of 
+	 *	get_row_result() and get_index_by_row_result(), so the whole scanline costs one virtual call.
+	 *	@param row_index the index of row in the row-major format
+	 *	@param col_begin the first col
+	 *	@param col_end the end col (not included)
+	 *	@param indexes [Out] the index array that has (col_end - col_begin) elements at least
+	 */
+	virtual void get_row_indexes(RowMajorIndexType row_index, RowMajorIndexType col_begin, RowMajorIndexType col_end,
+		IndexType *indexes) const
+	{
+		IndexType row_result = get_row_result(row_index);
+		for(RowMajorIndexType col = col_begin; col < col_end; ++col) {
+			*indexes++ = get_index_by_row_result(row_result, col);
+		}
+	}
+
 	/**
 	 *	@brief get the maximum index, often used to ensure the size of the container
 	 *	@return the maximum index get from the this indexing method
@@ -71,6 +104,79 @@ public:
 	 *	@brief get the index method name for identify different method
 	 */
 	virtual std::string get_index_method_name() const = 0;
+
+	/**
+	 *	@brief decompose the row-major rectangle into the maximal successive index ranges.
+	 *
+	 *	The ranges are sorted by the index and never adjacent to each other, so reading or writing
+	 *	the rectangle costs one sequential access per range instead of one per cell.
+	 *	The default implementation sorts the index of every cell, the derived index method
+	 *	should override it with a faster way.
+	 *
+	 *	@param start_row the left-corner point row
+	 *	@param start_col the left-corner point col
+	 *	@param rows the row scope of the rectangle, thus the rows is [start_row, start_row + rows)
+	 *	@param cols the col scope of the rectangle
+	 *	@param ranges [Out] the successive index ranges in format [front, tail)
+	 */
+	virtual void get_index_ranges(RowMajorIndexType start_row, RowMajorIndexType start_col,
+		RowMajorIndexType rows, RowMajorIndexType cols, std::vector<IndexRange> &ranges) const
+	{
+		ranges.clear();
+
+		std::vector<IndexType> index_vector;
+		index_vector.reserve(rows*cols);
+		for(RowMajorIndexType row = start_row; row < start_row + rows; ++row) {
+			IndexType row_result = get_row_result(row);
+			for(RowMajorIndexType col = start_col; col < start_col + cols; ++col) {
+				index_vector.push_back(get_index_by_row_result(row_result, col));
+			}
+		}
+		std::sort(index_vector.begin(), index_vector.end());
+
+		for(size_t i = 0; i < index_vector.size(); ++i) {
+			push_index_range(ranges, index_vector[i], index_vector[i] + 1);
+		}
+	}
+
+	/**
+	 *	@brief get the construction parameters besides the image size, which are saved in the image head file
+	 *	together with the index method name, so the reader can create the same index method.
+	 *	@return the parameters separated by ',', empty if the index method only needs the image size
+	 */
+	virtual std::string get_index_method_para() const
+	{
+		return std::string();
+	}
+
+	/**
+	 *	@brief get the index method of the scaled image in the specific hierarchical level.
+	 *
+	 *	The hierarchical image averages the 4^level successive cells beginning from the multiply of 4^level
+	 *	into the level image (at the position index / 4^level), so the index method must make sure these cells 
+	 *	are one aligned 2^level x 2^level square, and the level cell is indexed by the returned method with 
+	 *	the scaled (row, col).
+	 *
+	 *	@param level the hierarchical level, 0 means the full size image
+	 *	@return the index method of the level image, or null if the level is not supported
+	 */
+	virtual boost::shared_ptr<IndexMethodInterface> get_level_index_method(size_t /*level*/) const
+	{
+		return boost::shared_ptr<IndexMethodInterface>();
+	}
+
+	/**
+	 *	@brief append the range [front, tail) into the sorted ranges, merge it with the last range 
+	 *	if they are successive
+	 */
+	static void push_index_range(std::vector<IndexRange> &ranges, IndexType front, IndexType tail)
+	{
+		if(!ranges.empty() && ranges.back().tail == front) {
+			ranges.back().tail = tail;
+		} else {
+			ranges.push_back(IndexRange(front, tail));
+		}
+	}
 };
 
 /**
@@ -0,0 +1,106 @@
+#ifndef _INDEX_POLICY_H
+#define _INDEX_POLICY_H
+
+#include "IndexMethod.hpp"
+
+/**
+ * @class IndexPolicy IndexPolicy.h
+ *
+ * @brief The compile-time index policy used by the image containers to compute the cell index.
+ *
+ * The container keeps the index method as a IndexMethodInterface object, but when the actual type
+ * of the index method is known at compile time, the policy calls the member function with the
+ * qualified name, so there is no virtual dispatch and the index computing can be inlined in the loop.
+ * The IndexMethodInterface specialization keeps the runtime polymorphic way.
+ *
+ * @tparam IndexMethod The actual type of the index method, which must be constructed by (rows, cols)
+ */
+
+template<typename IndexMethod>
+struct IndexPolicy
+{
+	typedef IndexMethodInterface::IndexType IndexType;
+	typedef IndexMethodInterface::RowMajorIndexType RowMajorIndexType;
+
+	/**
+	 *	@brief create the default index method object for the image size
+	 */
+	static boost::shared_ptr<IndexMethodInterface> create(RowMajorIndexType rows, RowMajorIndexType cols)
+	{
+		return boost::make_shared<IndexMethod>(rows, cols);
+	}
+
+	/**
+	 *	@brief checks whether the index method object is the type of the policy
+	 */
+	static bool is_valid(const IndexMethodInterface *method)
+	{
+		return dynamic_cast<const IndexMethod*>(method) != NULL;
+	}
+
+	static IndexType get_index(const IndexMethodInterface &method, RowMajorIndexType row, RowMajorIndexType col)
+	{
+		return static_cast<const IndexMethod&>(method).IndexMethod::get_index(row, col);
+	}
+
+	static IndexType get_row_result(const IndexMethodInterface &method, RowMajorIndexType row)
+	{
+		return static_cast<const IndexMethod&>(method).IndexMethod::get_row_result(row);
+	}
+
+	static IndexType get_index_by_row_result(const IndexMethodInterface &method, IndexType row_result,
+		RowMajorIndexType col)
+	{
+		return static_cast<const IndexMethod&>(method).IndexMethod::get_index_by_row_result(row_result, col);
+	}
+
+	static void get_row_indexes(const IndexMethodInterface &method, RowMajorIndexType row, RowMajorIndexType col_begin,
+		RowMajorIndexType col_end, IndexType *indexes)
+	{
+		static_cast<const IndexMethod&>(method).IndexMethod::get_row_indexes(row, col_begin, col_end, indexes);
+	}
+};
+
+/**
+ *	@brief the runtime polymorphic policy, the default index method is the zorder index
+ */
+template<>
+struct IndexPolicy<IndexMethodInterface>
+{
+	typedef IndexMethodInterface::IndexType IndexType;
+	typedef IndexMethodInterface::RowMajorIndexType RowMajorIndexType;
+
+	static boost::shared_ptr<IndexMethodInterface> create(RowMajorIndexType rows, RowMajorIndexType cols)
+	{
+		return boost::make_shared<ZOrderIndex>(rows, cols);
+	}
+
+	static bool is_valid(const IndexMethodInterface *method)
+	{
+		return method != NULL;
+	}
+
+	static IndexType get_index(const IndexMethodInterface &method, RowMajorIndexType row, RowMajorIndexType col)
+	{
+		return method.get_index(row, col);
+	}
+
+	static IndexType get_row_result(const IndexMethodInterface &method, RowMajorIndexType row)
+	{
+		return method.get_row_result(row);
+	}
+
+	static IndexType get_index_by_row_result(const IndexMethodInterface &method, IndexType row_result,
+		RowMajorIndexType col)
+	{
+		return method.get_index_by_row_result(row_result, col);
+	}
+
+	static void get_row_indexes(const IndexMethodInterface &method, RowMajorIndexType row, RowMajorIndexType col_begin,
+		RowMajorIndexType col_end, IndexType *indexes)
+	{
+		method.get_row_indexes(row, col_begin, col_end, indexes);
+	}
+};
+
+#endif
@@ -1,185 +1,452 @@
 #ifndef _LRU_HPP
-#define _LRU_HPP 
+#define _LRU_HPP
 
-#include <list>
 #include <vector>
+#include <deque>
 #include <algorithm>
 #include <iostream>
-#include <fstream>
-#include <string>
+#include <utility>
 
 #include <boost/assert.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include "ImageStorage.hpp"
+#include "ImageCacheManager.hpp"
 
 /**
  * @class ImageFileLRU Lru.hpp
  *
- * @brief Implement the saving the big image file cache in lru algorithm
- * @see DiskBigImage
+ * @brief Implement the saving the big image file cache in lru algorithm, the image files are the nodes
+ * of the ImageStorage, identified by (level, node number)
+ *
+ * The cache is keyed by the saved content of the node (NodeContentKey), so the nodes sharing one saved
+ * content are cached once. When such a node is written, its data is copied into a cache keyed by the node
+ * itself, and the storage saves it elsewhere when it is written back.
+ *
+ * The cached files are indexed by an open addressing hash table of the keys, and chained in the recency
+ * list through the slot indexes, so finding, hitting and evicting a file are O(1) and allocate nothing.
+ *
+ * Only the changed cell ranges of a file are written back if the storage can write a node partially, so a
+ * small change of a big file doesn't rewrite the whole file.
+ *
+ * The memory of the files is acquired from ImageCacheManager, which may evict the least recently used file
+ * when another cache needs the memory. The owner must lock get_mutex() while using the cached data, so
+ * several threads can share one cache.
+ * @see DiskBigImage ImageStorage ImageCacheManager
  *
  * @tparam T The type of the image cells
  */
 
 template<typename T>
-class ImageFileLRU
+class ImageFileLRU : public ImageCacheClient
 {
 private:
 	struct ValueType
 	{
-		ValueType(std::string _image_file_name, int _file_cell_numbers)
-			: image_file_name(_image_file_name), count(0)
-		{
-			image_data.resize(_file_cell_numbers);
-		}
-
-		int count;
-		std::string image_file_name;
+		ValueType()
+			: level(size_t(npos)), node_no(size_t(npos)), keyed(false), dirty(false), loading(false), pins(0), bytes(0), 
+			prev(npos), next(npos) {}
+
+		/** the node which is written back to */
+		size_t level;
+		size_t node_no;
+		/** the key of the cached content, only valid if keyed */
+		NodeContentKey key;
+		bool keyed;
+		/** whether the image data is changed and not written back */
+		bool dirty;
+		/** the changed cell ranges [first, second) in order, empty if the whole file is dirty */
+		std::vector<std::pair<size_t, size_t> > dirty_ranges;
+		/** whether the image data is being read by a thread, the slot is out of the recency list meanwhile */
+		bool loading;
+		/** the number of the pins by pin_data(), the pinned slot is out of the recency list */
+		int pins;
+		/** the cells of the file, empty after the slot is evicted by the ImageCacheManager */
 		std::vector<T> image_data;
+		/** the valid bytes of the image data, the last file of a level may be not full */
+		size_t bytes;
+		/** the neighbour slots in the recency list, the prev is more recently used, the next links the free slots */
+		int prev, next;
 	};
 
-	typedef std::vector<ValueType> DataType;
+	/** the slots never move, so growing the cache doesn't copy the image data */
+	typedef std::deque<ValueType> DataType;
 
 public:
+	/** the most ranges kept for a file, more ranges are merged into one */
+	enum { MAX_DIRTY_RANGES = 16 };
 
-
+	/**
+	 *	@param _file_cache_numbers the maximum file number, 0 means no limit except the byte budget of
+	 *	ImageCacheManager
+	 */
 	void init(int _file_cell_numbers, int _file_cache_numbers)
 	{
-		BOOST_ASSERT(_file_cache_numbers > 0);
+		BOOST_ASSERT(_file_cache_numbers >= 0);
+
+		/* write back the dirty image before dropping the cache */
+		size_t allocated_bytes = 0;
+		for(size_t i = 0; i < lru_data.size(); ++i) {
+			write_back_data(i);
+			allocated_bytes += lru_data[i].image_data.size()*sizeof(T);
+		}
+		lru_data.clear();
+		ImageCacheManager::instance().release(this, allocated_bytes);
+
 		file_cell_numbers = _file_cell_numbers;
 		file_cache_numbers = _file_cache_numbers;
 		current_used = 0;
-		b_data_dirty.resize(file_cache_numbers, false);
+		free_slot = npos;
+		most_recent = least_recent = npos;
+		keyed_number = 0;
+		hash_table.assign(16, int(npos));
 	}
 
 	/**
 	 *	@brief initialize the lru manager
 	 *	@param _file_cell_numbers the cell number in one file
 	 *	@param _file_cache_numbers the file cache number
+	 *	@param cache_group the group sharing one fair share of ImageCacheManager, NULL for the cache itself
 	 */
-	ImageFileLRU(int _file_cell_numbers = 0, int _file_cache_numbers = 16) {
+	ImageFileLRU(int _file_cell_numbers = 0, int _file_cache_numbers = 16, const void *cache_group = NULL) {
+		ImageCacheManager::instance().register_client(this, cache_group);
 		init(_file_cell_numbers, _file_cache_numbers);
 	}
 
+	/**
+	 *	@brief set the storage where the image files are read from and written back to, the cache keeps the
+	 *	storage until the dirty files are written back, even if the image is destroyed before the pinned data
+	 */
+	void set_storage(const boost::shared_ptr<ImageStorage> &_storage) {
+		storage = _storage;
+	}
+
 	~ImageFileLRU() {
+		/* the manager never evicts the cache after unregistering */
+		ImageCacheManager::instance().unregister_client(this);
+
 		/* write back the dirty image */
 		for(size_t i = 0; i < lru_data.size(); ++i) {
-			if(b_data_dirty[i] == true)
+			if(lru_data[i].dirty == true)
 				write_back_data(i);
 		}
 	}
 
 	/**
-	 *	@brief checks whether the file_name is in the file cache
+	 *	@brief the mutex guarding the cache against the eviction by ImageCacheManager
 	 */
-	bool exists(const std::string &file_name) const {
-		for(DataType::const_iterator ite = lru_data.cbegin(); ite != lru_data.cend(); ++ite) {
-			if(ite->image_file_name == file_name)
-				return true;
+	boost::mutex& get_mutex() {
+		return m_mutex;
+	}
+
+	/**
+	 *	@brief the bytes of the cached files of the level
+	 */
+	size_t get_cached_bytes(size_t level) const {
+		size_t bytes = 0;
+		for(size_t i = 0; i < lru_data.size(); ++i) {
+			if(lru_data[i].keyed && lru_data[i].level == level) bytes += lru_data[i].image_data.size()*sizeof(T);
 		}
-		return false;
+		return bytes;
+	}
+
+	/**
+	 *	@brief get the cached files (level, node_no) from the most recently used, the files being loaded or
+	 *	pinned are not included
+	 */
+	void get_recent_nodes(std::vector<std::pair<size_t, size_t> > &nodes) const {
+		nodes.clear();
+		for(int index = most_recent; index != npos; index = lru_data[index].next) {
+			if(lru_data[index].level != size_t(npos)) nodes.push_back(std::make_pair(lru_data[index].level, lru_data[index].node_no));
+		}
+	}
+
+	/**
+	 *	@brief evict the least recently used file for ImageCacheManager, unless the cache is being used
+	 */
+	virtual size_t try_evict() {
+		boost::unique_lock<boost::mutex> lock(m_mutex, boost::try_to_lock);
+		if(!lock.owns_lock() || least_recent == npos) return 0;
+
+		int index = least_recent;
+		if(!write_back_data(index)) return 0;
+		drop_key(index);
+		unlink(index);
+
+		ValueType &value = lru_data[index];
+		size_t bytes = value.image_data.size()*sizeof(T);
+		std::vector<T>().swap(value.image_data);
+		value.level = value.node_no = size_t(npos);
+		value.bytes = 0;
+		value.next = free_slot;
+		free_slot = index;
+		return bytes;
 	}
 
 	/**
-	 *	@brief find the index of the file_name in the lru manager, if not exist, return npos
+	 *	@brief checks whether the image file (level, node_no) is in the file cache
 	 */
-	int find(const std::string &file_name) const {
-		for(DataType::const_iterator ite = lru_data.cbegin(); ite != lru_data.cend(); ++ite) {
-			if(ite->image_file_name == file_name)
-				return (ite - lru_data.cbegin());
+	bool exists(size_t level, size_t node_no) {
+		return find(level, node_no) != npos;
+	}
+
+	/**
+	 *	@brief find the index of the image file (level, node_no) in the lru manager, if not exist, return npos
+	 */
+	int find(size_t level, size_t node_no) {
+		/* the node being written has its own cache */
+		int index = find(NodeContentKey::node_key(level, node_no));
+		if(index != npos || !storage) return index;
+
+		bool shared = false;
+		return find(storage->get_content_key(level, node_no, shared));
+	}
+
+	/**
+	 *	@brief find the index of the cached content, if not exist, return npos
+	 */
+	int find(const NodeContentKey &key) const {
+		for(size_t pos = hash_key(key) & (hash_table.size() - 1); ; pos = (pos + 1) & (hash_table.size() - 1)) {
+			int index = hash_table[pos];
+			if(index == npos) return npos;
+			if(lru_data[index].key == key) return index;
 		}
-		return npos;
 	}
 
 	/**
-	 *	@brief put the file_name into the lru manager, and return the index of the specific file_name in the 
-	 *	lru manager.
+	 *	@brief put the image file (level, node_no) into the lru manager, and return the index of the image file
+	 *	in the lru manager.
+	 *
+	 *	The file is read with the lock released, and the other threads missing the same file wait for
+	 *	the reading instead of reading it again. The returned index is valid until the lock is released.
+	 *	@param lock the lock of get_mutex() held by the caller
+	 *	@param for_writing whether the data will be changed by get_data(), then the cache is owned by the node
 	 *	@return the index of the image file.
 	 *	@note if fails to put the file into lru manager, the return value is ImageFileLRU::npos
 	 */
-	int put_into_lru(const std::string &file_name) {
+	int put_into_lru(boost::mutex::scoped_lock &lock, size_t level, size_t node_no, bool for_writing = false) {
 		using namespace std;
 
-		int index = find(file_name);
+		BOOST_ASSERT(storage && lock.owns_lock());
+
+		const NodeContentKey own_key = NodeContentKey::node_key(level, node_no);
+		bool shared = false;
+		NodeContentKey key = own_key;
+		int index = npos;
+		for(;;) {
+			index = find(own_key);
+			if(index == npos) {
+				key = storage->get_content_key(level, node_no, shared);
+				index = find(key);
+			}
 
-		/* value is in the lru caches, just return the index */
-		if(index != npos)	{
-			update_count(index);
-			return index;
+			/* wait for the thread reading the file */
+			if(index != npos && lru_data[index].loading) {
+				m_loaded.wait(lock);
+				continue;
+			}
+			break;
 		}
 
-		ifstream fin(file_name, ios::in | ios::binary);
-		if(!fin.is_open()) {
-			cerr << "can't open file " << file_name << endl;
-			return npos;
+		if(index != npos && lru_data[index].key == own_key) {
+			touch(index);
+			return index;
 		}
 
-		/* the data cache is not full */
-		if(current_used < file_cache_numbers) {
-			lru_data.push_back(ValueType(file_name, file_cell_numbers));
-			index = current_used++;
-		} else {		/* remove one of the last not used data in cache */
-			int max_number = -1;
-
-			/* the last number count is the most not used data */
-			for(size_t i = 0; i < file_cache_numbers; ++i) {
-				if(lru_data[i].count > max_number)	{
-					max_number = lru_data[i].count;
-					index = i;
+		if(index != npos) {
+			if(!for_writing || !shared) {
+				/* value is in the lru caches, the writer of the not shared content just takes it over */
+				if(for_writing) {
+					lru_data[index].level = level;
+					lru_data[index].node_no = node_no;
 				}
+				touch(index);
+				return index;
 			}
 
-			if(!write_back_data(index)) return npos;
+			/* copy the shared content into the cache owned by the node, or take over the only cache */
+			int shared_index = index;
+			if(file_cache_numbers != 1) {
+				index = get_free_slot(shared_index);
+				if(index == npos) return npos;
 
-			/* put the new data in the remove index, the data will be covered by the new data read from file */
-			lru_data[index].image_file_name = file_name;
+				lru_data[index].image_data = lru_data[shared_index].image_data;
+				lru_data[index].bytes = lru_data[shared_index].bytes;
+			}
+			lru_data[index].level = level;
+			lru_data[index].node_no = node_no;
+			set_key(index, own_key);
+			touch(index);
+			return index;
 		}
 
-		/* read the data into cache */
-		std::vector<T> &data = lru_data[index].image_data;
-		fin.read(reinterpret_cast<char*>(&data[0]), file_cell_numbers*sizeof(T));
-		if(!fin.eof() && fin.fail()) {
-			cerr << "read image file " << lru_data[index].image_file_name << " fails" << endl;
-			return npos;
-		}
+		index = reserve_loading_slot(level, node_no, (for_writing && shared) ? own_key : key);
+		if(index == npos) return npos;
+
+		/* read the data into cache, the slots never move so the data is safe to fill without the lock */
+		size_t read_bytes = 0;
+		lock.unlock();
+		bool success = storage->read_node(level, node_no, &lru_data[index].image_data[0], file_cell_numbers*sizeof(T), read_bytes);
+		lock.lock();
+
+		return end_loading(index, success, read_bytes) ? index : npos;
+	}
+
+	/**
+	 *	@brief reserve a slot for the image file (level, node_no) which is read by the caller, so several files
+	 *	can be read together. The caller reads file_cell_numbers cells into the data with the lock released,
+	 *	then calls end_loading() with the lock. Meanwhile the other threads missing the file wait for it
+	 *	@param data [Out] the buffer to read the file into
+	 *	@return the index of the slot, npos if the file is cached or being read, or no slot can be reused
+	 */
+	int begin_loading(size_t level, size_t node_no, T *&data) {
+		BOOST_ASSERT(storage);
+
+		if(find(NodeContentKey::node_key(level, node_no)) != npos) return npos;
+		bool shared = false;
+		NodeContentKey key = storage->get_content_key(level, node_no, shared);
+		if(find(key) != npos) return npos;
 
-		fin.close();
-		update_count(index);
+		int index = reserve_loading_slot(level, node_no, key);
+		if(index != npos) data = &lru_data[index].image_data[0];
 		return index;
 	}
 
 	/**
-	 *	@brief write the index data into the file system
+	 *	@brief finish reading the file into the slot reserved by begin_loading(), must be called with the lock
+	 *	@return success
+	 */
+	bool end_loading(int index, bool success, size_t read_bytes) {
+		ValueType &value = lru_data[index];
+		BOOST_ASSERT(value.loading);
+
+		value.loading = false;
+		m_loaded.notify_all();
+
+		if(!success) {
+			/* the slot keeps no valid file, so it is reused first */
+			value.level = value.node_no = size_t(npos);
+			drop_key(index);
+			link_back(index);
+			return false;
+		}
+		value.bytes = read_bytes;
+
+		touch(index);
+		return true;
+	}
+
+	/**
+	 *	@brief the maximum file number, 0 means no limit
+	 */
+	size_t get_file_cache_number() const {
+		return file_cache_numbers;
+	}
+
+	/**
+	 *	@brief write the index data into the file system, only the dirty ranges are written if possible
 	 *	@return whether write successfully
 	 */
-	bool write_back_data(int index) 
+	bool write_back_data(int index)
 	{
 		using namespace std;
 
 		/* if the data is dirty, then write it back to the file to update the data in the disk */
-		if(b_data_dirty[index] == true) {
-			ofstream fout(lru_data[index].image_file_name, ios::out | ios::binary);
-			fout.write(reinterpret_cast<char*>(&lru_data[index].image_data[0]), file_cell_numbers*sizeof(T));
-
-			if(fout.fail()) {
-				cerr << "write image file " << lru_data[index].image_file_name << " fails" << endl;
+		ValueType &value = lru_data[index];
+		if(value.dirty == true) {
+			if(!write_dirty_ranges(value) && !storage->write_cells(value.level, value.node_no,
+				&value.image_data[0], value.bytes, sizeof(T))) {
+				cerr << "write image file " << value.node_no << " of level " << value.level << " fails" << endl;
 				return false;
 			}
-			fout.close();
+			mark_clean(index);
 		}
 
 		return true;
 	}
 
 	/**
-	 *	@brief update the count of all the file cache count, the specific index is set to zero
+	 *	@brief write back all the dirty files, the files stay in the cache. The dirty ranges of all the files
+	 *	are written together
+	 *	@return whether all the files are written successfully
 	 */
-	void update_count(int index) {
-		BOOST_ASSERT(index < lru_data.size() && index >= 0);
+	bool flush()
+	{
+		std::vector<ImageStorage::NodeRangeWrite> writes;
+		std::vector<std::pair<int, size_t> > range_files;
+		for(size_t i = 0; i < lru_data.size(); ++i) {
+			if(!lru_data[i].dirty || lru_data[i].loading) continue;
+
+			size_t first = writes.size();
+			if(get_range_writes(lru_data[i], writes)) range_files.push_back(std::make_pair(int(i), first));
+			else writes.resize(first);
+		}
+		if(!writes.empty()) storage->write_node_ranges(writes);
+
+		for(size_t k = 0; k < range_files.size(); ++k) {
+			size_t last = (k + 1 < range_files.size()) ? range_files[k + 1].second : writes.size();
+			bool written = true;
+			for(size_t i = range_files[k].second; i < last; ++i) {
+				if(!writes[i].success) written = false;
+			}
+			if(written) mark_clean(range_files[k].first);
+		}
+
+		/* the others are written as the whole files */
+		bool success = true;
 		for(size_t i = 0; i < lru_data.size(); ++i) {
-			++lru_data[i].count;
+			if(lru_data[i].dirty && !lru_data[i].loading && !write_back_data(int(i))) success = false;
 		}
+		return success;
+	}
 
-		/* the most current used is index by 0 */
-		lru_data[index].count = 0;
+	/**
+	 *	@brief get a slot for the new data. A new slot is allocated if the file cache number and the
+	 *	ImageCacheManager allow, otherwise the least recently used slot (except the keep_index) is written
+	 *	back and reused, the slot is dropped from the hash table
+	 *	@return the index of the slot, npos if fails to write back
+	 */
+	int get_free_slot(int keep_index)
+	{
+		int reusable = least_recent;
+		if(reusable != npos && reusable == keep_index) reusable = lru_data[reusable].prev;
+
+		/* the cache grows over the file cache number if all the slots are being loaded or pinned */
+		bool can_grow = (free_slot != npos || file_cache_numbers == 0 || current_used < file_cache_numbers || reusable == npos);
+		if(can_grow && ImageCacheManager::instance().acquire(this, file_cell_numbers*sizeof(T), reusable != npos)) {
+			int index = free_slot;
+			if(index != npos) {
+				free_slot = lru_data[index].next;
+				lru_data[index].next = npos;
+			} else {
+				lru_data.push_back(ValueType());
+				index = current_used++;
+			}
+			lru_data[index].image_data.resize(file_cell_numbers);
+			return index;
+		}
+
+		if(reusable == npos || !write_back_data(reusable)) return npos;
+		drop_key(reusable);
+		return reusable;
+	}
+
+	/**
+	 *	@brief mark the index as the most recently used
+	 */
+	void touch(int index) {
+		BOOST_ASSERT(index < (int)lru_data.size() && index >= 0);
+		if(index == most_recent || lru_data[index].pins > 0) return;
+
+		unlink(index);
+		lru_data[index].prev = npos;
+		lru_data[index].next = most_recent;
+		if(most_recent != npos) lru_data[most_recent].prev = index;
+		most_recent = index;
+		if(least_recent == npos) least_recent = index;
 	}
 
 	/*
@@ -190,27 +457,264 @@ public:
 		return lru_data[index].image_data;
 	}
 
+	/**
+	 *	@brief keep the index file cache from eviction until the returned data pointer and all its copies are
+	 *	released, must be called with the lock of get_mutex()
+	 *	@param lru the shared pointer of the cache, the cache lives as long as the returned pointer
+	 */
+	static boost::shared_ptr<const std::vector<T> > pin_data(const boost::shared_ptr<ImageFileLRU> &lru, int index) {
+		BOOST_ASSERT(index < (int)lru->lru_data.size() && index >= 0);
+
+		ValueType &value = lru->lru_data[index];
+		if(value.pins++ == 0) lru->unlink(index);
+		return boost::shared_ptr<const std::vector<T> >(&value.image_data, Unpinner(lru, index));
+	}
+
 	/*
 	 *	@brief get the index file cache's data
 	 */
 	std::vector<T>& get_data(int index) {
 		BOOST_ASSERT(index < lru_data.size() && index >= 0);
-		
-		/* if get the image data by this function, then the data will be marked as dirty */
-		b_data_dirty[index] = true;
+
+		/* if get the image data by this function, then the whole data will be marked as dirty */
+		lru_data[index].dirty = true;
+		lru_data[index].dirty_ranges.clear();
 		return lru_data[index].image_data;
 	}
 
+	/**
+	 *	@brief get the index file cache's data to change the cells [front, front + count), only the range
+	 *	is marked as dirty
+	 */
+	std::vector<T>& get_data(int index, size_t front, size_t count) {
+		BOOST_ASSERT(index < (int)lru_data.size() && index >= 0);
+
+		ValueType &value = lru_data[index];
+		if(!value.dirty) {
+			value.dirty = true;
+			value.dirty_ranges.assign(1, std::make_pair(front, front + count));
+		} else if(!value.dirty_ranges.empty()) {
+			add_dirty_range(value.dirty_ranges, front, front + count);
+		}
+		return value.image_data;
+	}
+
 public:
 	/** the npos means invalid index */
 	static const int npos = -1;
 
 private:
-	std::vector<ValueType> lru_data;
-	std::vector<bool> b_data_dirty;
+	/**
+	 *	@brief put the pinned slot back into the recency list when the last pin is released
+	 */
+	struct Unpinner
+	{
+		Unpinner(const boost::shared_ptr<ImageFileLRU> &_lru, int _index) : lru(_lru), index(_index) {}
+
+		void operator () (const std::vector<T> *)
+		{
+			boost::mutex::scoped_lock lock(lru->m_mutex);
+			if(--lru->lru_data[index].pins == 0) lru->touch(index);
+		}
+
+		boost::shared_ptr<ImageFileLRU> lru;
+		int index;
+	};
+
+	/**
+	 *	@brief merge the range [front, tail) into the ordered ranges, the overlapped or adjacent ranges
+	 *	are joined
+	 */
+	static void add_dirty_range(std::vector<std::pair<size_t, size_t> > &ranges, size_t front, size_t tail)
+	{
+		typedef std::vector<std::pair<size_t, size_t> >::iterator RangeIterator;
+
+		/* the first range not before [front, tail) and the first range after it */
+		RangeIterator first = ranges.begin();
+		while(first != ranges.end() && first->second < front) ++first;
+		RangeIterator last = first;
+		while(last != ranges.end() && last->first <= tail) ++last;
+
+		if(first != last) {
+			front = std::min(front, first->first);
+			tail = std::max(tail, (last - 1)->second);
+			first = ranges.erase(first, last);
+		}
+		ranges.insert(first, std::make_pair(front, tail));
+
+		/* too many ranges are written as one */
+		if(ranges.size() > MAX_DIRTY_RANGES) {
+			ranges.front().second = ranges.back().second;
+			ranges.resize(1);
+		}
+	}
+
+	/**
+	 *	@brief append the writes of the dirty ranges of the file
+	 *	@return false if the whole file should be written instead
+	 */
+	bool get_range_writes(const ValueType &value, std::vector<ImageStorage::NodeRangeWrite> &writes) const
+	{
+		if(value.dirty_ranges.empty()) return false;
+
+		/* the whole file is written, so it may be saved as a uniform node */
+		size_t cell_number = value.bytes/sizeof(T);
+		if(value.dirty_ranges.front().first == 0 && value.dirty_ranges.front().second >= cell_number) return false;
+
+		for(size_t i = 0; i < value.dirty_ranges.size(); ++i) {
+			size_t front = value.dirty_ranges[i].first;
+			size_t tail = std::min(value.dirty_ranges[i].second, cell_number);
+			if(front >= tail) continue;
+
+			writes.push_back(ImageStorage::NodeRangeWrite(value.level, value.node_no, front*sizeof(T),
+				&value.image_data[front], (tail - front)*sizeof(T)));
+		}
+		return true;
+	}
+
+	/**
+	 *	@brief write the dirty ranges of the file in place
+	 *	@return false if the whole file should be written instead
+	 */
+	bool write_dirty_ranges(const ValueType &value)
+	{
+		std::vector<ImageStorage::NodeRangeWrite> writes;
+		if(!get_range_writes(value, writes)) return false;
+		return writes.empty() || storage->write_node_ranges(writes);
+	}
+
+	/**
+	 *	@brief the file is written back, the node may be saved elsewhere, so the cache follows its new content
+	 */
+	void mark_clean(int index)
+	{
+		ValueType &value = lru_data[index];
+		value.dirty = false;
+		value.dirty_ranges.clear();
+
+		bool shared = false;
+		set_key(index, storage->get_content_key(value.level, value.node_no, shared));
+	}
+
+	/**
+	 *	@brief reserve a free slot for the file, the loading slot is found by the other threads, but never evicted
+	 */
+	int reserve_loading_slot(size_t level, size_t node_no, const NodeContentKey &key)
+	{
+		int index = get_free_slot(npos);
+		if(index == npos) return npos;
+
+		ValueType &value = lru_data[index];
+		value.level = level;
+		value.node_no = node_no;
+		value.loading = true;
+		set_key(index, key);
+		unlink(index);
+		return index;
+	}
+
+	static size_t hash_key(const NodeContentKey &key)
+	{
+		uint64 h = key.blob * 0x9e3779b97f4a7c15ULL ^ key.node;
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		return size_t(h);
+	}
+
+	/**
+	 *	@brief index the slot by the key, the former key of the slot is dropped
+	 */
+	void set_key(int index, const NodeContentKey &key)
+	{
+		drop_key(index);
+		BOOST_ASSERT(find(key) == npos);
+
+		/* keep the load factor of the hash table at most 1/2 */
+		if(2*(keyed_number + 1) > hash_table.size()) rehash(hash_table.size()*2);
+
+		size_t mask = hash_table.size() - 1;
+		size_t pos = hash_key(key) & mask;
+		while(hash_table[pos] != npos) pos = (pos + 1) & mask;
+
+		hash_table[pos] = index;
+		lru_data[index].key = key;
+		lru_data[index].keyed = true;
+		++keyed_number;
+	}
+
+	void rehash(size_t table_size)
+	{
+		hash_table.assign(table_size, int(npos));
+		size_t mask = table_size - 1;
+		for(size_t i = 0; i < lru_data.size(); ++i) {
+			if(!lru_data[i].keyed) continue;
+
+			size_t pos = hash_key(lru_data[i].key) & mask;
+			while(hash_table[pos] != npos) pos = (pos + 1) & mask;
+			hash_table[pos] = int(i);
+		}
+	}
+
+	/**
+	 *	@brief remove the slot from the hash table, the following entries of the probe chain are shifted back
+	 */
+	void drop_key(int index)
+	{
+		if(!lru_data[index].keyed) return;
+		lru_data[index].keyed = false;
+		--keyed_number;
+
+		size_t mask = hash_table.size() - 1;
+		size_t pos = hash_key(lru_data[index].key) & mask;
+		while(hash_table[pos] != index) pos = (pos + 1) & mask;
+
+		for(size_t next = (pos + 1) & mask; hash_table[next] != npos; next = (next + 1) & mask) {
+			/* move the entry into the hole if its home position is not in (pos, next] */
+			size_t home = hash_key(lru_data[hash_table[next]].key) & mask;
+			if(((next - home) & mask) >= ((next - pos) & mask)) {
+				hash_table[pos] = hash_table[next];
+				pos = next;
+			}
+		}
+		hash_table[pos] = npos;
+	}
+
+	void unlink(int index)
+	{
+		ValueType &value = lru_data[index];
+		if(value.prev != npos) lru_data[value.prev].next = value.next;
+		else if(most_recent == index) most_recent = value.next;
+		if(value.next != npos) lru_data[value.next].prev = value.prev;
+		else if(least_recent == index) least_recent = value.prev;
+		value.prev = value.next = npos;
+	}
+
+	void link_back(int index)
+	{
+		lru_data[index].prev = least_recent;
+		lru_data[index].next = npos;
+		if(least_recent != npos) lru_data[least_recent].next = index;
+		least_recent = index;
+		if(most_recent == npos) most_recent = index;
+	}
+
+private:
+	boost::shared_ptr<ImageStorage> storage;
+	DataType lru_data;
+	/** the slot indexes of the cached keys, npos for the empty entry */
+	std::vector<int> hash_table;
+	size_t keyed_number;
+	/** the ends of the recency list */
+	int most_recent, least_recent;
+	/** the first slot evicted by ImageCacheManager, the free slots are linked by ValueType::next */
+	int free_slot;
+	boost::mutex m_mutex;
+	/** notified when a file has been read into the cache */
+	boost::condition_variable m_loaded;
 	size_t current_used;
 	size_t file_cache_numbers;
 	size_t file_cell_numbers;
 };
 
-#endif
\ No newline at end of file
+#endif
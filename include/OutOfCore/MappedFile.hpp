@@ -0,0 +1,163 @@
+#ifndef _MAPPED_FILE_HPP
+#define _MAPPED_FILE_HPP
+
+#include "BasicType.h"
+
+#include <string>
+#include <iostream>
+#include <algorithm>
+
+#include <boost/noncopyable.hpp>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
+/**
+ * @class MappedFile MappedFile.hpp
+ *
+ * @brief The whole file mapped read-only into the memory, the pages are read by the kernel when they are
+ * visited and shared by all the processes mapping the same file.
+ * @see DiskBigImage
+ */
+
+class MappedFile : private boost::noncopyable
+{
+public:
+	/** the hint of how the mapped pages will be visited */
+	enum AccessAdvice
+	{
+		ADVICE_NORMAL,
+		/** the pages are visited randomly, the kernel doesn't read ahead */
+		ADVICE_RANDOM,
+		ADVICE_SEQUENTIAL,
+		/** the pages will be visited soon, the kernel reads them in the background */
+		ADVICE_WILLNEED
+	};
+
+#ifdef _WIN32
+	MappedFile() : m_data(NULL), m_bytes(0), m_file(INVALID_HANDLE_VALUE), m_mapping(NULL) {}
+#else
+	MappedFile() : m_data(NULL), m_bytes(0) {}
+#endif
+
+	~MappedFile() { close(); }
+
+	/**
+	 *	@brief map the whole existing file read-only
+	 */
+	bool open(const std::string &file_name)
+	{
+		using namespace std;
+
+		close();
+#ifdef _WIN32
+		m_file = CreateFileA(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		LARGE_INTEGER file_size;
+		if(m_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_file, &file_size) || file_size.QuadPart == 0) {
+			cerr << "map " << file_name << " failure" << endl;
+			close();
+			return false;
+		}
+
+		m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if(m_mapping != NULL) m_data = reinterpret_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+		if(m_data == NULL) {
+			cerr << "map " << file_name << " failure" << endl;
+			close();
+			return false;
+		}
+		m_bytes = file_size.QuadPart;
+#else
+		int fd = ::open(file_name.c_str(), O_RDONLY);
+		struct stat file_stat;
+		if(fd < 0 || fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+			cerr << "map " << file_name << " failure" << endl;
+			if(fd >= 0) ::close(fd);
+			return false;
+		}
+
+		/* the mapping is kept after closing the descriptor */
+		void *data = mmap(NULL, size_t(file_stat.st_size), PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		if(data == MAP_FAILED) {
+			cerr << "map " << file_name << " failure" << endl;
+			return false;
+		}
+		m_data = reinterpret_cast<const char*>(data);
+		m_bytes = file_stat.st_size;
+#endif
+		return true;
+	}
+
+	void close()
+	{
+#ifdef _WIN32
+		if(m_data != NULL) UnmapViewOfFile(m_data);
+		if(m_mapping != NULL) CloseHandle(m_mapping);
+		if(m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+		m_mapping = NULL;
+		m_file = INVALID_HANDLE_VALUE;
+#else
+		if(m_data != NULL) munmap(const_cast<char*>(m_data), size_t(m_bytes));
+#endif
+		m_data = NULL;
+		m_bytes = 0;
+	}
+
+	bool is_open() const
+	{
+		return m_data != NULL;
+	}
+
+	const char* data() const
+	{
+		return m_data;
+	}
+
+	int64 size() const
+	{
+		return m_bytes;
+	}
+
+	/**
+	 *	@brief tell the kernel how the bytes from the offset will be visited, only a hint (ignored on windows)
+	 */
+	void advise(int64 offset, int64 bytes, AccessAdvice advice) const
+	{
+#ifndef _WIN32
+		if(m_data == NULL || offset >= m_bytes || bytes <= 0) return;
+
+		/* madvise works on the whole pages */
+		static const int64 page_size = sysconf(_SC_PAGESIZE);
+		int64 begin = offset / page_size * page_size;
+		int64 end = std::min(offset + bytes, m_bytes);
+
+		int flag = MADV_NORMAL;
+		if(advice == ADVICE_RANDOM) flag = MADV_RANDOM;
+		else if(advice == ADVICE_SEQUENTIAL) flag = MADV_SEQUENTIAL;
+		else if(advice == ADVICE_WILLNEED) flag = MADV_WILLNEED;
+		madvise(const_cast<char*>(m_data) + begin, size_t(end - begin), flag);
+#endif
+	}
+
+private:
+	const char *m_data;
+	int64 m_bytes;
+#ifdef _WIN32
+	HANDLE m_file;
+	HANDLE m_mapping;
+#endif
+};
+
+#endif
@@ -0,0 +1,408 @@
+#ifndef _NODE_CODEC_HPP
+#define _NODE_CODEC_HPP
+
+#include "BasicType.h"
+#include "ImageStorage.hpp"
+
+#include <vector>
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+#include <boost/assert.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+
+/**
+ * @class NodeCodec NodeCodec.hpp
+ *
+ * @brief The lossless codec to compress the data nodes of the image.
+ *
+ * The codecs are stateless, so one codec can be used by multiply threads concurrently.
+ * @see CompressedImageStorage
+ */
+
+class NodeCodec
+{
+public:
+	enum CodecType
+	{
+		/** the raw cells */
+		NO_CODEC = 0,
+		/** the byte delta of the neighbour cells followed by the run length encoding, very fast to decode */
+		DELTA_RLE_CODEC = 1,
+		/** the zlib deflate */
+		ZLIB_CODEC = 2
+	};
+
+	virtual ~NodeCodec() {}
+
+	virtual CodecType get_codec_type() const = 0;
+
+	/**
+	 *	@brief append the encoded data of the bytes of src into dst
+	 */
+	virtual bool encode(const char *src, size_t bytes, std::vector<char> &dst) const = 0;
+
+	/**
+	 *	@brief decode the src_bytes of src, the decoded data must be exactly bytes
+	 */
+	virtual bool decode(const char *src, size_t src_bytes, char *dst, size_t bytes) const = 0;
+
+	/**
+	 *	@brief create the codec, return the null pointer for NO_CODEC or the unknown type
+	 *	@param cell_size the bytes of one image cell
+	 */
+	static boost::shared_ptr<NodeCodec> create(CodecType type, size_t cell_size);
+};
+
+/**
+ * @class DeltaRleCodec NodeCodec.hpp
+ *
+ * @brief Each byte is replaced by the difference from the same byte of the previous cell, then the
+ * differences are run length encoded. The smooth or flat image areas become the long runs of zero.
+ *
+ * The control byte c < 128 is followed by c + 1 literal bytes, and c >= 128 is followed by one byte
+ * repeated c - 128 + MIN_RUN times.
+ */
+
+class DeltaRleCodec : public NodeCodec
+{
+public:
+	enum { MIN_RUN = 3, MAX_RUN = 127 + MIN_RUN, MAX_LITERAL = 128 };
+
+	explicit DeltaRleCodec(size_t cell_size) : m_cell_size(cell_size < 1 ? 1 : cell_size) {}
+
+	virtual CodecType get_codec_type() const
+	{
+		return DELTA_RLE_CODEC;
+	}
+
+	virtual bool encode(const char *src, size_t bytes, std::vector<char> &dst) const
+	{
+		const uchar *in = reinterpret_cast<const uchar*>(src);
+
+		std::vector<uchar> delta(bytes);
+		size_t head = std::min(m_cell_size, bytes);
+		for(size_t i = 0; i < head; ++i) delta[i] = in[i];
+		for(size_t i = head; i < bytes; ++i) delta[i] = uchar(in[i] - in[i - m_cell_size]);
+
+		dst.reserve(dst.size() + bytes/2);
+		size_t literal_front = 0, i = 0;
+		while(i < bytes) {
+			size_t run = 1;
+			while(i + run < bytes && run < MAX_RUN && delta[i + run] == delta[i]) ++run;
+
+			if(run < MIN_RUN) {
+				i += run;
+				continue;
+			}
+
+			append_literal(&delta[0], literal_front, i, dst);
+			dst.push_back(char(128 + run - MIN_RUN));
+			dst.push_back(char(delta[i]));
+			i += run;
+			literal_front = i;
+		}
+		append_literal(delta.empty() ? NULL : &delta[0], literal_front, bytes, dst);
+
+		return true;
+	}
+
+	virtual bool decode(const char *src, size_t src_bytes, char *dst, size_t bytes) const
+	{
+		const uchar *in = reinterpret_cast<const uchar*>(src);
+		const uchar *in_end = in + src_bytes;
+		uchar *out = reinterpret_cast<uchar*>(dst);
+		const size_t cell_size = m_cell_size;
+		size_t pos = 0;
+
+		/* the differences are accumulated back into the cells while decoding, so the data is touched once */
+		while(in < in_end) {
+			size_t control = *in++;
+			if(control < 128) {
+				size_t count = control + 1;
+				if(in + count > in_end || pos + count > bytes) return false;
+				for(size_t i = 0; i < count; ++i, ++pos) {
+					out[pos] = uchar(in[i] + (pos >= cell_size ? out[pos - cell_size] : 0));
+				}
+				in += count;
+			} else {
+				size_t count = control - 128 + MIN_RUN;
+				if(in >= in_end || pos + count > bytes) return false;
+				uchar value = *in++;
+				size_t end = pos + count;
+				for(; pos < end && pos < cell_size; ++pos) out[pos] = value;
+
+				if(value == 0) {
+					/* the zero difference repeats the previous cell, copy the repeated cells in doubling chunks */
+					for(size_t distance = cell_size; pos < end; ) {
+						size_t chunk = std::min(distance, end - pos);
+						memcpy(out + pos, out + pos - distance, chunk);
+						pos += chunk;
+						distance += chunk;
+					}
+				} else {
+					for(; pos < end; ++pos) out[pos] = uchar(value + out[pos - cell_size]);
+				}
+			}
+		}
+
+		return pos == bytes;
+	}
+
+private:
+	static void append_literal(const uchar *data, size_t front, size_t tail, std::vector<char> &dst)
+	{
+		while(front < tail) {
+			size_t count = std::min<size_t>(tail - front, MAX_LITERAL);
+			dst.push_back(char(count - 1));
+			dst.insert(dst.end(), data + front, data + front + count);
+			front += count;
+		}
+	}
+
+private:
+	size_t m_cell_size;
+};
+
+/**
+ * @class ZlibCodec NodeCodec.hpp
+ *
+ * @brief The zlib deflate by boost::iostreams, better ratio for the textured image but slower than DeltaRleCodec.
+ */
+
+class ZlibCodec : public NodeCodec
+{
+public:
+	virtual CodecType get_codec_type() const
+	{
+		return ZLIB_CODEC;
+	}
+
+	virtual bool encode(const char *src, size_t bytes, std::vector<char> &dst) const
+	{
+		namespace io = boost::iostreams;
+
+		try {
+			io::filtering_ostream out;
+			out.push(io::zlib_compressor(io::zlib::best_speed));
+			out.push(io::back_inserter(dst));
+			out.write(src, bytes);
+			out.reset();
+		} catch(io::zlib_error &err) {
+			std::cerr << "zlib compression error : " << err.what() << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	virtual bool decode(const char *src, size_t src_bytes, char *dst, size_t bytes) const
+	{
+		namespace io = boost::iostreams;
+
+		try {
+			io::filtering_istream in;
+			in.push(io::zlib_decompressor());
+			in.push(io::array_source(src, src_bytes));
+			in.read(dst, bytes);
+			if(size_t(in.gcount()) != bytes) return false;
+		} catch(io::zlib_error &err) {
+			std::cerr << "zlib decompression error : " << err.what() << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+};
+
+inline boost::shared_ptr<NodeCodec> NodeCodec::create(CodecType type, size_t cell_size)
+{
+	switch(type) {
+	case DELTA_RLE_CODEC:
+		return boost::make_shared<DeltaRleCodec>(cell_size);
+	case ZLIB_CODEC:
+		return boost::make_shared<ZlibCodec>();
+	default:
+		return boost::shared_ptr<NodeCodec>();
+	}
+}
+
+/**
+ * @class CompressedImageStorage NodeCodec.hpp
+ *
+ * @brief Compress the nodes before writing into the underlying storage, and decompress the nodes after reading.
+ *
+ * Every saved node begins with a 16 bytes node head : uint codec type, uint reserved, uint64 raw bytes.
+ * The node which can't be compressed smaller is saved raw with the NO_CODEC type. The encoding runs in
+ * the caller thread, so the writer threads of AsyncFileWriter compress the nodes concurrently.
+ */
+
+class CompressedImageStorage : public ImageStorage
+{
+public:
+	enum { NODE_HEAD_SIZE = 16 };
+
+	CompressedImageStorage(const boost::shared_ptr<ImageStorage> &storage, const boost::shared_ptr<NodeCodec> &codec)
+		: m_storage(storage), m_codec(codec)
+	{
+		BOOST_ASSERT(m_storage && m_codec);
+	}
+
+	virtual bool create_level(size_t level)
+	{
+		return m_storage->create_level(level);
+	}
+
+	virtual bool write_node(size_t level, size_t node_no, const void *data, size_t bytes)
+	{
+		std::vector<char> buffer(NODE_HEAD_SIZE);
+		if(!m_codec->encode(reinterpret_cast<const char*>(data), bytes, buffer)) return false;
+
+		uint codec_type = m_codec->get_codec_type();
+		if(buffer.size() >= NODE_HEAD_SIZE + bytes) {
+			/* not compressible, keep the raw data */
+			codec_type = NodeCodec::NO_CODEC;
+			buffer.resize(NODE_HEAD_SIZE + bytes);
+			if(bytes > 0) memcpy(&buffer[NODE_HEAD_SIZE], data, bytes);
+		}
+
+		uint reserved = 0;
+		uint64 raw_bytes = bytes;
+		memcpy(&buffer[0], &codec_type, sizeof(codec_type));
+		memcpy(&buffer[4], &reserved, sizeof(reserved));
+		memcpy(&buffer[8], &raw_bytes, sizeof(raw_bytes));
+
+		return m_storage->write_node(level, node_no, &buffer[0], buffer.size());
+	}
+
+	/**
+	 *	@brief the uniform node is already as small as it can be, so it is saved directly
+	 */
+	virtual bool write_uniform_node(size_t level, size_t node_no, const UniformCell &cell, size_t bytes)
+	{
+		return m_storage->write_uniform_node(level, node_no, cell, bytes);
+	}
+
+	virtual bool get_uniform_node(size_t level, size_t node_no, UniformCell &cell, size_t &bytes)
+	{
+		return m_storage->get_uniform_node(level, node_no, cell, bytes);
+	}
+
+	virtual NodeContentKey get_content_key(size_t level, size_t node_no, bool &shared)
+	{
+		return m_storage->get_content_key(level, node_no, shared);
+	}
+
+	virtual bool read_node(size_t level, size_t node_no, void *data, size_t bytes, size_t &read_bytes)
+	{
+		UniformCell cell;
+		size_t uniform_bytes = 0;
+		if(m_storage->get_uniform_node(level, node_no, cell, uniform_bytes)) {
+			read_bytes = std::min(bytes, uniform_bytes);
+			cell.fill(data, read_bytes);
+			return true;
+		}
+
+		/* the saved node is never larger than the raw data with the node head */
+		std::vector<char> buffer(NODE_HEAD_SIZE + bytes);
+		size_t saved_bytes = 0;
+		if(!m_storage->read_node(level, node_no, &buffer[0], buffer.size(), saved_bytes)) return false;
+
+		return decode_node(level, node_no, buffer, saved_bytes, data, bytes, read_bytes);
+	}
+
+	/**
+	 *	@brief read the saved nodes by the underlying storage concurrently, then decode them
+	 */
+	virtual bool read_nodes(std::vector<NodeRead> &reads)
+	{
+		std::vector<std::vector<char> > buffers(reads.size());
+		std::vector<NodeRead> saved_reads;
+		std::vector<size_t> read_nos;
+		for(size_t i = 0; i < reads.size(); ++i) {
+			NodeRead &read = reads[i];
+			UniformCell cell;
+			size_t uniform_bytes = 0;
+			if(m_storage->get_uniform_node(read.level, read.node_no, cell, uniform_bytes)) {
+				read.read_bytes = std::min(read.bytes, uniform_bytes);
+				cell.fill(read.data, read.read_bytes);
+				read.success = true;
+				continue;
+			}
+
+			buffers[i].resize(NODE_HEAD_SIZE + read.bytes);
+			saved_reads.push_back(NodeRead(read.level, read.node_no, &buffers[i][0], buffers[i].size()));
+			read_nos.push_back(i);
+		}
+
+		m_storage->read_nodes(saved_reads);
+
+		bool success = true;
+		for(size_t i = 0; i < saved_reads.size(); ++i) {
+			NodeRead &read = reads[read_nos[i]];
+			read.success = saved_reads[i].success && decode_node(read.level, read.node_no, buffers[read_nos[i]],
+				saved_reads[i].read_bytes, read.data, read.bytes, read.read_bytes);
+			if(!read.success) success = false;
+		}
+		return success;
+	}
+
+	virtual bool flush()
+	{
+		return m_storage->flush();
+	}
+
+	virtual bool close()
+	{
+		return m_storage->close();
+	}
+
+private:
+	/**
+	 *	@brief decode the saved node of saved_bytes in the buffer
+	 */
+	bool decode_node(size_t level, size_t node_no, const std::vector<char> &buffer, size_t saved_bytes, 
+		void *data, size_t bytes, size_t &read_bytes) const
+	{
+		uint codec_type = 0;
+		uint64 raw_bytes = 0;
+		if(saved_bytes >= NODE_HEAD_SIZE) {
+			memcpy(&codec_type, &buffer[0], sizeof(codec_type));
+			memcpy(&raw_bytes, &buffer[8], sizeof(raw_bytes));
+		}
+		if(saved_bytes < NODE_HEAD_SIZE || raw_bytes > bytes) {
+			std::cerr << "the compressed node " << node_no << " of level " << level << " is not correct" << std::endl;
+			return false;
+		}
+
+		const char *payload = &buffer[NODE_HEAD_SIZE];
+		size_t payload_bytes = saved_bytes - NODE_HEAD_SIZE;
+		bool success = false;
+		if(codec_type == NodeCodec::NO_CODEC) {
+			success = (payload_bytes == raw_bytes);
+			if(success && raw_bytes > 0) memcpy(data, payload, (size_t)raw_bytes);
+		} else if(codec_type == (uint)m_codec->get_codec_type()) {
+			success = m_codec->decode(payload, payload_bytes, reinterpret_cast<char*>(data), (size_t)raw_bytes);
+		}
+
+		if(!success) {
+			std::cerr << "decode the node " << node_no << " of level " << level << " failure" << std::endl;
+			return false;
+		}
+
+		read_bytes = (size_t)raw_bytes;
+		return true;
+	}
+
+private:
+	boost::shared_ptr<ImageStorage> m_storage;
+	boost::shared_ptr<NodeCodec> m_codec;
+};
+
+#endif
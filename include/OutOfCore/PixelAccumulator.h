@@ -0,0 +1,84 @@
+#ifndef _PIXEL_ACCUMULATOR_H
+#define _PIXEL_ACCUMULATOR_H
+
+#include "BasicType.h"
+#include <limits>
+
+/**
+ * @class PixelAccumulator PixelAccumulator.h
+ *
+ * @brief The accumulator trait to average the image cells, used by the hierarchical image to build
+ * the scaled level images by the box filter.
+ *
+ * The accumulator keeps the sum of the cells in a wider type, so the sum of a large block of cells
+ * does not overflow and the average is computed only once. The cell type which is not a scalar or
+ * a PixelElement must specialize this trait.
+ *
+ * @tparam T The type of the image cell
+ */
+
+template<typename T>
+struct PixelAccumulator
+{
+	typedef double AccumType;
+
+	static void clear(AccumType &sum)
+	{
+		sum = 0;
+	}
+
+	static void add(AccumType &sum, const T &value)
+	{
+		sum += value;
+	}
+
+	static void merge(AccumType &sum, const AccumType &other)
+	{
+		sum += other;
+	}
+
+	/**
+	 *	@brief get the average of the sum of weight cells, the zero cell if the weight is 0
+	 */
+	static T average(const AccumType &sum, int64 weight)
+	{
+		if(weight <= 0) return T(0);
+		return static_cast<T>(sum / weight + (std::numeric_limits<T>::is_integer ? 0.5 : 0.0));
+	}
+};
+
+template<typename E>
+struct PixelAccumulator<PixelElement<E> >
+{
+	struct AccumType
+	{
+		double data[3];
+	};
+
+	static void clear(AccumType &sum)
+	{
+		sum.data[0] = sum.data[1] = sum.data[2] = 0;
+	}
+
+	static void add(AccumType &sum, const PixelElement<E> &value)
+	{
+		for(int i = 0; i < 3; ++i) sum.data[i] += value.data[i];
+	}
+
+	static void merge(AccumType &sum, const AccumType &other)
+	{
+		for(int i = 0; i < 3; ++i) sum.data[i] += other.data[i];
+	}
+
+	static PixelElement<E> average(const AccumType &sum, int64 weight)
+	{
+		PixelElement<E> value;
+		for(int i = 0; i < 3; ++i) {
+			value.data[i] = (weight <= 0) ? E(0) :
+				static_cast<E>(sum.data[i] / weight + (std::numeric_limits<E>::is_integer ? 0.5 : 0.0));
+		}
+		return value;
+	}
+};
+
+#endif
@@ -0,0 +1,213 @@
+#ifndef _ZORDER_KERNEL_H
+#define _ZORDER_KERNEL_H
+
+#include "BasicType.h"
+
+/**
+ * The bit interleaving kernels of the zorder index.
+ *
+ * zorder_spread_bits() moves the lower 32 bits of the number into the even bits of the result,
+ * zorder_compact_bits() is the reverse operation that gathers the even bits into the lower 32 bits.
+ * The magic bits version works on every cpu, the bmi2 version (pdep/pext) is only valid when
+ * cpu_support_bmi2() returns true, so the caller must dispatch at runtime. The same for the avx2 version 
+ * of the row indexes kernel and cpu_support_avx2().
+ */
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define ZORDER_KERNEL_HAS_BMI2 1
+#define ZORDER_KERNEL_HAS_AVX2 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define ZORDER_KERNEL_TARGET_BMI2
+#define ZORDER_KERNEL_TARGET_AVX2
+#else
+#include <cpuid.h>
+#define ZORDER_KERNEL_TARGET_BMI2 __attribute__((target("bmi2")))
+#define ZORDER_KERNEL_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+/** the even bits mask, thus the col bits of the zorder index */
+#define ZORDER_EVEN_BITS_MASK 0x5555555555555555ULL
+
+/** the odd bits mask, thus the row bits of the zorder index */
+#define ZORDER_ODD_BITS_MASK 0xAAAAAAAAAAAAAAAAULL
+
+/**
+ *	@brief query the cpuid whether the cpu supports the bmi2 instruction set
+ */
+inline bool detect_cpu_bmi2()
+{
+#if defined(ZORDER_KERNEL_HAS_BMI2) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if(info[0] < 7) return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 8)) != 0;
+#elif defined(ZORDER_KERNEL_HAS_BMI2)
+	unsigned int eax, ebx, ecx, edx;
+	if(__get_cpuid_max(0, 0) < 7) return false;
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	return (ebx & (1 << 8)) != 0;
+#else
+	return false;
+#endif
+}
+
+/**
+ *	@brief checks whether the cpu supports the bmi2 instruction set, the result is cached
+ */
+inline bool cpu_support_bmi2()
+{
+	static const bool support = detect_cpu_bmi2();
+	return support;
+}
+
+/**
+ *	@brief query the cpuid whether the cpu supports the avx2 instruction set, and the os saves the ymm registers
+ */
+inline bool detect_cpu_avx2()
+{
+#if defined(ZORDER_KERNEL_HAS_AVX2) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if(info[0] < 7) return false;
+
+	/* osxsave and avx */
+	__cpuid(info, 1);
+	if((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0) return false;
+	if((_xgetbv(0) & 6) != 6) return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#elif defined(ZORDER_KERNEL_HAS_AVX2)
+	unsigned int eax, ebx, ecx, edx;
+	if(__get_cpuid_max(0, 0) < 7) return false;
+
+	/* osxsave and avx */
+	__cpuid(1, eax, ebx, ecx, edx);
+	if((ecx & (1 << 27)) == 0 || (ecx & (1 << 28)) == 0) return false;
+	unsigned int xcr0_low, xcr0_high;
+	__asm__ __volatile__("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+	if((xcr0_low & 6) != 6) return false;
+
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	return (ebx & (1 << 5)) != 0;
+#else
+	return false;
+#endif
+}
+
+/**
+ *	@brief checks whether the cpu supports the avx2 instruction set, the result is cached
+ */
+inline bool cpu_support_avx2()
+{
+	static const bool support = detect_cpu_avx2();
+	return support;
+}
+
+inline ulonglong zorder_spread_bits(ulonglong x)
+{
+	x &= 0x00000000FFFFFFFFULL;
+	x = (x | (x << 16)) & 0x0000FFFF0000FFFFULL;
+	x = (x | (x << 8)) & 0x00FF00FF00FF00FFULL;
+	x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	x = (x | (x << 2)) & 0x3333333333333333ULL;
+	x = (x | (x << 1)) & 0x5555555555555555ULL;
+	return x;
+}
+
+inline ulonglong zorder_compact_bits(ulonglong x)
+{
+	x &= 0x5555555555555555ULL;
+	x = (x | (x >> 1)) & 0x3333333333333333ULL;
+	x = (x | (x >> 2)) & 0x0F0F0F0F0F0F0F0FULL;
+	x = (x | (x >> 4)) & 0x00FF00FF00FF00FFULL;
+	x = (x | (x >> 8)) & 0x0000FFFF0000FFFFULL;
+	x = (x | (x >> 16)) & 0x00000000FFFFFFFFULL;
+	return x;
+}
+
+/**
+ *	@brief add the spread bits number y to the spread bits number x, the carry goes through the odd bits
+ */
+inline ulonglong zorder_add_spread_bits(ulonglong x, ulonglong y)
+{
+	return ((x | ZORDER_ODD_BITS_MASK) + y) & ZORDER_EVEN_BITS_MASK;
+}
+
+/**
+ *	@brief fill the zorder indexes of the successive cols [col_begin, col_begin + count) in one row.
+ *	The col bits are increased by the masked add instead of spreading every col.
+ *	@param row_bits the bits that are combined with each col bits, thus the spread row bits (and the higher bits)
+ */
+inline void zorder_row_indexes(ulonglong row_bits, ulonglong col_begin, size_t count, int64 *indexes)
+{
+	ulonglong col_bits = zorder_spread_bits(col_begin);
+	for(size_t i = 0; i < count; ++i) {
+		indexes[i] = (int64)(col_bits | row_bits);
+		col_bits = zorder_add_spread_bits(col_bits, 1);
+	}
+}
+
+#ifdef ZORDER_KERNEL_HAS_AVX2
+
+/**
+ *	@brief the avx2 version of zorder_row_indexes(), 8 cols in two vectors each loop
+ */
+ZORDER_KERNEL_TARGET_AVX2 inline void zorder_row_indexes_avx2(ulonglong row_bits, ulonglong col_begin, size_t count, int64 *indexes)
+{
+	const __m256i odd_mask = _mm256_set1_epi64x((long long)(ZORDER_ODD_BITS_MASK));
+	const __m256i even_mask = _mm256_set1_epi64x((long long)(ZORDER_EVEN_BITS_MASK));
+	const __m256i row_vec = _mm256_set1_epi64x((long long)(row_bits));
+
+	/* the spread bits of 4, the lanes step 4 cols each time */
+	const __m256i step_vec = _mm256_set1_epi64x((long long)(zorder_spread_bits(4)));
+
+	ulonglong col_bits0 = zorder_spread_bits(col_begin);
+	ulonglong col_bits1 = zorder_add_spread_bits(col_bits0, 1);
+	ulonglong col_bits2 = zorder_add_spread_bits(col_bits1, 1);
+	ulonglong col_bits3 = zorder_add_spread_bits(col_bits2, 1);
+	__m256i col_vec = _mm256_set_epi64x((long long)(col_bits3), (long long)(col_bits2), 
+		(long long)(col_bits1), (long long)(col_bits0));
+
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8) {
+		__m256i next_vec = _mm256_and_si256(_mm256_add_epi64(_mm256_or_si256(col_vec, odd_mask), step_vec), even_mask);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(indexes + i), _mm256_or_si256(col_vec, row_vec));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(indexes + i + 4), _mm256_or_si256(next_vec, row_vec));
+		col_vec = _mm256_and_si256(_mm256_add_epi64(_mm256_or_si256(next_vec, odd_mask), step_vec), even_mask);
+	}
+
+	/* the residual cols */
+	if(i < count) zorder_row_indexes(row_bits, col_begin + i, count - i, indexes + i);
+}
+
+#endif
+
+#ifdef ZORDER_KERNEL_HAS_BMI2
+
+ZORDER_KERNEL_TARGET_BMI2 inline ulonglong zorder_spread_bits_bmi2(ulonglong x)
+{
+	return _pdep_u64(x, ZORDER_EVEN_BITS_MASK);
+}
+
+ZORDER_KERNEL_TARGET_BMI2 inline ulonglong zorder_compact_bits_bmi2(ulonglong x)
+{
+	return _pext_u64(x, ZORDER_EVEN_BITS_MASK);
+}
+
+/**
+ *	@brief decode the row and col of the zorder index in one call to avoid two dispatches
+ */
+ZORDER_KERNEL_TARGET_BMI2 inline void zorder_decode_bmi2(ulonglong index, ulonglong &row, ulonglong &col)
+{
+	col = _pext_u64(index, ZORDER_EVEN_BITS_MASK);
+	row = _pext_u64(index, ZORDER_ODD_BITS_MASK);
+}
+
+#endif
+
+#endif
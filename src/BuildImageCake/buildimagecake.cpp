@@ -44,7 +44,8 @@ bool build_image_cake(int argc, const char ** argv)
     }
 
 
-    HierarchicalImage<Vec3b, 512> big_image(large_rows, large_cols, mini_rows, mini_cols);
+    /* the zorder index is known at compile time, so the index computing is inlined in the filling loops */
+    HierarchicalImage<Vec3b, 512, ZOrderIndex> big_image(large_rows, large_cols, mini_rows, mini_cols, index_method);
     big_image.set_mutliply_ways_writing_number(big_image.get_max_image_level()+1);
     cout << "mini_rows " << big_image.get_minimal_image_rows() << endl;
     cout << "mini_cols " << big_image.get_minimal_image_cols() << endl;
@@ -72,12 +73,8 @@ bool build_image_cake(int argc, const char ** argv)
     Vec3b white;
     white.r = white.g = white.b = 255;
 
-    /* fill the image with white color */
-    for(int row = 0; row < large_rows; ++row) {
-        for(int col = 0; col < large_cols; ++col) {
-            big_image(row, col) = white;
-        }
-    }
+    /* fill the image with white color, the areas not covered by the source images become the uniform nodes */
+    big_image.set_pixels(0, 0, large_rows, large_cols, white);
 
     int current_max_row = -1;
     for(int start_row = 0; start_row + img_rows <= large_rows;) {
@@ -88,7 +85,7 @@ bool build_image_cake(int argc, const char ** argv)
             /* copy the image file into the (start_rows, start_cols) pos in the big containter */
             for(int row = 0, big_row = start_row; row < img_rows; ++row, ++big_row) {
                 for(int col = 0, big_col = start_col; col < img_cols; ++col, ++big_col) {
-                    big_image(big_row, big_col) = *(Vec3b*)(img_data.data + row*img_data.step[0] + col*img_data.step[1]);
+                    big_image.pixel(big_row, big_col) = *(Vec3b*)(img_data.data + row*img_data.step[0] + col*img_data.step[1]);
                 }
             }
 
@@ -213,21 +213,14 @@ void QBigImageWidget::delta_copy_image_data(int delta_rows, int delta_cols)
         ori_row = distance_rows;
     }
 
-    /* now copy the ori area data into dst area data */
-    std::vector<Vec3b> ori_data = img_data;
-
-    Vec3b *ori_ptr = &ori_data[ori_row*img_cols + ori_col];
-    Vec3b *dst_ptr = &img_data[dst_row*img_cols + dst_col];
-
-    for(unsigned row = 0; row < img_rows - distance_rows; ++row) {
-        for(unsigned col = 0; col < img_cols - distance_cols; ++col) {
-            *dst_ptr = *ori_ptr;
-            ++dst_ptr;
-            ++ori_ptr;
-        }
-
-        dst_ptr += distance_cols;
-        ori_ptr += distance_cols;
+    /* now move the ori area data into dst area data in place, the rows are moved from the far end
+     * when moving down, so no row is overwritten before it is moved */
+    int move_rows = img_rows - distance_rows;
+    size_t move_bytes = (img_cols - distance_cols)*sizeof(Vec3b);
+
+    for(int i = 0; i < move_rows; ++i) {
+        int row = (dst_row > ori_row) ? (move_rows - 1 - i) : i;
+        memmove(&img_data[(dst_row + row)*img_cols + dst_col], &img_data[(ori_row + row)*img_cols + ori_col], move_bytes);
     }
 
     /* now get the two rectangle image area into dst image */
@@ -282,10 +275,11 @@ bool QBigImageWidget::copy_area_image_data(int area_start_row, int area_start_co
 {
     if(area_rows == 0 || area_cols == 0) return true;
 
-    std::vector<Vec3b> area_data;
+    /* read the area into its place of img_data directly */
+    Vec3b *dst_ptr = &img_data[area_start_row*img_cols + area_start_col];
 
-    if(!big_image->get_pixels_by_level(img_current_level, start_row+area_start_row, 
-        start_col+area_start_col, area_rows, area_cols, area_data)) {
+    if(!big_image->read_pixels_by_level(img_current_level, start_row+area_start_row, 
+        start_col+area_start_col, area_rows, area_cols, dst_ptr, img_cols*sizeof(Vec3b))) {
             init_para();
             if(QMessageBox::Abort == QMessageBox::critical(this, 
                 "ReadingBigImage", 
@@ -296,19 +290,6 @@ bool QBigImageWidget::copy_area_image_data(int area_start_row, int area_start_co
             return false;
     }
 
-    Vec3b *ori_ptr = &area_data[0];
-    Vec3b *dst_ptr = &img_data[area_start_row*img_cols + area_start_col];
-
-    for(unsigned row = 0; row < area_rows; ++row) {
-        for(unsigned col = 0; col < area_cols; ++col) {
-            *dst_ptr = *ori_ptr;
-            ++dst_ptr;
-            ++ori_ptr;
-        }
-
-        dst_ptr += img_cols - area_cols;
-    }
-
     return true;
 }
 
@@ -0,0 +1,31 @@
+#ifndef _TEST_DISK_IMAGE_H
+#define _TEST_DISK_IMAGE_H
+
+#include "OutOfCore/DiskBigImage.hpp"
+
+#include <string>
+
+/*
+ * the test image shared by the tests of the big image in the disk, defined in testDiskImageStorage.cpp
+ */
+
+typedef DiskBigImage<Vec3b> DiskImageType;
+typedef boost::shared_ptr<DiskImageType> DiskImagePtr;
+
+static const size_t TEST_ROWS = 600, TEST_COLS = 700;
+
+/* the cell of the test image, the top-left 128 x 128 block is uniform */
+Vec3b test_cell(size_t row, size_t col);
+
+bool is_same_cell(const Vec3b &a, const Vec3b &b);
+
+/* write the test image by HierarchicalImage in the storage format and codec */
+bool write_test_image(const std::string &file_name, ImageStorage::StorageFormat format, NodeCodec::CodecType codec);
+
+/* checks the rectangle read from the level 0 is the same with the test image */
+bool is_same_area(DiskImageType &image, int start_row, int start_col, int rows, int cols);
+
+/* the file in the test directory of the arguments, empty if the directory is not given */
+std::string get_test_file_name(int argc, char **argv, const char *name);
+
+#endif
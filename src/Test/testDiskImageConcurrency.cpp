@@ -0,0 +1,61 @@
+#include "OutOfCore/DiskBigImage.hpp"
+#include "OutOfCore/ImageCacheManager.hpp"
+#include "testDiskImage.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+
+/*
+ * test the concurrent reading of one DiskBigImage by several threads. Input the directory for the test image files
+ */
+
+using namespace std;
+
+static void read_image_areas(DiskImageType *image, int thread_no, int *failures)
+{
+	for(int i = 0; i < 200; ++i) {
+		int start_row = (i*37 + thread_no*11) % (TEST_ROWS - 64), start_col = (i*53 + thread_no*7) % (TEST_COLS - 64);
+		if(!is_same_area(*image, start_row, start_col, 64, 64)) ++(*failures);
+	}
+}
+
+/* read the image in the threads concurrently, with the small byte budget of all the caches */
+bool test_concurrent_reading(int argc, char **argv)
+{
+	string file_name = get_test_file_name(argc, argv, "concurrent.bigimage");
+	if(file_name.empty() || !write_test_image(file_name, ImageStorage::PACKED_STORAGE, NodeCodec::DELTA_RLE_CODEC)) return false;
+
+	DiskImagePtr image = load_disk_image<Vec3b>(file_name);
+	if(!image) return false;
+	image->set_file_cache_number(0);
+	image->set_prefetch_policy(DiskImageType::PREFETCH_NEIGHBOURS);
+
+	uint64 former_budget = ImageCacheManager::instance().get_byte_budget();
+	ImageCacheManager::instance().set_byte_budget(16*4096*sizeof(Vec3b));
+
+	const int thread_number = 8;
+	std::vector<int> failures(thread_number, 0);
+	boost::thread_group threads;
+	for(int i = 0; i < thread_number; ++i) {
+		threads.create_thread(boost::bind(&read_image_areas, image.get(), i, &failures[i]));
+	}
+	threads.join_all();
+
+	bool correct = true;
+	for(int i = 0; i < thread_number; ++i) {
+		if(failures[i] > 0) correct = false;
+	}
+
+	image.reset();
+	ImageCacheManager::instance().set_byte_budget(former_budget);
+
+	if(correct)
+		cout << "the concurrent reading result is correct" << endl;
+	else
+		cout << "the concurrent reading result is not correct" << endl;
+	return correct;
+}
@@ -0,0 +1,95 @@
+#include "OutOfCore/HierarchicalImage.hpp"
+#include "OutOfCore/DiskBigImage.hpp"
+#include "testDiskImage.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+/*
+ * test the deduplication of the packed image : the nodes of the same content are saved once, and the shared
+ * node is copied when it is written again. Input the directory for the test image files
+ */
+
+using namespace std;
+
+/* the cell repeated every 64 x 64 block, so each full node (4096 cells in the zorder) has the same content */
+static Vec3b repeated_cell(size_t row, size_t col)
+{
+	Vec3b cell;
+	cell.r = (uchar)((row % 64)*4);
+	cell.g = (uchar)((col % 64)*4);
+	cell.b = (uchar)((row + col) % 64);
+	return cell;
+}
+
+/* get the saved data position of the level 0 node in the packed image */
+static bool get_node_location(const string &file_name, size_t node_no, int64 &offset)
+{
+	BigImageHead head;
+	if(!head.load(file_name.c_str())) return false;
+
+	PackedImageStorage storage;
+	if(!storage.open(file_name, head.packed_directory_offset, BigImageHead::DIRECTORY_OFFSET_POS)) return false;
+
+	size_t bytes = 0;
+	return storage.get_node_location(0, node_no, offset, bytes);
+}
+
+/* the repeated nodes share one saved data, the modified node gets its own copy and the other keeps the content */
+bool test_node_dedup(int argc, char **argv)
+{
+	namespace bf = boost::filesystem;
+
+	string file_name = get_test_file_name(argc, argv, "node_dedup.bigimage");
+	if(file_name.empty()) return false;
+
+	{
+		HierarchicalImage<Vec3b, 8, ZOrderIndex> image(TEST_ROWS, TEST_COLS, 5, 5);
+		image.set_file_node_size(4096*3);
+		image.set_storage_format(ImageStorage::PACKED_STORAGE);
+		for(size_t row = 0; row < TEST_ROWS; ++row) {
+			for(size_t col = 0; col < TEST_COLS; ++col) {
+				image.pixel(row, col) = repeated_cell(row, col);
+			}
+		}
+		if(!image.write_image(file_name)) return false;
+	}
+
+	/* the node 0 is the block (0, 0) and the node 1 is the block (0, 64) */
+	int64 first_offset = 0, second_offset = 0;
+	bool correct = get_node_location(file_name, 0, first_offset) && get_node_location(file_name, 1, second_offset)
+		&& first_offset == second_offset;
+
+	/* the whole level 0 is much larger than the saved nodes */
+	correct = correct && bf::file_size(file_name) < TEST_ROWS*TEST_COLS*sizeof(Vec3b)/4;
+
+	std::vector<Vec3b> block(64*64);
+	for(size_t i = 0; i < block.size(); ++i) block[i] = test_cell(200 + i/64, 300 + i%64);
+	{
+		DiskImagePtr image = load_disk_image<Vec3b>(file_name);
+		correct = correct && image && image->set_pixel_by_level(0, 0, 0, 64, 64, block);
+	}
+
+	/* the modified node is moved to its own copy */
+	correct = correct && get_node_location(file_name, 0, first_offset) && get_node_location(file_name, 1, second_offset)
+		&& first_offset != second_offset;
+
+	DiskImagePtr image = load_disk_image<Vec3b>(file_name);
+	std::vector<Vec3b> cells;
+	correct = correct && image && image->read_pixels_by_level(0, 0, 0, 64, 128, cells);
+	for(size_t row = 0; correct && row < 64; ++row) {
+		for(size_t col = 0; col < 128; ++col) {
+			Vec3b cell = (col < 64) ? block[row*64 + col] : repeated_cell(row, col);
+			if(!is_same_cell(cells[row*128 + col], cell)) correct = false;
+		}
+	}
+
+	if(correct)
+		cout << "the node dedup result is correct" << endl;
+	else
+		cout << "the node dedup result is not correct" << endl;
+	return correct;
+}
@@ -0,0 +1,72 @@
+#include "OutOfCore/DiskBigImage.hpp"
+#include "testDiskImage.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+/*
+ * test the writing back of the changed image data by DiskBigImage::flush() and the eviction of the cache.
+ * Input the directory for the test image files
+ */
+
+using namespace std;
+
+/* write the image after flush(), the copy of the image file must be loadable at any time after the flush */
+bool test_write_after_flush(int argc, char **argv)
+{
+	namespace bf = boost::filesystem;
+
+	string file_name = get_test_file_name(argc, argv, "flush.bigimage");
+	string copy_name = get_test_file_name(argc, argv, "flush_copy.bigimage");
+	if(file_name.empty()) return false;
+
+	std::vector<Vec3b> block(64*64);
+	for(size_t i = 0; i < block.size(); ++i) block[i] = test_cell(i % 500 + 100, i % 600);
+
+	bool correct = true;
+	for(int codec = NodeCodec::NO_CODEC; codec <= NodeCodec::ZLIB_CODEC; ++codec) {
+		if(!write_test_image(file_name, ImageStorage::PACKED_STORAGE, NodeCodec::CodecType(codec))) return false;
+
+		DiskImagePtr image = load_disk_image<Vec3b>(file_name);
+		if(!image) return false;
+		image->set_file_cache_number(4);
+
+		/* the uniform node is moved when written, then flushed */
+		bool same = image->set_pixel_by_level(0, 0, 0, 64, 64, block) && image->flush();
+
+		/* write another uniform node and evict it, so it is appended after the flushed directory */
+		same = same && image->set_pixel_by_level(0, 64, 64, 64, 64, block);
+		for(int i = 0; i < 16; ++i) {
+			same = same && is_same_area(*image, 128 + (i*61) % 400, 128 + (i*97) % 500, 64, 64);
+		}
+
+		bf::copy_file(file_name, copy_name, bf::copy_option::overwrite_if_exists);
+		DiskImagePtr copy_image = load_disk_image<Vec3b>(copy_name);
+		std::vector<Vec3b> cells;
+		same = same && copy_image && copy_image->read_pixels_by_level(0, 0, 0, 64, 64, cells) && is_same_area(*copy_image, 128, 128, 300, 300);
+		for(size_t i = 0; same && i < block.size(); ++i) {
+			if(!is_same_cell(cells[i], block[i])) same = false;
+		}
+
+		/* all the changes are kept after closing */
+		image.reset();
+		copy_image.reset();
+		image = load_disk_image<Vec3b>(file_name);
+		same = same && image && image->read_pixels_by_level(0, 64, 64, 64, 64, cells);
+		for(size_t i = 0; same && i < block.size(); ++i) {
+			if(!is_same_cell(cells[i], block[i])) same = false;
+		}
+
+		cout << "codec " << codec << (same ? " : correct" : " : not correct") << endl;
+		correct = correct && same;
+	}
+
+	if(correct)
+		cout << "the write after flush result is correct" << endl;
+	else
+		cout << "the write after flush result is not correct" << endl;
+	return correct;
+}
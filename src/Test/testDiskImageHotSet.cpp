@@ -0,0 +1,50 @@
+#include "OutOfCore/DiskBigImage.hpp"
+#include "testDiskImage.h"
+
+#include <iostream>
+#include <string>
+
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+
+/*
+ * test the hot set of the image file cache, which is saved when the image is destroyed and preloaded by the next
+ * loading. Input the directory for the test image files
+ */
+
+using namespace std;
+
+/* the hot set saved when the image is destroyed is loaded into the cache by the next load_disk_image() */
+bool test_hot_set(int argc, char **argv)
+{
+	namespace bf = boost::filesystem;
+
+	string file_name = get_test_file_name(argc, argv, "hot_set.bigimage");
+	if(file_name.empty() || !write_test_image(file_name, ImageStorage::PACKED_STORAGE, NodeCodec::NO_CODEC)) return false;
+
+	string hot_set_name = get_test_file_name(argc, argv, "hot_set.hotset");
+	bf::remove(hot_set_name);
+
+	bool correct = false;
+	{
+		DiskImagePtr image = load_disk_image<Vec3b>(file_name);
+		correct = image && image->get_cached_bytes(0) == 0 && is_same_area(*image, 200, 200, 200, 200);
+		if(image) image->set_keep_hot_set(true);
+	}
+	correct = correct && bf::exists(hot_set_name);
+
+	DiskImagePtr image = load_disk_image<Vec3b>(file_name);
+	correct = correct && image;
+
+	/* the hot set is loaded in the background */
+	for(int i = 0; correct && i < 100 && image->get_cached_bytes(0) == 0; ++i) {
+		boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+	}
+	correct = correct && image->get_cached_bytes(0) > 0 && is_same_area(*image, 200, 200, 200, 200);
+
+	if(correct)
+		cout << "the hot set result is correct" << endl;
+	else
+		cout << "the hot set result is not correct" << endl;
+	return correct;
+}
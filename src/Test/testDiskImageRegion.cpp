@@ -0,0 +1,139 @@
+#include "OutOfCore/DiskBigImage.hpp"
+#include "testDiskImage.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+ * test the reading of the image regions without copying the cells by read_pixels_by_level().
+ * Input the directory for the test image files
+ */
+
+using namespace std;
+
+/* checks the views of get_region_view() get the same cells as read_pixels_by_level() */
+static bool is_same_region_view(DiskImageType &image)
+{
+	/* a file node of 4096 cells is an aligned 64 x 64 block, the uniform one too */
+	for(int i = 0; i < 4; ++i) {
+		int start_row = (i % 2)*64, start_col = (i + 1)*64;
+		ImageRegionView<Vec3b> view;
+		std::vector<Vec3b> cells;
+		if(!image.get_region_view(0, start_row, start_col, 64, 64, view) ||
+			!image.read_pixels_by_level(0, start_row, start_col, 64, 64, cells)) return false;
+
+		for(int row = 0; row < 64; ++row) {
+			for(int col = 0; col < 64; ++col) {
+				if(!is_same_cell(view.at(row, col), cells[row*64 + col])) return false;
+			}
+		}
+	}
+	return true;
+}
+
+/* the view may outlive its image, the changes of the image are saved before the view is released */
+bool test_region_view(int argc, char **argv)
+{
+	string file_name = get_test_file_name(argc, argv, "region_view.bigimage");
+	if(file_name.empty() || !write_test_image(file_name, ImageStorage::PACKED_STORAGE, NodeCodec::NO_CODEC)) return false;
+
+	std::vector<Vec3b> block(64*64);
+	for(size_t i = 0; i < block.size(); ++i) block[i] = test_cell(300 + i/64, 400 + i%64);
+
+	DiskImagePtr image = load_disk_image<Vec3b>(file_name);
+	bool correct = image && is_same_region_view(*image);
+
+	/* the changed file node is kept by the view */
+	ImageRegionView<Vec3b> view;
+	correct = correct && image->set_pixel_by_level(0, 192, 192, 64, 64, block) && 
+		image->get_region_view(0, 192, 192, 64, 64, view);
+	image.reset();
+
+	for(int row = 0; correct && row < 64; ++row) {
+		for(int col = 0; col < 64; ++col) {
+			if(!is_same_cell(view.at(row, col), block[row*64 + col])) correct = false;
+		}
+	}
+	view.reset();
+
+	std::vector<Vec3b> cells;
+	image = load_disk_image<Vec3b>(file_name);
+	correct = correct && image && image->read_pixels_by_level(0, 192, 192, 64, 64, cells) && 
+		is_same_area(*image, 256, 0, 300, 600);
+	for(size_t i = 0; correct && i < block.size(); ++i) {
+		if(!is_same_cell(cells[i], block[i])) correct = false;
+	}
+
+	if(correct)
+		cout << "the region view result is correct" << endl;
+	else
+		cout << "the region view result is not correct" << endl;
+	return correct;
+}
+
+/* checks read_regions() gets the same cells as read_pixels_by_level() */
+static bool is_same_region_reading(DiskImageType &image)
+{
+	std::vector<std::vector<Vec3b> > buffers(5);
+	std::vector<ImageRegionRequest<Vec3b> > requests;
+	for(int i = 0; i < 5; ++i) {
+		/* the row stride is larger than the cols */
+		buffers[i].resize(50*48);
+		requests.push_back(ImageRegionRequest<Vec3b>(0, i*90, i*110, 50, 40, &buffers[i][0], 48*sizeof(Vec3b)));
+	}
+	if(!image.read_regions(requests)) return false;
+
+	for(int i = 0; i < 5; ++i) {
+		std::vector<Vec3b> cells;
+		if(!image.read_pixels_by_level(0, i*90, i*110, 50, 40, cells)) return false;
+		for(int row = 0; row < 50; ++row) {
+			for(int col = 0; col < 40; ++col) {
+				if(!is_same_cell(buffers[i][row*48 + col], cells[row*40 + col])) return false;
+			}
+		}
+	}
+	return true;
+}
+
+/* read the regions of several file nodes together into the caller buffers */
+bool test_region_reading(int argc, char **argv)
+{
+	string file_name = get_test_file_name(argc, argv, "region.bigimage");
+	if(file_name.empty() || !write_test_image(file_name, ImageStorage::PACKED_STORAGE, NodeCodec::NO_CODEC)) return false;
+
+	DiskImagePtr image = load_disk_image<Vec3b>(file_name);
+	bool correct = image && is_same_region_reading(*image);
+
+	if(correct)
+		cout << "the region reading result is correct" << endl;
+	else
+		cout << "the region reading result is not correct" << endl;
+	return correct;
+}
+
+/* the mapped image gets the same cells as the image file, and it is read-only */
+bool test_mapped_image(int argc, char **argv)
+{
+	string file_name = get_test_file_name(argc, argv, "mapped.bigimage");
+	if(file_name.empty() || !write_test_image(file_name, ImageStorage::PACKED_STORAGE, NodeCodec::NO_CODEC)) return false;
+
+	DiskImagePtr image = load_disk_image<Vec3b>(file_name, MAPPED_IMAGE_ACCESS);
+	bool correct = image && image->get_access_mode() == MAPPED_IMAGE_ACCESS && is_same_area(*image, 0, 0, TEST_ROWS, TEST_COLS)
+		&& is_same_region_reading(*image) && is_same_region_view(*image);
+
+	std::vector<Vec3b> cells(4);
+	if(image && image->set_pixel_by_level(0, 0, 0, 2, 2, cells)) correct = false;
+
+	/* the compressed image can't be mapped, it is read by the file caches instead */
+	image.reset();
+	if(!write_test_image(file_name, ImageStorage::PACKED_STORAGE, NodeCodec::ZLIB_CODEC)) return false;
+	image = load_disk_image<Vec3b>(file_name, MAPPED_IMAGE_ACCESS);
+	correct = correct && image && image->get_access_mode() == CACHED_IMAGE_ACCESS && is_same_area(*image, 0, 0, TEST_ROWS, TEST_COLS);
+
+	if(correct)
+		cout << "the mapped image result is correct" << endl;
+	else
+		cout << "the mapped image result is not correct" << endl;
+	return correct;
+}
@@ -0,0 +1,152 @@
+#include "OutOfCore/HierarchicalImage.hpp"
+#include "OutOfCore/DiskBigImage.hpp"
+#include "testDiskImage.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+/*
+ * test the storage of the big image in the disk : write the image by HierarchicalImage, load it by DiskBigImage,
+ * then compare the cells read back with the cells written. Input the directory for the test image files
+ */
+
+using namespace std;
+
+Vec3b test_cell(size_t row, size_t col)
+{
+	Vec3b cell;
+	if(row < 128 && col < 128) return Vec3b();
+	cell.r = (uchar)(row & 255);
+	cell.g = (uchar)(col & 255);
+	cell.b = (uchar)((row*7 + col*13) & 255);
+	return cell;
+}
+
+bool is_same_cell(const Vec3b &a, const Vec3b &b)
+{
+	return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+bool write_test_image(const string &file_name, ImageStorage::StorageFormat format, NodeCodec::CodecType codec)
+{
+	HierarchicalImage<Vec3b, 8, ZOrderIndex> image(TEST_ROWS, TEST_COLS, 5, 5);
+	image.set_file_node_size(4096*3);
+	image.set_storage_format(format);
+	image.set_compression_codec(codec);
+	for(size_t row = 0; row < TEST_ROWS; ++row) {
+		for(size_t col = 0; col < TEST_COLS; ++col) {
+			image.pixel(row, col) = test_cell(row, col);
+		}
+	}
+	return image.write_image(file_name);
+}
+
+bool is_same_area(DiskImageType &image, int start_row, int start_col, int rows, int cols)
+{
+	std::vector<Vec3b> cells;
+	if(!image.read_pixels_by_level(0, start_row, start_col, rows, cols, cells)) return false;
+
+	for(int row = 0; row < rows; ++row) {
+		for(int col = 0; col < cols; ++col) {
+			if(!is_same_cell(cells[row*cols + col], test_cell(start_row + row, start_col + col))) return false;
+		}
+	}
+	return true;
+}
+
+string get_test_file_name(int argc, char **argv, const char *name)
+{
+	namespace bf = boost::filesystem;
+	if(argc < 2) {
+		cout << "Usage : [test directory]" << endl;
+		return string();
+	}
+
+	bf::create_directories(argv[1]);
+	return (bf::path(argv[1]) / name).generic_string();
+}
+
+/* write the image in each storage format and codec, reopen it and read it back */
+bool test_storage_round_trip(int argc, char **argv)
+{
+	string file_name = get_test_file_name(argc, argv, "round_trip.bigimage");
+	if(file_name.empty()) return false;
+
+	bool correct = true;
+	for(int packed = 0; packed < 2; ++packed) {
+		for(int codec = NodeCodec::NO_CODEC; codec <= NodeCodec::ZLIB_CODEC; ++codec) {
+			ImageStorage::StorageFormat format = packed ? ImageStorage::PACKED_STORAGE : ImageStorage::DIRECTORY_STORAGE;
+			if(!write_test_image(file_name, format, NodeCodec::CodecType(codec))) return false;
+
+			DiskImagePtr image = load_disk_image<Vec3b>(file_name);
+			bool same = image && is_same_area(*image, 0, 0, TEST_ROWS, TEST_COLS);
+
+			cout << "packed " << packed << " codec " << codec << (same ? " : correct" : " : not correct") << endl;
+			correct = correct && same;
+		}
+	}
+
+	if(correct)
+		cout << "the storage round trip result is correct" << endl;
+	else
+		cout << "the storage round trip result is not correct" << endl;
+	return correct;
+}
+
+/* the level 1 image is the 2x2 box averaging of the level 0, the odd sized image has the border blocks of
+ * 1 or 2 valid cells, the padding of the index method is not counted */
+bool test_level_averaging(int argc, char **argv)
+{
+	const size_t rows = 301, cols = 347;
+	string file_name = get_test_file_name(argc, argv, "level_averaging.bigimage");
+	if(file_name.empty()) return false;
+
+	{
+		HierarchicalImage<Vec3b, 8, ZOrderIndex> image(rows, cols, 5, 5);
+		image.set_file_node_size(4096*3);
+		for(size_t row = 0; row < rows; ++row) {
+			for(size_t col = 0; col < cols; ++col) {
+				image.pixel(row, col) = test_cell(row, col);
+			}
+		}
+		if(!image.write_image(file_name)) return false;
+	}
+
+	const size_t level_rows = (rows + 1)/2, level_cols = (cols + 1)/2;
+	DiskImagePtr image = load_disk_image<Vec3b>(file_name);
+	std::vector<Vec3b> cells;
+	bool correct = image && image->read_pixels_by_level(1, 0, 0, level_rows, level_cols, cells);
+
+	for(size_t row = 0; correct && row < level_rows; ++row) {
+		for(size_t col = 0; col < level_cols; ++col) {
+			int sum[3] = {0, 0, 0}, weight = 0;
+			for(size_t k = 0; k < 4; ++k) {
+				size_t cell_row = 2*row + k/2, cell_col = 2*col + k%2;
+				if(cell_row >= rows || cell_col >= cols) continue;
+
+				Vec3b cell = test_cell(cell_row, cell_col);
+				sum[0] += cell.r;
+				sum[1] += cell.g;
+				sum[2] += cell.b;
+				++weight;
+			}
+
+			/* the rounded mean of the valid cells */
+			const Vec3b &cell = cells[row*level_cols + col];
+			if(cell.r != (2*sum[0] + weight)/(2*weight) || cell.g != (2*sum[1] + weight)/(2*weight) || 
+				cell.b != (2*sum[2] + weight)/(2*weight)) {
+				correct = false;
+				break;
+			}
+		}
+	}
+
+	if(correct)
+		cout << "the level averaging result is correct" << endl;
+	else
+		cout << "the level averaging result is not correct" << endl;
+	return correct;
+}
@@ -162,3 +162,67 @@ bool test_big_image_containter(int argc, char **argv)
 
 	return true;
 }
+
+/*
+ * test the pinned tile of the image container
+ * 1) fill the image by the per pixel access
+ * 2) pin every tile to check the tile data, and invert the tile data
+ * 3) unpin the tile to write back, check the image data
+ */
+bool test_image_tile(int argc, char **argv)
+{
+	if(argc < 4) {
+		cout << "Usage : [rows] [cols] [tile order]" << endl;
+		return false;
+	}
+
+	int rows = atoi(argv[1]);
+	int cols = atoi(argv[2]);
+	int tile_order = atoi(argv[3]);
+
+	typedef BlockwiseImage<Vec3b, 64, ZOrderIndex> ImageType;
+	ImageType big_image(rows, cols, 1, 1);
+
+	boost::timer t;
+	for(int row = 0; row < rows; ++row) {
+		for(int col = 0; col < cols; ++col) {
+			Vec3b &pixel = big_image.pixel(row, col);
+			pixel.r = (uchar)(row); pixel.g = (uchar)(col); pixel.b = (uchar)(row + col);
+		}
+	}
+	cout << "fill the image by pixel cost time : " << t.elapsed() << " s " << endl;
+
+	t.restart();
+	bool correct = true;
+	for(int tile_row = 0; (tile_row << tile_order) < rows; ++tile_row) {
+		for(int tile_col = 0; (tile_col << tile_order) < cols; ++tile_col) {
+			ImageTile<Vec3b> tile;
+			if(!big_image.pin_tile(tile_row, tile_col, tile_order, tile)) return false;
+
+			for(int row = 0; row < tile.get_rows(); ++row) {
+				Vec3b *row_data = tile.data() + row * tile.get_stride();
+				for(int col = 0; col < tile.get_cols(); ++col) {
+					if(row_data[col].r != (uchar)(tile.get_start_row() + row) || row_data[col].g != (uchar)(tile.get_start_col() + col))
+						correct = false;
+					row_data[col].b = ~row_data[col].b;
+				}
+			}
+
+			big_image.unpin_tile(tile);
+		}
+	}
+	cout << "access the image by tile cost time : " << t.elapsed() << " s " << endl;
+
+	for(int row = 0; row < rows; ++row) {
+		for(int col = 0; col < cols; ++col) {
+			if(big_image.pixel(row, col).b != (uchar)(~(uchar)(row + col))) correct = false;
+		}
+	}
+
+	if(correct)
+		cout << "the tile result is correct" << endl;
+	else
+		cout << "the tile result is not correct" << endl;
+
+	return correct;
+}
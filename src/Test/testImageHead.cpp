@@ -0,0 +1,98 @@
+#include "OutOfCore/DiskBigImage.hpp"
+#include "testDiskImage.h"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+/*
+ * test the head of the big image : the image with the former text head stays loadable and writable.
+ * Input the directory for the test image files
+ */
+
+using namespace std;
+
+/* write the image with the former text head : the text lines with the optional extra line, and the node files
+ * of each level in the image data directory */
+static bool write_text_head_image(const string &file_name, const string &extra_line)
+{
+	namespace bf = boost::filesystem;
+
+	const int shift_num = 12;
+	const size_t max_level = 2, node_size = size_t(1) << shift_num;
+
+	ZOrderIndex index_method(TEST_ROWS, TEST_COLS);
+	std::vector<Vec3b> cells(size_t(index_method.get_max_index() + 1));
+	for(size_t row = 0; row < TEST_ROWS; ++row) {
+		for(size_t col = 0; col < TEST_COLS; ++col) {
+			cells[size_t(index_method.get_index(row, col))] = test_cell(row, col);
+		}
+	}
+
+	{
+		ofstream fout(file_name.c_str(), ios::out | ios::trunc);
+		fout << "type=BlockwiseImage\nrows=" << TEST_ROWS << "\ncols=" << TEST_COLS << "\nfilenodesize=" << node_size
+			<< "\nfilenodeshiftnum=" << shift_num << "\nindexmethod=ZOrderIndex\nminirows=1\nminicols=1\nmaxlevel=" << max_level
+			<< "\n" << extra_line;
+		if(!fout.good()) return false;
+	}
+
+	bf::path file_path(file_name);
+	bf::path data_path = file_path.parent_path() / file_path.stem();
+	bf::remove_all(data_path);
+
+	DirectoryImageStorage storage(data_path.generic_string());
+	for(size_t level = 0; level <= max_level; ++level) {
+		std::vector<Vec3b> level_cells;
+		for(size_t i = 0; i < cells.size(); i += (size_t(1) << (2*level))) level_cells.push_back(cells[i]);
+
+		if(!storage.create_level(level)) return false;
+		for(size_t node = 0; node*node_size < level_cells.size(); ++node) {
+			size_t bytes = std::min(node_size, level_cells.size() - node*node_size)*sizeof(Vec3b);
+			if(!storage.write_node(level, node, &level_cells[node*node_size], bytes)) return false;
+		}
+	}
+	return storage.close();
+}
+
+/* the image with the former text head must stay loadable and writable, the text head with the packed storage
+ * is rejected */
+bool test_text_head_image(int argc, char **argv)
+{
+	string file_name = get_test_file_name(argc, argv, "text_head.bigimage");
+	if(file_name.empty() || !write_text_head_image(file_name, "")) return false;
+
+	std::vector<Vec3b> block(64*64);
+	for(size_t i = 0; i < block.size(); ++i) block[i] = test_cell(200 + i/64, 300 + i%64);
+
+	bool correct = false;
+	{
+		DiskImagePtr image = load_disk_image<Vec3b>(file_name);
+		correct = image && is_same_area(*image, 0, 0, TEST_ROWS, TEST_COLS);
+		correct = correct && image->set_pixel_by_level(0, 0, 128, 64, 64, block);
+	}
+
+	DiskImagePtr image = load_disk_image<Vec3b>(file_name);
+	std::vector<Vec3b> cells;
+	correct = correct && image && image->read_pixels_by_level(0, 0, 0, 256, 256, cells);
+	for(size_t row = 0; correct && row < 256; ++row) {
+		for(size_t col = 0; col < 256; ++col) {
+			Vec3b cell = test_cell(row, col);
+			if(row < 64 && col >= 128 && col < 192) cell = block[row*64 + col - 128];
+			if(!is_same_cell(cells[row*256 + col], cell)) correct = false;
+		}
+	}
+
+	image.reset();
+	if(!write_text_head_image(file_name, "storage=packed\n")) return false;
+	if(load_disk_image<Vec3b>(file_name)) correct = false;
+
+	if(correct)
+		cout << "the text head image result is correct" << endl;
+	else
+		cout << "the text head image result is not correct" << endl;
+	return correct;
+}
@@ -231,4 +231,224 @@ bool test_zorder_index(int argc, char **argv)
 	}
 
 	return true;
-}
\ No newline at end of file
+}
+
+/* test the index ranges decomposition, compare the fast result with the sorting way of the base interface */
+static bool is_same_index_ranges(const IndexMethodInterface &method, size_t start_row, size_t start_col, 
+	size_t rows, size_t cols)
+{
+	typedef IndexMethodInterface::IndexRange IndexRange;
+
+	std::vector<IndexRange> fast_ranges, sort_ranges;
+	method.get_index_ranges(start_row, start_col, rows, cols, fast_ranges);
+	method.IndexMethodInterface::get_index_ranges(start_row, start_col, rows, cols, sort_ranges);
+
+	cout << method.get_index_method_name() << " range number : " << fast_ranges.size() << endl;
+	if(fast_ranges.size() != sort_ranges.size()) return false;
+
+	for(size_t i = 0; i < fast_ranges.size(); ++i) {
+		if(fast_ranges[i].front != sort_ranges[i].front || fast_ranges[i].tail != sort_ranges[i].tail)
+			return false;
+	}
+	return true;
+}
+
+bool test_index_ranges(int argc, char **argv)
+{
+	if(argc < 7) {
+		cout << "Usage : [row count] [col count] [start_row] [start_col] [rows] [cols]" << endl;
+		return false;
+	}
+
+	size_t row_count = atoi(argv[1]);
+	size_t col_count = atoi(argv[2]);
+	size_t start_row = atoi(argv[3]);
+	size_t start_col = atoi(argv[4]);
+	size_t rows = atoi(argv[5]);
+	size_t cols = atoi(argv[6]);
+
+	if(start_row + rows > row_count || start_col + cols > col_count) {
+		cout << "the range is out of the image" << endl;
+		return false;
+	}
+
+	bool correct = true;
+	ZOrderIndex zorder(row_count, col_count);
+	if(is_same_index_ranges(zorder, start_row, start_col, rows, cols)) {
+		cout << "the zorder result is correct" << endl;
+	} else {
+		cout << "the zorder result is not correct" << endl;
+		correct = false;
+	}
+
+	ZOrderIndexIntuition zorder_intuition(row_count, col_count);
+	if(is_same_index_ranges(zorder_intuition, start_row, start_col, rows, cols)) {
+		cout << "the zorder intuition result is correct" << endl;
+	} else {
+		cout << "the zorder intuition result is not correct" << endl;
+		correct = false;
+	}
+
+	HilbertIndex hilbert(row_count, col_count);
+	if(is_same_index_ranges(hilbert, start_row, start_col, rows, cols)) {
+		cout << "the hilbert result is correct" << endl;
+	} else {
+		cout << "the hilbert result is not correct" << endl;
+		correct = false;
+	}
+
+	TiledZOrderIndex tiled(row_count, col_count, 3);
+	if(is_same_index_ranges(tiled, start_row, start_col, rows, cols)) {
+		cout << "the tiled zorder result is correct" << endl;
+	} else {
+		cout << "the tiled zorder result is not correct" << endl;
+		correct = false;
+	}
+
+	Block2DIndex block(row_count, col_count, 2, 3);
+	if(is_same_index_ranges(block, start_row, start_col, rows, cols)) {
+		cout << "the block result is correct" << endl;
+	} else {
+		cout << "the block result is not correct" << endl;
+		correct = false;
+	}
+
+	return correct;
+}
+
+/* test the hilbert index method, input the rows, cols and the hierarchical level for testing */
+bool test_hilbert_index(int argc, char **argv)
+{
+	if(argc < 4) {
+		cout << "Usage : [row count] [col count] [level]" << endl;
+		return false;
+	}
+
+	typedef HilbertIndex::IndexType IndexType;
+	typedef HilbertIndex::RowMajorIndexType RowMajorType;
+
+	RowMajorType row_count = atoi(argv[1]);
+	RowMajorType col_count = atoi(argv[2]);
+	size_t level = atoi(argv[3]);
+
+	HilbertIndex hilbert(row_count, col_count);
+	boost::shared_ptr<IndexMethodInterface> level_method = hilbert.get_level_index_method(level);
+
+	bool correct = true;
+	IndexType max_index = 0;
+	for(RowMajorType row = 0; row < row_count; ++row) {
+		for(RowMajorType col = 0; col < col_count; ++col) {
+			IndexType index = hilbert.get_index(row, col);
+			max_index = std::max(max_index, index);
+
+			/* the index must be converted back to the same cell */
+			RowMajorPoint point = hilbert.get_origin_index(index);
+			if(point.row != row || point.col != col) correct = false;
+
+			/* the cell index of the scaled image must be index / 4^level */
+			if(level_method->get_index(row >> level, col >> level) != (index >> (2*level))) correct = false;
+		}
+	}
+	if(max_index != hilbert.get_max_index()) correct = false;
+
+	if(correct)
+		cout << "the hilbert result is correct" << endl;
+	else
+		cout << "the hilbert result is not correct" << endl;
+
+	return correct;
+}
+
+/* checks the batch row indexes are the same with the index of each cell */
+static bool is_same_row_indexes(const IndexMethodInterface &method, size_t row_count, size_t col_count)
+{
+	std::vector<IndexMethodInterface::IndexType> row_indexes(col_count);
+	for(size_t row = 0; row < row_count; ++row) {
+		/* a different start col for each row to test the unaligned cols */
+		size_t col_begin = row % col_count;
+		method.get_row_indexes(row, col_begin, col_count, row_indexes.data());
+
+		for(size_t col = col_begin; col < col_count; ++col) {
+			if(row_indexes[col - col_begin] != method.get_index(row, col)) return false;
+		}
+	}
+	return true;
+}
+
+/* test the batch row indexes of the index methods, input the rows, cols for testing */
+bool test_row_indexes(int argc, char **argv)
+{
+	if(argc < 3) {
+		cout << "Usage : [row count] [col count]" << endl;
+		return false;
+	}
+
+	size_t row_count = atoi(argv[1]);
+	size_t col_count = atoi(argv[2]);
+
+	bool correct = is_same_row_indexes(ZOrderIndex(row_count, col_count), row_count, col_count)
+		&& is_same_row_indexes(TiledZOrderIndex(row_count, col_count, 3), row_count, col_count)
+		&& is_same_row_indexes(HilbertIndex(row_count, col_count), row_count, col_count);
+
+	if(correct)
+		cout << "the row indexes result is correct" << endl;
+	else
+		cout << "the row indexes result is not correct" << endl;
+
+	return correct;
+}
+
+/* test the bmi2 zorder kernel against the magic bits kernel over the boundary and the random numbers,
+ * it is skipped when the cpu doesn't support the bmi2 */
+bool test_zorder_kernel(int /*argc*/, char ** /*argv*/)
+{
+	bool correct = true;
+#ifdef ZORDER_KERNEL_HAS_BMI2
+	if(!cpu_support_bmi2()) {
+		cout << "the cpu doesn't support the bmi2, the zorder kernel test is skipped" << endl;
+		return true;
+	}
+
+	std::vector<ulonglong> numbers;
+	const ulonglong boundaries[] = { 0ULL, 1ULL, 2ULL, 3ULL, 0x7FFFFFFFULL, 0x80000000ULL, 0xFFFFFFFFULL, 
+		0x100000000ULL, 0x5555555555555555ULL, 0xAAAAAAAAAAAAAAAAULL, 0x7FFFFFFFFFFFFFFFULL, 0xFFFFFFFFFFFFFFFFULL };
+	numbers.assign(boundaries, boundaries + sizeof(boundaries)/sizeof(boundaries[0]));
+	for(int bit = 0; bit < 64; ++bit) {
+		numbers.push_back(1ULL << bit);
+		numbers.push_back((1ULL << bit) - 1);
+	}
+
+	/* the xorshift random numbers, the same sequence each time */
+	ulonglong random = 88172645463325252ULL;
+	for(int i = 0; i < 100000; ++i) {
+		random ^= random << 13;
+		random ^= random >> 7;
+		random ^= random << 17;
+		numbers.push_back(random);
+	}
+
+	for(size_t i = 0; i < numbers.size(); ++i) {
+		ulonglong x = numbers[i];
+		if(zorder_spread_bits(x) != zorder_spread_bits_bmi2(x) || zorder_compact_bits(x) != zorder_compact_bits_bmi2(x)) {
+			cout << "the zorder kernel differs at 0x" << hex << x << dec << endl;
+			correct = false;
+			break;
+		}
+
+		ulonglong row = 0, col = 0;
+		zorder_decode_bmi2(x, row, col);
+		if(row != zorder_compact_bits(x >> 1) || col != zorder_compact_bits(x)) {
+			cout << "the zorder decoding differs at 0x" << hex << x << dec << endl;
+			correct = false;
+			break;
+		}
+	}
+#endif
+
+	if(correct)
+		cout << "the zorder kernel result is correct" << endl;
+	else
+		cout << "the zorder kernel result is not correct" << endl;
+
+	return correct;
+}
@@ -2,14 +2,44 @@ using namespace std;
 
 extern bool test_read_level_range_image(int argc, char **argv);
 extern bool test_big_image_containter(int argc, char **argv);
+extern bool test_image_tile(int argc, char **argv);
 extern bool test_zorder_index(int argc, char **argv);
 extern bool test_block_index(int argc, char **argv);
+extern bool test_index_ranges(int argc, char **argv);
+extern bool test_hilbert_index(int argc, char **argv);
+extern bool test_row_indexes(int argc, char **argv);
+extern bool test_zorder_kernel(int argc, char **argv);
+extern bool test_storage_round_trip(int argc, char **argv);
+extern bool test_level_averaging(int argc, char **argv);
+extern bool test_write_after_flush(int argc, char **argv);
+extern bool test_text_head_image(int argc, char **argv);
+extern bool test_region_view(int argc, char **argv);
+extern bool test_region_reading(int argc, char **argv);
+extern bool test_mapped_image(int argc, char **argv);
+extern bool test_concurrent_reading(int argc, char **argv);
+extern bool test_hot_set(int argc, char **argv);
+extern bool test_node_dedup(int argc, char **argv);
 
 int main(int argc, char **argv)
 {
 	//test_zorder_index(argc, argv);
 	//test_block_index(argc, argv);
+	//test_index_ranges(argc, argv);
+	//test_hilbert_index(argc, argv);
+	//test_row_indexes(argc, argv);
+	//test_zorder_kernel(argc, argv);
 	//test_big_image_containter(argc, argv);
+	//test_image_tile(argc, argv);
+	//test_storage_round_trip(argc, argv);
+	//test_level_averaging(argc, argv);
+	//test_write_after_flush(argc, argv);
+	//test_text_head_image(argc, argv);
+	//test_region_view(argc, argv);
+	//test_region_reading(argc, argv);
+	//test_mapped_image(argc, argv);
+	//test_concurrent_reading(argc, argv);
+	//test_hot_set(argc, argv);
+	//test_node_dedup(argc, argv);
 	test_read_level_range_image(argc, argv);
 
 	return 0;
@@ -122,6 +122,23 @@ int test_normal_image_time_cost(size_t start_rows, size_t start_cols, size_t row
 	return count;
 };
 
+/*
+ * count the successive index ranges of the rectangle in the specific index method, 
+ * each range means one seek when reading the image files
+ */
+size_t test_index_method_range_count(const IndexMethodInterface &method, size_t start_rows, size_t start_cols, 
+	size_t rows, size_t cols)
+{
+	boost::timer t;
+
+	std::vector<IndexMethodInterface::IndexRange> ranges;
+	method.get_index_ranges(start_rows, start_cols, rows, cols, ranges);
+
+	print_counted_time(t, (method.get_index_method_name() + " get the index ranges").c_str());
+	cout << method.get_index_method_name() << " total range is " << ranges.size() << endl;
+	return ranges.size();
+}
+
 int main(int argc, char **argv)
 {
 	{
@@ -165,6 +182,20 @@ int main(int argc, char **argv)
 		}
 
 		cout << "count distance is " << count1 - count2 << endl;
+
+		/* compare the range count of the zorder and the hilbert curve */
+		start_rows = atoi(argv[1]);
+		start_cols = atoi(argv[2]);
+		rows = atoi(argv[3]);
+		cols = atoi(argv[4]);
+		test_index_method_range_count(ZOrderIndex(43200, 76800), start_rows, start_cols, rows, cols);
+		test_index_method_range_count(HilbertIndex(43200, 76800), start_rows, start_cols, rows, cols);
+		test_index_method_range_count(TiledZOrderIndex(43200, 76800), start_rows, start_cols, rows, cols);
+
+		/* the padding cells of the index method are also saved in the container and the image files */
+		cout << "the image cell number is " << (IndexMethodInterface::IndexType)(43200) * 76800 << endl;
+		cout << "ZOrderIndex cell number is " << ZOrderIndex(43200, 76800).get_max_index() + 1 << endl;
+		cout << "TiledZOrderIndex cell number is " << TiledZOrderIndex(43200, 76800).get_max_index() + 1 << endl;
 	}
 
 	//test_make_upper_fout_multiply();
@@ -14,7 +14,8 @@ bool test_writing_hierarchical(int argc, char ** argv)
 
 	if(argc < 7) {
 		cout << "Usage : [file name] [res row] [res col] [write image file name] [multiply ways number] [enlarge number]"
-			"[optional (set file size by M unit)] [optinal (show image)]" << endl;
+			"[optional (set file size by M unit)] [optinal (show image)] [optional (packed storage)] "
+			"[optional (codec : 0 raw, 1 delta rle, 2 zlib)]" << endl;
 		return false;
 	}
 
@@ -26,6 +27,8 @@ bool test_writing_hierarchical(int argc, char ** argv)
 	size_t enlarge_number = atoi(argv[6]);
 	int64 file_size = (argc >= 8) ? atoi(argv[7]) : 6;
 	bool show_image = (argc >= 9) ? atoi(argv[8]) : false;
+	bool packed_storage = (argc >= 10) ? atoi(argv[9]) : false;
+	int codec = (argc >= 11) ? atoi(argv[10]) : NodeCodec::NO_CODEC;
 
 	cv::Mat original_img = cv::imread(file_name);
 	if(original_img.empty()) {
@@ -52,6 +55,8 @@ bool test_writing_hierarchical(int argc, char ** argv)
 
 	HierarchicalImage<Vec3b, 512> big_image(large_rows, large_cols, mini_rows, mini_cols);
 	big_image.set_mutliply_ways_writing_number(merge_number);
+	if(packed_storage) big_image.set_storage_format(ImageStorage::PACKED_STORAGE);
+	big_image.set_compression_codec(NodeCodec::CodecType(codec));
 	cout << "mini_rows " << big_image.get_minimal_image_rows() << endl;
 	cout << "mini_cols " << big_image.get_minimal_image_cols() << endl;
 	cout << "max_level " << big_image.get_max_image_level() << endl;